@@ -9,6 +9,8 @@ copy /Y ..\%msvc%\..\..\lib\VolumeViz\details\SoVolumeSkinDetail.h %COINDIR%\inc
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\details\SoOrthoSliceDetail.h %COINDIR%\include\VolumeViz\details\SoOrthoSliceDetail.h >nul:
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\details\SoObliqueSliceDetail.h %COINDIR%\include\VolumeViz\details\SoObliqueSliceDetail.h >nul:
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoOrthoSlice.h %COINDIR%\include\VolumeViz\nodes\SoOrthoSlice.h >nul:
+copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoMultiSlice.h %COINDIR%\include\VolumeViz\nodes\SoMultiSlice.h >nul:
+copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoROI.h %COINDIR%\include\VolumeViz\nodes\SoROI.h >nul:
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoVolumeSkin.h %COINDIR%\include\VolumeViz\nodes\SoVolumeSkin.h >nul:
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoObliqueSlice.h %COINDIR%\include\VolumeViz\nodes\SoObliqueSlice.h >nul:
 copy /Y ..\%msvc%\..\..\lib\VolumeViz\nodes\SoTransferFunction.h %COINDIR%\include\VolumeViz\nodes\SoTransferFunction.h >nul:
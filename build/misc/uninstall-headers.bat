@@ -9,6 +9,8 @@ del %COINDIR%\include\VolumeViz\details\SoVolumeSkinDetail.h
 del %COINDIR%\include\VolumeViz\details\SoOrthoSliceDetail.h
 del %COINDIR%\include\VolumeViz\details\SoObliqueSliceDetail.h
 del %COINDIR%\include\VolumeViz\nodes\SoOrthoSlice.h
+del %COINDIR%\include\VolumeViz\nodes\SoMultiSlice.h
+del %COINDIR%\include\VolumeViz\nodes\SoROI.h
 del %COINDIR%\include\VolumeViz\nodes\SoVolumeSkin.h
 del %COINDIR%\include\VolumeViz\nodes\SoObliqueSlice.h
 del %COINDIR%\include\VolumeViz\nodes\SoTransferFunction.h
@@ -318,6 +318,19 @@ SOURCE=..\..\lib\VolumeViz\elements\PageSizeElement.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\lib\VolumeViz\elements\PickProfileElement.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\elements"
+!ENDIF
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\lib\VolumeViz\elements\StorageHintElement.cpp
 !IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
 # PROP Intermediate_Dir "Release\VolumeViz\elements"
@@ -368,6 +381,19 @@ SOURCE=..\..\lib\VolumeViz\elements\LightingElement.cpp
 # PROP Intermediate_Dir "StaticDebug\VolumeViz\elements"
 !ENDIF
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\lib\VolumeViz\elements\ROIElement.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\elements"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\elements"
+!ENDIF
+# End Source File
 # End Group
 # Begin Group "VolumeViz/nodes sources"
 # PROP Default_Filter "c;cpp;ic;icc;h"
@@ -464,6 +490,32 @@ SOURCE=..\..\lib\VolumeViz\nodes\OrthoSlice.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\lib\VolumeViz\nodes\MultiSlice.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\nodes"
+!ENDIF
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\lib\VolumeViz\nodes\ROI.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\nodes"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\nodes"
+!ENDIF
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\lib\VolumeViz\nodes\VolumeSkin.cpp
 !IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
 # PROP Intermediate_Dir "Release\VolumeViz\nodes"
@@ -649,6 +701,32 @@ SOURCE=..\..\lib\VolumeViz\misc\Util.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\lib\VolumeViz\misc\ObliqueSampler.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\misc"
+!ENDIF
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\lib\VolumeViz\misc\VoxelRay.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\VolumeViz\misc"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\VolumeViz\misc"
+!ENDIF
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\lib\VolumeViz\misc\ResourceManager.cpp
 !IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
 # PROP Intermediate_Dir "Release\VolumeViz\misc"
@@ -662,7 +740,7 @@ SOURCE=..\..\lib\VolumeViz\misc\ResourceManager.cpp
 # End Source File
 # Begin Source File
 
-SOURCE=..\..\lib\VolumeViz\misc\GlobalRenderLock.cpp
+SOURCE=..\..\lib\VolumeViz\misc\VolumeRenderLock.cpp
 !IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
 # PROP Intermediate_Dir "Release\VolumeViz\misc"
 !ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
@@ -945,6 +1023,19 @@ SOURCE=..\..\lib\VolumeViz\render\common\Cvr3DRGBATexture.cpp
 # PROP Intermediate_Dir "StaticDebug\render\common"
 !ENDIF
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\lib\VolumeViz\render\common\CvrImageCache.cpp
+!IF  "$(CFG)" == "simvoleon2 - Win32 DLL (Release)"
+# PROP Intermediate_Dir "Release\render\common"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 DLL (Debug)"
+# PROP Intermediate_Dir "Debug\render\common"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Release)"
+# PROP Intermediate_Dir "StaticRelease\render\common"
+!ELSEIF  "$(CFG)" == "simvoleon2 - Win32 LIB (Debug)"
+# PROP Intermediate_Dir "StaticDebug\render\common"
+!ENDIF
+# End Source File
 # End Group
 # Begin Group "render/Pointset sources"
 # PROP Default_Filter "c;cpp;ic;icc;h"
@@ -1036,6 +1127,14 @@ SOURCE=..\..\lib\VolumeViz\nodes\SoOrthoSlice.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\lib\VolumeViz\nodes\SoMultiSlice.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\lib\VolumeViz\nodes\SoROI.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\lib\VolumeViz\nodes\SoVolumeSkin.h
 # End Source File
 # Begin Source File
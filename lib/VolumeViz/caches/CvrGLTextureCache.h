@@ -33,6 +33,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
+#include <Inventor/SbVec3s.h>
 #include <Inventor/caches/SoCache.h>
 #include <Inventor/system/gl.h>
 
@@ -51,6 +52,9 @@ public:
   void setGLTextureId(const SoGLRenderAction * action, GLuint id);
   GLuint getGLTextureId(void) const;
 
+  void setRecyclable(const SbVec3s & dimensions,
+                     const GLenum internalformat, const GLenum format);
+
   SbBool isDead(void) const;
 
 private:
@@ -59,6 +63,11 @@ private:
   GLuint texid;
   SbBool dead;
   uint32_t glctxid;
+
+  SbBool recyclable;
+  SbVec3s dimensions;
+  GLenum internalformat;
+  GLenum format;
 };
 
 // *************************************************************************
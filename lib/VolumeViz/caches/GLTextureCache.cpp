@@ -44,13 +44,20 @@ CvrGLTextureCache::CvrGLTextureCache(SoState * state)
   this->texid = 0;
   this->glctxid = UINT_MAX;
   this->dead = FALSE;
+  this->recyclable = FALSE;
 }
 
 CvrGLTextureCache::~CvrGLTextureCache()
 {
   if (!this->isDead() && (this->texid != 0)) {
     CvrResourceManager * rm = CvrResourceManager::getInstance(this->glctxid);
-    rm->killTexture(this->texid);
+    if (this->recyclable) {
+      rm->recycleTexture(this->texid, this->dimensions,
+                         this->internalformat, this->format);
+    }
+    else {
+      rm->killTexture(this->texid);
+    }
     rm->remove(this);
   }
 }
@@ -77,7 +84,9 @@ CvrGLTextureCache::setGLTextureId(const SoGLRenderAction * action, GLuint id)
   assert(!this->dead);
 
   this->texid = id;
-  this->glctxid = action->getCacheContext();
+  // Use the share group id, as the resource manager and its texture
+  // will outlive the context if other contexts share its textures.
+  this->glctxid = CvrResourceManager::getShareGroup(action->getCacheContext());
 
   CvrResourceManager * rm = CvrResourceManager::getInstance(this->glctxid);
   rm->set(this, NULL, CvrGLTextureCache::texDestructionCB, this);
@@ -90,6 +99,19 @@ CvrGLTextureCache::getGLTextureId(void) const
   return this->texid;
 }
 
+// Let the GL texture be reused for another texture of the same
+// dimensions and format when this cache dies, instead of deleting
+// it. See CvrResourceManager::recycleTexture().
+void
+CvrGLTextureCache::setRecyclable(const SbVec3s & dimensions,
+                                 const GLenum internalformat, const GLenum format)
+{
+  this->recyclable = TRUE;
+  this->dimensions = dimensions;
+  this->internalformat = internalformat;
+  this->format = format;
+}
+
 // *************************************************************************
 
 /*! Returns \c TRUE if the texture has been deallocated.
@@ -63,6 +63,7 @@ private:
 
   // FIXME: should rather use a setDetails() function. 20041008 mortene.
   friend class SoObliqueSlice;
+  friend class SoMultiSlice;
 };
 
 #endif // !COIN_SOOBLIQUESLICEDETAIL_H
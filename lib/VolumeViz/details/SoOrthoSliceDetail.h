@@ -63,6 +63,7 @@ private:
 
   // FIXME: should rather use a setDetails() function. 20041008 mortene.
   friend class SoOrthoSlice;
+  friend class SoMultiSlice;
 };
 
 #endif // !COIN_SOORTHOSLICEDETAIL_H
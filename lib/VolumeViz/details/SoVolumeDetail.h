@@ -64,6 +64,9 @@ public:
                                      SbVec3s * pos = 0, SbVec3f * objpos = 0,
                                      SbBool flag = FALSE) const;
 
+  static void setRecordProfile(SoState * state, const SbBool on);
+  static SbBool getRecordProfile(SoState * state);
+
 
   // NOTE: The TGS VolumeViz signature of this function differs from
   // the following. We consider their solution to be unoptimal, and
@@ -49,13 +49,18 @@
 #include <Inventor/SoPickedPoint.h>
 #include <Inventor/actions/SoRayPickAction.h>
 #include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/threads/SbMutex.h>
+#include <Inventor/C/tidbits.h>
 
 #include <VolumeViz/details/SoVolumeDetail.h>
 #include <VolumeViz/misc/CvrUtil.h>
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
+#include <VolumeViz/misc/CvrVoxelRay.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
+#include <VolumeViz/elements/CvrPickProfileElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
 #include <VolumeViz/nodes/SoVolumeData.h>
 
 // *************************************************************************
@@ -94,6 +99,12 @@ public:
   SbList<VoxelInfo> voxelinfolist;
   SoVolumeDetail * master;
 
+  // Brick value ranges of the last volume picked with first-hit-only
+  // picking.
+  static CvrBrickRanges * brickranges;
+  static SbMutex * brickmutex;
+  static void cleanup(void);
+
   // Note: if adding more members, remember to update the copy
   // operator above.
 };
@@ -102,6 +113,9 @@ public:
 #define PRIVATE(p) (p->pimpl)
 #define PUBLIC(p) (p->master)
 
+CvrBrickRanges * SoVolumeDetailP::brickranges = NULL;
+SbMutex * SoVolumeDetailP::brickmutex = NULL;
+
 // *************************************************************************
 
 SO_DETAIL_SOURCE(SoVolumeDetail);
@@ -127,6 +141,22 @@ void
 SoVolumeDetail::initClass(void)
 {
   SO_DETAIL_INIT_CLASS(SoVolumeDetail, SoDetail);
+
+  SoRayPickAction::enableElement(CvrPickProfileElement::getClassTypeId(),
+                                 CvrPickProfileElement::getClassStackIndex());
+
+  SoVolumeDetailP::brickmutex = new SbMutex;
+  SoVolumeDetailP::brickranges = new CvrBrickRanges;
+  coin_atexit((coin_atexit_f *)SoVolumeDetailP::cleanup, 0);
+}
+
+void
+SoVolumeDetailP::cleanup(void)
+{
+  delete SoVolumeDetailP::brickranges;
+  SoVolumeDetailP::brickranges = NULL;
+  delete SoVolumeDetailP::brickmutex;
+  SoVolumeDetailP::brickmutex = NULL;
 }
 
 
@@ -251,6 +281,50 @@ SoVolumeDetail::getFirstNonTransparentValue(unsigned int * value,
 }
 
 
+/*!
+  Controls whether or not ray picks on volumes with \a state, which
+  must be the state of an SoRayPickAction, should record the full
+  profile of voxels along the ray. This is on by default.
+
+  The setting is kept on the state like other traversal state, so it
+  only applies to the current action, and is undone when leaving the
+  SoSeparator it was set under. Call this e.g. from an SoCallback node
+  placed in front of the volume.
+
+  When off, the ray traversal stops at the first voxel which is not
+  completely transparent, and skips quickly through regions of the
+  volume which are fully transparent with the current transfer
+  function. This makes picking much faster for large volumes, but
+  the profile will only contain the first voxel along the ray, the
+  first non-transparent voxel and the last voxel along the ray.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeDetail::setRecordProfile(SoState * state, const SbBool on)
+{
+  CvrPickProfileElement::set(state, on);
+}
+
+/*!
+  Returns whether or not ray picks with \a state record the full
+  voxel profile.
+
+  \sa setRecordProfile()
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeDetail::getRecordProfile(SoState * state)
+{
+  // Only enabled for SoRayPickAction.
+  if (!state->isElementEnabled(CvrPickProfileElement::getClassStackIndex())) {
+    return TRUE;
+  }
+  return CvrPickProfileElement::get(state);
+}
+
+// *************************************************************************
+
 /*!
   \COININTERNAL
   
@@ -267,110 +341,123 @@ SoVolumeDetail::setDetails(const SbVec3f raystart, const SbVec3f rayend,
   const SoTransferFunctionElement * transferfunctionelement =
     SoTransferFunctionElement::getInstance(state);
 
-  // Find objectspace-dimensions of a voxel.
-  const SbBox3f & objbbox = vbelem->getUnitDimensionsBox();
-  const SbVec3s & voxcubedims = vbelem->getVoxelCubeDimensions();
+  // The ray is traversed exactly voxel by voxel.
+  CvrVoxelRay ray(vbelem->getVoxels(), vbelem->getBytesPrVoxel(),
+                  vbelem->getVoxelCubeDimensions(), vbelem->getUnitDimensionsBox());
+  if (!ray.start(raystart, rayend)) { return; }
 
-  SbVec3f mincorner, maxcorner;
-  objbbox.getBounds(mincorner, maxcorner);
+  // Only one CLUT lookup setup for the full ray.
+  CvrCLUT * clut = CvrVoxelChunk::getCLUT(transferfunctionelement, CvrCLUT::ALPHA_AS_IS);
 
-  const SbVec3f size = maxcorner - mincorner;
-  const SbVec3f voxelsize(size[0] / voxcubedims[0],
-                          size[1] / voxcubedims[1],
-                          size[2] / voxcubedims[2]);
+  const SbBool recordprofile = SoVolumeDetail::getRecordProfile(state);
 
-  // Calculate maximum number of voxels that could possibly be touched
-  // by the ray.
-  const SbVec3f rayvec = (rayend - raystart);
-  const float minvoxdim = SbMin(voxelsize[0], SbMin(voxelsize[1], voxelsize[2]));
-  const unsigned int maxvoxinray = (unsigned int)(rayvec.length() / minvoxdim + 1);  
-  const SbVec3f stepvec = (rayvec / (float)maxvoxinray) / 2.0f;
-  const SbBox3s voxelbounds(SbVec3s(0, 0, 0), voxcubedims - SbVec3s(1, 1, 1));
+  // With a region of interest, voxels outside the selected boxes are
+  // not rendered, so they can't be hit either.
+  SbList<SbBox3s> roiboxes;
+  const CvrROIElement * roielem = CvrROIElement::getInstance(state);
+  if (roielem->isEnabled()) {
+    roielem->getSelection(vbelem->getVoxelCubeDimensions(), roiboxes);
+    if (roiboxes.getLength() == 0) { clut->unref(); return; }
+  }
+
+  // Transparent bricks are skipped when only looking for the first
+  // hit. (Not while debugging, as that modifies the voxel values.)
+  const SbBool skipbricks = !recordprofile && !CvrUtil::debugRayPicks();
+  CvrBrickRanges * brickranges = SoVolumeDetailP::brickranges;
+  unsigned int opaquecount[257];
+  if (skipbricks) {
+    CvrBrickRanges::countOpaque(clut, opaquecount);
+    SoVolumeDetailP::brickmutex->lock();
+    brickranges->setVolume(vbelem->getVoxels(), vbelem->getBytesPrVoxel(),
+                           vbelem->getVoxelCubeDimensions(), vbelem->getNodeId());
+  }
 
-  SbVec3s ijk, lastijk(-1, -1, -1);
   SoPickedPoint * pickedpoint = NULL;
-  CvrCLUT * clut = NULL;
   SbBool opaquevoxelhit = FALSE;
+  SbBool first = TRUE;
+
+  SbBool more = TRUE;
+  while (more) {
+    // (The first voxel is always visited, to start the profile.)
+    if (skipbricks && !first &&
+        brickranges->isTransparent(ray.getVoxel(), opaquecount)) {
+      more = ray.skipBrick(CvrBrickRanges::BRICKSIZE);
+      continue;
+    }
 
-  for (SbVec3f objectcoord = raystart;
-       (objectcoord - raystart).length() < (rayend - raystart).length();
-       objectcoord += stepvec) {
-
-    // FIXME: we're not hitting the voxels in an exact manner with the
-    // intersection testing (it seems we're slightly off in the
-    // x-direction, at least), as can be seen from the
-    // SoGuiExamples/volumerendering/raypick example (either that or
-    // it could be the actual 2D texture-slice rendering that is
-    // wrong). 20030220 mortene.
-    //
-    // UPDATE: this might have been fixed now, at least I found and
-    // fixed an offset bug in the objectCoordsToIJK() method
-    // today. 20030320 mortene.
+    const SbVec3f objectcoord = ray.getPosition();
 
     // check if coords is not inside action's volume for picking
-    if (!action->isBetweenPlanes(objectcoord)) { continue; }
-
-    ijk = vbelem->objectCoordsToIJK(objectcoord);
+    if (action->isBetweenPlanes(objectcoord)) {
+      const SbVec3s & ijk = ray.getVoxel();
 
-    // voxel out of bounds?
-    if (!voxelbounds.intersect(ijk)) { continue; }
-    // ray already touched this voxel?
-    if (ijk == lastijk) { continue; }
+      if (CvrUtil::debugRayPicks()) {
+        SoDebugError::postInfo("SoVolumeDetail::setDetails",
+                               "ray touched new voxel ijk=<%d, %d, %d>",
+                               ijk[0], ijk[1], ijk[2]);
+      }
 
-    if (CvrUtil::debugRayPicks()) {
-      SoDebugError::postInfo("SoVolumeDetail::setDetails",
-                             "ray touched new voxel ijk=<%d, %d, %d>",
-                             ijk[0], ijk[1], ijk[2]);
-    }
+      const uint32_t voxelvalue = ray.getValue();
+      uint8_t rgba[4];
+      clut->lookupRGBA(voxelvalue, rgba);
 
-    clut = CvrVoxelChunk::getCLUT(transferfunctionelement, CvrCLUT::ALPHA_AS_IS);
-    clut->ref();
-    uint8_t rgba[4];
-
-    // FIXME: As SIMVoleon does not support 16bits voxels 100% yet,
-    // we'll have to scale down the value to 8bit if needed before
-    // passing on the data. (20100806 handegar)
-    const uint32_t voxelvalue = vbelem->getVoxelValue(ijk) >> 8*(vbelem->getBytesPrVoxel() - 1);
+      SbBool selected = (roiboxes.getLength() == 0);
+      for (int i = 0; !selected && (i < roiboxes.getLength()); i++) {
+        selected = roiboxes[i].intersect(ijk);
+      }
 
-    clut->lookupRGBA(voxelvalue, rgba);
-     
-    if (pickedpoint == NULL) {                
-      if (rgba[3] != 0) {
-        pickedpoint = action->addIntersection(objectcoord);        
+      SbBool hit = FALSE;
+      if ((pickedpoint == NULL) && (rgba[3] != 0) && selected) {
+        pickedpoint = action->addIntersection(objectcoord);
         opaquevoxelhit = TRUE;
+        hit = TRUE;
         // if NULL, something else is obstructing the view to the
         // volume, the app programmer only want the nearest, and we
         // don't need to continue our intersection tests
-        if (pickedpoint == NULL) return;
+        if (pickedpoint == NULL) { break; }
+        // FIXME: should fill in the normal vector of the pickedpoint:
+        //  ->setObjectNormal(<voxcube-side-normal>);
+        // 20030320 mortene.
       }
-      // FIXME: should fill in the normal vector of the pickedpoint:
-      //  ->setObjectNormal(<voxcube-side-normal>);
-      // 20030320 mortene.       
-    }
 
+      if (CvrUtil::debugRayPicks()) { // Draw a voxel-line through the volume
+        static uint8_t raypickdebugcounter = 0;
+        PRIVATE(this)->setVoxelValue(ijk, 255 - (raypickdebugcounter++ & 2), vbelem);
+        if (pickedpoint) {
+          SoPath * path = pickedpoint->getPath();
+          SoSearchAction sa;
+          sa.setType(SoVolumeData::getClassTypeId());
+          sa.setInterest(SoSearchAction::LAST);
+          sa.apply(path);
+          SoPath * result = sa.getPath();
+          assert(result && "Could not find a SoVolumeData node in path.");
+          SoVolumeData * vd = (SoVolumeData *) result->getTail();
+          vd->touch(); // Update volume data
+        }
+      }
 
-    if (CvrUtil::debugRayPicks()) { // Draw a voxel-line through the volume
-      static uint8_t raypickdebugcounter = 0;
-      PRIVATE(this)->setVoxelValue(ijk, 255 - (raypickdebugcounter++ & 2), vbelem);
-      if (pickedpoint) {
-        SoPath * path = pickedpoint->getPath();          
-        SoSearchAction sa;
-        sa.setType(SoVolumeData::getClassTypeId());
-        sa.setInterest(SoSearchAction::LAST);
-        sa.apply(path);          
-        SoPath * result = sa.getPath();
-        assert(result && "Could not find a SoVolumeData node in path.");
-        SoVolumeData * vd = (SoVolumeData *) result->getTail();
-        vd->touch(); // Update volume data
+      if (recordprofile || first || hit) {
+        PRIVATE(this)->addVoxelIntersection(objectcoord, ijk, voxelvalue, rgba);
+        first = FALSE;
+      }
+      if (hit && !recordprofile) {
+        // End the profile with the last voxel along the ray.
+        const SbVec3s lastijk = ray.getLastVoxel();
+        const uint32_t lastvalue = ray.getValue(lastijk);
+        uint8_t lastrgba[4];
+        clut->lookupRGBA(lastvalue, lastrgba);
+        PRIVATE(this)->addVoxelIntersection(ray.getEndPosition(), lastijk,
+                                            lastvalue, lastrgba);
+        break;
       }
     }
 
-    PRIVATE(this)->addVoxelIntersection(objectcoord, ijk, voxelvalue, rgba);
-    lastijk = ijk;      
+    more = ray.next();
   }
 
- 
-  if (clut) clut->unref();
+  if (skipbricks) { SoVolumeDetailP::brickmutex->unlock(); }
+
+  clut->unref();
   
   if (pickedpoint) {   
     if (opaquevoxelhit) { 
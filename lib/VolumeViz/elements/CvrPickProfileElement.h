@@ -1,3 +1,6 @@
+#ifndef SIMVOLEON_CVRPICKPROFILEELEMENT_H
+#define SIMVOLEON_CVRPICKPROFILEELEMENT_H
+
 /**************************************************************************\
  * Copyright (c) Kongsberg Oil & Gas Technologies AS
  * All rights reserved.
@@ -30,21 +33,23 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-#include <assert.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <Inventor/elements/SoInt32Element.h>
+
 
-// *************************************************************************
+class CvrPickProfileElement : public SoInt32Element {
+  typedef SoInt32Element inherited;
+  SO_ELEMENT_HEADER(CvrPickProfileElement);
 
-SbMutex * CvrGlobalRenderLock::mutex = NULL;
+public:
+  static void initClass(void);
+  virtual void init(SoState * state);
+  static const CvrPickProfileElement * getInstance(SoState * const state);
 
-// *************************************************************************
+  static void set(SoState * state, SbBool val);
+  static SbBool get(SoState * state);
 
-void
-CvrGlobalRenderLock::init(void)
-{
-  assert(CvrGlobalRenderLock::mutex == NULL);
-  CvrGlobalRenderLock::mutex = new SbMutex;
-  // FIXME: one-off leak, should clean up the mutex at exit. 20041112 mortene.
-}
+protected:
+  virtual ~CvrPickProfileElement();
+};
 
-// *************************************************************************
+#endif // !SIMVOLEON_CVRPICKPROFILEELEMENT_H
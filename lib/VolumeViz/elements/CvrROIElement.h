@@ -0,0 +1,74 @@
+#ifndef SIMVOLEON_CVRROIELEMENT_H
+#define SIMVOLEON_CVRROIELEMENT_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <Inventor/SbBox3s.h>
+#include <Inventor/elements/SoSubElement.h>
+#include <Inventor/lists/SbList.h>
+
+// *************************************************************************
+
+class CvrROIElement : public SoElement {
+  typedef SoElement inherited;
+
+  SO_ELEMENT_HEADER(CvrROIElement);
+
+public:
+  static void initClass(void);
+  virtual void init(SoState * state);
+  static const CvrROIElement * getInstance(SoState * const state);
+
+  virtual SbBool matches(const SoElement * element) const;
+  virtual SoElement * copyMatchInfo(void) const;
+
+  static void set(SoState * state, const SbBox3s & box, const int flags,
+                  const SbBox3s & subvolume, const SbBool relative);
+
+  SbBool isEnabled(void) const;
+  void getSelection(const SbVec3s & dimensions, SbList<SbBox3s> & boxes) const;
+
+protected:
+  virtual ~CvrROIElement();
+
+private:
+  SbBool enabled;
+  SbBox3s box;
+  int flags;
+  SbBox3s subvolume;
+  SbBool relative;
+};
+
+// *************************************************************************
+
+#endif // !SIMVOLEON_CVRROIELEMENT_H
@@ -0,0 +1,258 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <VolumeViz/elements/CvrROIElement.h>
+
+#include <assert.h>
+
+#include <VolumeViz/nodes/SoROI.h>
+
+// *************************************************************************
+
+SO_ELEMENT_SOURCE(CvrROIElement);
+
+// *************************************************************************
+
+void
+CvrROIElement::initClass(void)
+{
+  SO_ELEMENT_INIT_CLASS(CvrROIElement, inherited);
+}
+
+
+CvrROIElement::~CvrROIElement(void)
+{
+}
+
+void
+CvrROIElement::init(SoState * state)
+{
+  inherited::init(state);
+  this->enabled = FALSE;
+  this->box.setBounds(0, 0, 0, 0, 0, 0);
+  this->flags = SoROI::SUB_VOLUME;
+  this->subvolume.setBounds(0, 0, 0, 0, 0, 0);
+  this->relative = FALSE;
+}
+
+const CvrROIElement *
+CvrROIElement::getInstance(SoState * const state)
+{
+  return (const CvrROIElement *)
+    CvrROIElement::getConstElement(state, CvrROIElement::classStackIndex);
+}
+
+// *************************************************************************
+
+SbBool
+CvrROIElement::matches(const SoElement * element) const
+{
+  const CvrROIElement * elem = (const CvrROIElement *)element;
+  return
+    (elem->enabled == this->enabled) &&
+    (elem->box == this->box) &&
+    (elem->flags == this->flags) &&
+    (elem->subvolume == this->subvolume) &&
+    (elem->relative == this->relative);
+}
+
+SoElement *
+CvrROIElement::copyMatchInfo(void) const
+{
+  assert(this->getTypeId().canCreateInstance());
+
+  CvrROIElement * element = (CvrROIElement *)
+    this->getTypeId().createInstance();
+
+  element->enabled = this->enabled;
+  element->box = this->box;
+  element->flags = this->flags;
+  element->subvolume = this->subvolume;
+  element->relative = this->relative;
+
+  return element;
+}
+
+void
+CvrROIElement::set(SoState * state, const SbBox3s & box, const int flags,
+                   const SbBox3s & subvolume, const SbBool relative)
+{
+  CvrROIElement * element = (CvrROIElement *)
+    CvrROIElement::getElement(state, CvrROIElement::classStackIndex);
+  element->enabled = TRUE;
+  element->box = box;
+  element->flags = flags;
+  element->subvolume = subvolume;
+  element->relative = relative;
+}
+
+// *************************************************************************
+
+SbBool
+CvrROIElement::isEnabled(void) const
+{
+  return this->enabled;
+}
+
+// Two boxes can be merged if they span the same range along two
+// axes, and are adjacent along the third.
+static SbBool
+cvr_roi_merge(const SbBox3s & a, const SbBox3s & b, SbBox3s & result)
+{
+  const SbVec3s & amin = a.getMin();
+  const SbVec3s & amax = a.getMax();
+  const SbVec3s & bmin = b.getMin();
+  const SbVec3s & bmax = b.getMax();
+
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    const unsigned int o1 = (axis + 1) % 3;
+    const unsigned int o2 = (axis + 2) % 3;
+    if ((amin[o1] != bmin[o1]) || (amax[o1] != bmax[o1]) ||
+        (amin[o2] != bmin[o2]) || (amax[o2] != bmax[o2])) { continue; }
+
+    if ((amax[axis] + 1 == bmin[axis]) || (bmax[axis] + 1 == amin[axis])) {
+      result = a;
+      result.extendBy(b);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Returns the set of disjoint boxes, in voxel coordinates (inclusive),
+// which makes up the region selected by the ROI within a volume of
+// the given dimensions.
+//
+// The ROI box splits each axis of the volume into three ranges
+// (before, within and after the box), and so the volume into 27
+// cells. Every cell is either completely inside or outside the
+// selection, so the selection is found by testing each cell against
+// the three component boxes of the flags, and then merging
+// neighboring cells.
+void
+CvrROIElement::getSelection(const SbVec3s & dimensions, SbList<SbBox3s> & boxes) const
+{
+  boxes.truncate(0);
+
+  // An all-zero sub-volume means the full volume.
+  SbVec3s smin, smax;
+  this->subvolume.getBounds(smin, smax);
+  const SbBool usesubvolume =
+    (smin != SbVec3s(0, 0, 0)) || (smax != SbVec3s(0, 0, 0));
+
+  int lo[3], hi[3];
+  for (unsigned int a = 0; a < 3; a++) {
+    lo[a] = 0;
+    hi[a] = dimensions[a] - 1;
+    if (usesubvolume) {
+      lo[a] = SbMax(lo[a], (int)smin[a]);
+      hi[a] = SbMin(hi[a], (int)smax[a]);
+    }
+    if (lo[a] > hi[a]) { return; }
+  }
+
+  SbVec3s bmin, bmax;
+  this->box.getBounds(bmin, bmax);
+  if (this->relative && usesubvolume) {
+    bmin += smin;
+    bmax += smin;
+  }
+
+  // The three ranges along each axis, where index 1 is within the
+  // box.
+  int range[3][3][2];
+  for (unsigned int a = 0; a < 3; a++) {
+    range[a][0][0] = lo[a];
+    range[a][0][1] = SbMin((int)bmin[a] - 1, hi[a]);
+    range[a][1][0] = SbMax((int)bmin[a], lo[a]);
+    range[a][1][1] = SbMin((int)bmax[a], hi[a]);
+    range[a][2][0] = SbMax((int)bmax[a] + 1, lo[a]);
+    range[a][2][1] = hi[a];
+  }
+
+  const SbBool orselect = (this->flags & SoROI::OR_SELECT) != 0;
+
+  for (unsigned int i = 0; i < 3; i++) {
+    for (unsigned int j = 0; j < 3; j++) {
+      for (unsigned int k = 0; k < 3; k++) {
+        const unsigned int idx[3] = { i, j, k };
+
+        SbBool empty = FALSE;
+        for (unsigned int a = 0; a < 3; a++) {
+          if (range[a][idx[a]][0] > range[a][idx[a]][1]) { empty = TRUE; }
+        }
+        if (empty) { continue; }
+
+        SbBool selected = orselect ? FALSE : TRUE;
+        SbBool anycomponent = FALSE;
+        for (unsigned int c = 0; c < 3; c++) {
+          const int axes = (this->flags >> (c * 4)) & 0x7;
+          if (axes == 0) { continue; }
+          anycomponent = TRUE;
+
+          SbBool inside = TRUE;
+          for (unsigned int a = 0; a < 3; a++) {
+            if ((axes & (1 << a)) && (idx[a] != 1)) { inside = FALSE; }
+          }
+          if (this->flags & (SoROI::INVERT_0 << (c * 4))) { inside = !inside; }
+
+          selected = orselect ? (selected || inside) : (selected && inside);
+        }
+        if (!anycomponent) { selected = TRUE; }
+        if (this->flags & SoROI::INVERT_OUTPUT) { selected = !selected; }
+
+        if (selected) {
+          boxes.append(SbBox3s(range[0][i][0], range[1][j][0], range[2][k][0],
+                               range[0][i][1], range[1][j][1], range[2][k][1]));
+        }
+      }
+    }
+  }
+
+  // Merge neighbors, to keep down the number of rendering passes.
+  SbBool merged = TRUE;
+  while (merged) {
+    merged = FALSE;
+    for (int i = 0; !merged && (i < boxes.getLength()); i++) {
+      for (int j = i + 1; !merged && (j < boxes.getLength()); j++) {
+        SbBox3s result;
+        if (cvr_roi_merge(boxes[i], boxes[j], result)) {
+          boxes[i] = result;
+          boxes.remove(j);
+          merged = TRUE;
+        }
+      }
+    }
+  }
+}
+
+// *************************************************************************
@@ -48,6 +48,7 @@
 #include <Inventor/SbBasic.h>
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/threads/SbMutex.h>
 
 #include <VolumeViz/elements/CvrPalettedTexturesElement.h>
 #include <VolumeViz/misc/CvrUtil.h>
@@ -161,6 +162,17 @@ static const char * palettelookupprogram_replace =
 // CvrCLUT instances (over one GL context).
 static const char * CVRCLUT_STATIC_KEYID = "foobar";
 
+SbMutex * CvrCLUT::mutex = NULL;
+
+// *************************************************************************
+
+void
+CvrCLUT::initClass(void)
+{
+  assert(CvrCLUT::mutex == NULL);
+  CvrCLUT::mutex = new SbMutex;
+}
+
 // *************************************************************************
 
 // colormap values are between 0 and 255
@@ -272,14 +284,15 @@ CvrCLUT::killAllGLContextData(void)
 {
   this->killAll1DTextures();
 
+  CvrCLUT::mutex->lock();
   const unsigned int len = (unsigned int)this->contextlist.getLength();
   for (unsigned int i = 0; i < len; i++) {
     struct GLContextStorage * c = this->contextlist[i];
-    CvrResourceManager * rm = CvrResourceManager::getInstance(c->ctxid);
-    rm->remove(this);
+    c->resourcemanager->remove(this);
     delete c;
   }
   this->contextlist.truncate(0);
+  CvrCLUT::mutex->unlock();
 }
 
 
@@ -290,7 +303,9 @@ void
 CvrCLUT::ref(void) const
 {
   CvrCLUT * that = (CvrCLUT *)this; // cast away constness
+  CvrCLUT::mutex->lock();
   that->refcount++;
+  CvrCLUT::mutex->unlock();
 }
 
 
@@ -298,9 +313,12 @@ void
 CvrCLUT::unref(void) const
 {
   CvrCLUT * that = (CvrCLUT *)this; // cast away constness
+  CvrCLUT::mutex->lock();
   that->refcount--;
   assert(this->refcount >= 0);
-  if (this->refcount == 0) delete this;
+  const SbBool dead = (this->refcount == 0);
+  CvrCLUT::mutex->unlock();
+  if (dead) delete this;
 }
 
 
@@ -310,12 +328,21 @@ CvrCLUT::getRefCount(void) const
   return this->refcount;
 }
 
+// Returns a checksum of the color map. CLUTs with different checksums
+// are never equal, so this is suitable as a hash key.
+uint32_t
+CvrCLUT::getChecksum(void) const
+{
+  return this->crc32cmap;
+}
+
 
 // *************************************************************************
 
 // Equality comparison between the color lookup tables. The comparison
-// will be quick, as it's based on having a checksum for the color
-// table.
+// will usually be quick, as CLUTs with different checksums are never
+// equal. As CLUTs are shared between nodes by content, the color
+// tables are compared in full when the checksums match.
 int
 operator==(const CvrCLUT & c1, const CvrCLUT & c2)
 {
@@ -323,17 +350,16 @@ operator==(const CvrCLUT & c1, const CvrCLUT & c2)
 
   if (c1.crc32cmap != c2.crc32cmap) { return FALSE; }
 
-  assert(c1.nrentries == c2.nrentries);
-  assert(c1.nrcomponents == c2.nrcomponents);
-  assert(c1.datatype == c2.datatype);
+  // Different tables can have the same bytes, e.g. when zero-filled.
+  if ((c1.nrentries != c2.nrentries) ||
+      (c1.nrcomponents != c2.nrcomponents) ||
+      (c1.datatype != c2.datatype)) {
+    return FALSE;
+  }
 
-#if CVR_DEBUG
-  // Checking that CRC32 checksums don't give false positives.  This
-  // has implications for performance, so get rid of it after a while.
   const int blocksize = c1.nrentries * c1.nrcomponents;
   const int blksize = blocksize * (c1.datatype == CvrCLUT::INTS ? 1 : sizeof(float));
-  assert(memcmp(c1.int_entries, c2.int_entries, blksize) == 0);
-#endif // CVR_DEBUG
+  if (memcmp(c1.int_entries, c2.int_entries, blksize) != 0) { return FALSE; }
 
   if (c1.transparencythresholds[0] != c2.transparencythresholds[0]) { return FALSE; }
   if (c1.transparencythresholds[1] != c2.transparencythresholds[1]) { return FALSE; }
@@ -464,6 +490,7 @@ CvrCLUT::contextDeletedCB(void * closure, uint32_t ctxid)
   CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
 
   if (closure) { // dynamic (per-CvrCLUT) data
+    CvrCLUT::mutex->lock();
     void * ptr;
     const SbBool ok = rm->get(closure, ptr);
     assert(ok);
@@ -484,8 +511,10 @@ CvrCLUT::contextDeletedCB(void * closure, uint32_t ctxid)
     rm->remove(closure);
     ((CvrCLUT *)closure)->contextlist.removeItem(ctxstorage);
     delete ctxstorage;
+    CvrCLUT::mutex->unlock();
   }
   else { // static/global data for all CvrCLUT instances
+    CvrCLUT::mutex->lock();
     void * ptr;
     const SbBool ok = rm->get(CVRCLUT_STATIC_KEYID, ptr);
     assert(ok);
@@ -511,6 +540,7 @@ CvrCLUT::contextDeletedCB(void * closure, uint32_t ctxid)
 
     rm->remove(CVRCLUT_STATIC_KEYID);
     delete ctxstorage;
+    CvrCLUT::mutex->unlock();
   }
 }
 
@@ -518,15 +548,25 @@ CvrCLUT::contextDeletedCB(void * closure, uint32_t ctxid)
 CvrCLUT::GLContextStorage *
 CvrCLUT::getGLContextStorage(uint32_t ctxid)
 {
+  // Look these up before locking, as context destruction calls
+  // contextDeletedCB() with the resource managers' lock held.
   CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
+  // Store the share group id, as the context itself may be
+  // destructed before the other contexts in the group.
+  const uint32_t sharegroup = CvrResourceManager::getShareGroup(ctxid);
+
+  // Render threads sharing this CLUT must not both make storage for
+  // the same context.
+  CvrCLUT::mutex->lock();
   void * ptr;
   const SbBool ok = rm->get(this, ptr);
   if (!ok) {
-    ptr = new CvrCLUT::GLContextStorage(ctxid);
+    ptr = new CvrCLUT::GLContextStorage(sharegroup, rm);
     rm->set(this, ptr, CvrCLUT::contextDeletedCB, this);
     CvrCLUT::GLContextStorage * ctxstruct = (CvrCLUT::GLContextStorage *)ptr;
     this->contextlist.append(ctxstruct);
   }
+  CvrCLUT::mutex->unlock();
 
   return (CvrCLUT::GLContextStorage *)ptr;
 }
@@ -536,12 +576,14 @@ CvrCLUT::GlobalGLContextStorage *
 CvrCLUT::getGlobalGLContextStorage(uint32_t ctxid)
 {
   CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
+  CvrCLUT::mutex->lock();
   void * ptr;
   const SbBool ok = rm->get(CVRCLUT_STATIC_KEYID, ptr);
   if (!ok) {
     ptr = new CvrCLUT::GlobalGLContextStorage;
     rm->set(CVRCLUT_STATIC_KEYID, ptr, CvrCLUT::contextDeletedCB, NULL);
   }
+  CvrCLUT::mutex->unlock();
 
   return (CvrCLUT::GlobalGLContextStorage *)ptr;
 }
@@ -692,6 +734,13 @@ CvrCLUT::deactivate(const cc_glglue * glw) const
 // *************************************************************************
 
 
+// Number of colors in the table.
+unsigned int
+CvrCLUT::getNumEntries(void) const
+{
+  return this->nrentries;
+}
+
 // Find RGBA color at the given idx.
 void
 CvrCLUT::lookupRGBA(const unsigned int idx, uint8_t rgba[4]) const
@@ -703,6 +752,29 @@ CvrCLUT::lookupRGBA(const unsigned int idx, uint8_t rgba[4]) const
 }
 
 
+// Returns TRUE if all the 8-bit color indices flagged in the
+// \a usedindices bitmask map to fully opaque colors.
+SbBool
+CvrCLUT::isOpaque(const uint32_t usedindices[8]) const
+{
+  for (unsigned int idx = 0; idx < 256; idx++) {
+    if ((usedindices[idx >> 5] & (1u << (idx & 0x1f))) == 0) { continue; }
+    if (idx >= this->nrentries) { return FALSE; }
+    if (this->glcolors[idx * 4 + 3] != 0xff) { return FALSE; }
+  }
+  return TRUE;
+}
+
+
+// Returns TRUE if the color at \a idx is fully transparent.
+SbBool
+CvrCLUT::isTransparent(const unsigned int idx) const
+{
+  if (idx >= this->nrentries) { return FALSE; }
+  return (this->glcolors[idx * 4 + 3] == 0x00) ? TRUE : FALSE;
+}
+
+
 // FIXME: this doesn't seem compatible with the fact that
 // CvrCLUT-instances should be possible to share between any number of
 // textured elements. Must be fixed, or strange errors may
@@ -779,13 +851,14 @@ CvrCLUT::regenerateGLColorData(void)
 void
 CvrCLUT::killAll1DTextures(void)
 {
+  CvrCLUT::mutex->lock();
   const unsigned int len = (unsigned int)this->contextlist.getLength();
   for (unsigned int i = 0; i < len; i++) {
     struct GLContextStorage * c = this->contextlist[i];
-    CvrResourceManager * rm = CvrResourceManager::getInstance(c->ctxid);
-    rm->killTexture(c->texture1Dclut);
+    c->resourcemanager->killTexture(c->texture1Dclut);
     c->texture1Dclut = 0;
   }
+  CvrCLUT::mutex->unlock();
 }
 
 
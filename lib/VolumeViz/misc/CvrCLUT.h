@@ -38,6 +38,8 @@
 #include <Inventor/lists/SbList.h>
 
 struct cc_glglue;
+class CvrResourceManager;
+class SbMutex;
 class SoGLRenderAction;
 
 // *************************************************************************
@@ -52,6 +54,8 @@ public:
           const float * colormap, AlphaUse policy);
   CvrCLUT(const CvrCLUT & clut);
 
+  static void initClass(void);
+
   friend int operator==(const CvrCLUT & c1, const CvrCLUT & c2);
   friend int operator!=(const CvrCLUT & c1, const CvrCLUT & c2);
 
@@ -59,6 +63,8 @@ public:
   void unref(void) const;
   int32_t getRefCount(void) const;
 
+  uint32_t getChecksum(void) const;
+
   void setTransparencyThresholds(uint32_t low, uint32_t high);
 
   enum TextureType { TEXTURE2D = 0, TEXTURE3D = 1, TEXTURE3D_GRADIENT = 2 };
@@ -66,7 +72,10 @@ public:
   void activate(uint32_t ctxid, TextureType t) const;
   void deactivate(const cc_glglue * glw) const;
 
+  unsigned int getNumEntries(void) const;
   void lookupRGBA(const unsigned int idx, uint8_t rgba[4]) const;
+  SbBool isOpaque(const uint32_t usedindices[8]) const;
+  SbBool isTransparent(const unsigned int idx) const;
 
   static SbBool usePaletteTextures(const SoGLRenderAction * action);
 
@@ -81,14 +90,16 @@ private:
   void setAlphaUse(AlphaUse policy);
 
   struct GLContextStorage {
-    GLContextStorage(uint32_t id)
+    GLContextStorage(uint32_t id, CvrResourceManager * rm)
     {
       this->texture1Dclut = 0;
       this->ctxid = id;
+      this->resourcemanager = rm;
     }
     
     GLuint texture1Dclut;
     uint32_t ctxid;
+    CvrResourceManager * resourcemanager;
   };
   SbList<struct GLContextStorage *> contextlist;
   struct GlobalGLContextStorage {
@@ -129,6 +140,10 @@ private:
   uint8_t * glcolors;
 
   int refcount;
+  // CLUTs are shared between volumes, which may be rendered from
+  // different threads, so the reference counting and the per-context
+  // storage are guarded.
+  static SbMutex * mutex;
 
   friend class nop; // to avoid g++ compiler warning on the private constructor
 };
@@ -0,0 +1,99 @@
+#ifndef SIMVOLEON_CVROBLIQUESAMPLER_H
+#define SIMVOLEON_CVROBLIQUESAMPLER_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+// Resamples an arbitrarily oriented plane through the volume to a 2D
+// image on the CPU, for export and for rendering SoObliqueSlice
+// without 3D textures. Also samples the volume at arbitrary points,
+// for probing. All positions are given in the object space
+// of the volume, i.e. within the box set with
+// SoVolumeData::setVolumeSize().
+
+#include <Inventor/SbBasic.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbVec2s.h>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/SbVec3s.h>
+
+class CvrCLUT;
+class SbPlane;
+struct cvr_resample_job;
+struct cvr_probe_job;
+
+// *************************************************************************
+
+class CvrObliqueSampler {
+public:
+  CvrObliqueSampler(const uint8_t * voxels, const unsigned int bytesprvoxel,
+                    const SbVec3s & dimensions, const SbBox3f & volumebox);
+
+  SbBool getSliceRectangle(const SbPlane & plane, SbVec3f & origo,
+                           SbVec3f & horizspan, SbVec3f & verticalspan) const;
+  SbVec2s getNativeResolution(const SbVec3f & horizspan,
+                              const SbVec3f & verticalspan) const;
+
+  void resample(const SbVec3f & origo, const SbVec3f & horizspan,
+                const SbVec3f & verticalspan, const SbVec2s & size,
+                const SbBool linear, const float outsidevalue,
+                float * buffer) const;
+
+  void probe(const SbVec3f * points, const int numpoints,
+             const SbBool linear, const float outsidevalue,
+             float * buffer) const;
+
+  void resampleRGBA(const SbVec3f & origo, const SbVec3f & horizspan,
+                    const SbVec3f & verticalspan, const SbVec2s & size,
+                    const SbBool linear, const CvrCLUT * clut,
+                    uint8_t * rgba) const;
+  static void renderRGBA(const SbVec3f & origo, const SbVec3f & horizspan,
+                         const SbVec3f & verticalspan, const SbVec2s & size,
+                         const uint8_t * rgba);
+
+private:
+  SbVec3f toVoxelSpace(const SbVec3f & objectpos) const;
+  void resampleRows(const cvr_resample_job * job) const;
+  static void * resampleThread(void * closure);
+  void probePoints(const cvr_probe_job * job) const;
+  static void * probeThread(void * closure);
+
+  const uint8_t * voxels;
+  unsigned int bytesprvoxel;
+  SbVec3s dimensions;
+  SbBox3f volumebox;
+  SbVec3f scale;
+};
+
+// *************************************************************************
+
+#endif // !SIMVOLEON_CVROBLIQUESAMPLER_H
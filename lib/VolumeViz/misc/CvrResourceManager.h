@@ -34,14 +34,23 @@
 \**************************************************************************/
 
 #include <Inventor/SbDict.h>
+#include <Inventor/SbVec3s.h>
 #include <Inventor/lists/SbList.h>
 #include <Inventor/system/gl.h>
 
+class SbMutex;
+class SbThreadMutex;
+
 // *************************************************************************
 
 class CvrResourceManager {
 public:
+  static void initClass(void);
   static CvrResourceManager * getInstance(uint32_t ctxid);
+  static CvrResourceManager * findInstance(uint32_t ctxid);
+
+  static void setShareGroup(uint32_t ctxid, uint32_t sharectxid);
+  static uint32_t getShareGroup(uint32_t ctxid);
 
   typedef void ToBeDeletedCB(void * closure, uint32_t contextid);
 
@@ -51,12 +60,23 @@ public:
 
   void killTexture(const GLuint id);
 
+  void recycleTexture(const GLuint id, const SbVec3s & dimensions,
+                      const GLenum internalformat, const GLenum format);
+  SbBool reuseTexture(const SbVec3s & dimensions,
+                      const GLenum internalformat, const GLenum format,
+                      GLuint & id);
+
 private:
   CvrResourceManager(uint32_t ctxid);
   ~CvrResourceManager();
 
   uint32_t ctxid;
   static SbDict * managers;
+  static SbDict * sharegroups;
+  // Guards the static dictionaries.
+  static SbThreadMutex * managersmutex;
+  // Guards the instance's resource dictionary and lists.
+  SbMutex * mutex;
   SbDict resourceholders;
 
   struct cb {
@@ -67,9 +87,19 @@ private:
 
   SbList<struct cb> cblist;
   SbList<GLuint> dyingtextureids;
+
+  struct recycledtexture {
+    GLuint id;
+    SbVec3s dimensions;
+    GLenum internalformat;
+    GLenum format;
+  };
+  SbList<struct recycledtexture> recycledtextures;
+  void scheduleTextureDeletion(const GLuint id);
   void GLContextMadeCurrent(uint32_t contextid);
   static void GLContextMadeCurrentCB(void * closure, uint32_t contextid);
   static void GLContextDestructionCB(uint32_t ctxtid, void * userdata);
+  static SbBool leaveShareGroup(uint32_t contextid);
 };
 
 // *************************************************************************
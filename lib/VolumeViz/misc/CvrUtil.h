@@ -36,6 +36,8 @@
 #include <Inventor/SbBasic.h>
 
 class SbMatrix;
+class SbBox3f;
+class SoState;
 class CvrVoxelBlockElement;
 
 // *************************************************************************
@@ -55,6 +57,16 @@ public:
 
   static void getTransformFromVolumeBoxDimensions(const CvrVoxelBlockElement * vd,
                                                   SbMatrix & m);
+
+  static SbBool isInsideViewVolume(SoState * state, const SbBox3f & box);
+
+  static SbBool enableClipBox(SoState * state, const SbBox3f & box,
+                              const unsigned int axismask);
+  static void disableClipBox(SoState * state, const unsigned int axismask);
+
+  static int maxWorkerThreads(void);
+  static void runJobs(void * jobs, const int nrjobs, const unsigned int jobsize,
+                      void * (*func)(void *));
 };
 
 // *************************************************************************
@@ -1,5 +1,5 @@
-#ifndef SIMVOLEON_GLOBALRENDERLOCK_H
-#define SIMVOLEON_GLOBALRENDERLOCK_H
+#ifndef SIMVOLEON_VOLUMERENDERLOCK_H
+#define SIMVOLEON_VOLUMERENDERLOCK_H
 
 /**************************************************************************\
  * Copyright (c) Kongsberg Oil & Gas Technologies AS
@@ -33,24 +33,37 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-// This class is useful as a simple way to do a global render lock
-// until the SIM Voleon code is fully re-entrant.
+// Render lock for the SIM Voleon nodes. Rendering of the same volume
+// from several threads is serialized, while different volumes can
+// be rendered concurrently, e.g. from separate threads per view or GL
+// context.
+//
+// The lock is re-entrant, so it is safe for a node to take it while
+// another node has it for the same volume in the same thread.
 
 // *************************************************************************
 
-#include <Inventor/threads/SbMutex.h>
+#include <Inventor/threads/SbThreadMutex.h>
+
+class SoState;
 
 // *************************************************************************
 
-class CvrGlobalRenderLock {
+class CvrVolumeRenderLock {
 public:
   static void init(void);
 
-  CvrGlobalRenderLock(void) { CvrGlobalRenderLock::mutex->lock(); }
-  ~CvrGlobalRenderLock() { CvrGlobalRenderLock::mutex->unlock(); }
+  CvrVolumeRenderLock(SoState * state);
+  ~CvrVolumeRenderLock();
 
 private:
-  static SbMutex * mutex;
+  SbThreadMutex * mutex;
+
+  // The locks are shared by the volumes hashing to the same slot, so
+  // we don't need to keep track of volume node construction and
+  // destruction.
+  enum { NRMUTEXES = 16 };
+  static SbThreadMutex * mutexes[NRMUTEXES];
 };
 
-#endif // !SIMVOLEON_GLOBALRENDERLOCK_H
+#endif // !SIMVOLEON_VOLUMERENDERLOCK_H
@@ -39,6 +39,7 @@
 #include <VolumeViz/misc/CvrCLUT.h>
 
 class CvrTextureObject;
+class SbRWMutex;
 class SoGLRenderAction;
 class SoTransferFunctionElement;
 class SbBox2s;
@@ -51,6 +52,8 @@ public:
                 const void * buffer = NULL);
   ~CvrVoxelChunk();
 
+  static void initClass(void);
+
   void transfer(const SoGLRenderAction * action, const CvrCLUT * clut, CvrTextureObject * texobj, SbBool & invisible) const;
 
   const void * getBuffer(void) const;
@@ -65,13 +68,19 @@ public:
   void dumpToPPM(const char * filename) const;
 
   // FIXME: move to CvrCLUT?
+  // The returned CLUT has been ref()'ed for the caller, who must
+  // unref() it when done with it.
   static CvrCLUT * getCLUT(const SoTransferFunctionElement * e, CvrCLUT::AlphaUse alphause);
+  static CvrCLUT * getCLUT(const SoTransferFunction * node, CvrCLUT::AlphaUse alphause);
+  static void releaseCLUTs(const SoTransferFunction * node);
 
   CvrVoxelChunk * buildSubPage(const unsigned int axisidx, const int pageidx,
                                const SbBox2s & cutslice);
 
   CvrVoxelChunk * buildSubCube(const SbBox3s & cubecut);
 
+  SbBox3s getVisibleBox(const SoGLRenderAction * action, const CvrCLUT * clut) const;
+
 private:
   void transfer2D(const SoGLRenderAction * action, const CvrCLUT * clut, CvrTextureObject * texobj, SbBool & invisible) const;
   void transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut, CvrTextureObject * texobj, SbBool & invisible) const;
@@ -80,8 +89,28 @@ private:
   CvrVoxelChunk * buildSubPageY(const int pageidx, const SbBox2s & cutslice);
   CvrVoxelChunk * buildSubPageZ(const int pageidx, const SbBox2s & cutslice);
 
-  static CvrCLUT * makeCLUT(const SoTransferFunctionElement * e, CvrCLUT::AlphaUse alphause);
+  static CvrCLUT * getCLUT(const SoTransferFunction * node,
+                           const uint32_t transparencythresholds[2],
+                           CvrCLUT::AlphaUse alphause);
+  static CvrCLUT * makeCLUT(const SoTransferFunction * node,
+                            const uint32_t transparencythresholds[2],
+                            CvrCLUT::AlphaUse alphause);
+  static CvrCLUT * findSharedCLUT(CvrCLUT * clut);
+  static void releaseUnusedCLUTs(void);
+
+  // The CLUTs last made for each SoTransferFunction node, with the
+  // transparency thresholds they were made for.
+  struct CLUTNodeEntry {
+    uint32_t nodeid;
+    CvrCLUT * cluts[CvrCLUT::ALPHA_BINARY + 1];
+    uint32_t thresholds[CvrCLUT::ALPHA_BINARY + 1][2];
+  };
+  static void releaseCLUTNodeEntry(struct CLUTNodeEntry * entry);
   static SbDict * CLUTdict;
+  // All CLUTs in use, hashed on their checksum, for sharing CLUTs
+  // made from identical color maps.
+  static SbDict * CLUTcontentdict;
+  static SbRWMutex * CLUTdictmutex;
 
   static uint8_t PREDEFGRADIENTS[SoTransferFunction::SEISMIC + 1][256][4];
   static void initPredefGradients(void);
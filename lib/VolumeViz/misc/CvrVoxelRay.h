@@ -0,0 +1,119 @@
+#ifndef SIMVOLEON_CVRVOXELRAY_H
+#define SIMVOLEON_CVRVOXELRAY_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+// Walks a ray through the voxel block, visiting each voxel it passes
+// through exactly once, in order (a 3D-DDA, as described by Amanatides
+// & Woo). Used for picking. Positions are given in the object space
+// of the volume, i.e. within the box set with
+// SoVolumeData::setVolumeSize().
+
+#include <Inventor/SbBasic.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/SbVec3s.h>
+
+class CvrCLUT;
+
+// *************************************************************************
+
+class CvrVoxelRay {
+public:
+  CvrVoxelRay(const uint8_t * voxels, const unsigned int bytesprvoxel,
+              const SbVec3s & dimensions, const SbBox3f & volumebox);
+
+  SbBool start(const SbVec3f & from, const SbVec3f & to);
+  SbBool next(void);
+  SbBool skipBrick(const unsigned int bricksize);
+
+  const SbVec3s & getVoxel(void) const;
+  SbVec3f getPosition(void) const;
+  uint32_t getValue(void) const;
+
+  SbVec3s getLastVoxel(void) const;
+  SbVec3f getEndPosition(void) const;
+  uint32_t getValue(const SbVec3s & voxel) const;
+
+private:
+  void setupSteps(void);
+
+  const uint8_t * voxels;
+  unsigned int bytesprvoxel;
+  SbVec3s dimensions;
+  SbVec3f volumemin, voxelsize;
+
+  // The ray is p0 + t * d in voxel space, and from + t * rayvec in
+  // object space.
+  SbVec3f from, rayvec;
+  SbVec3f p0, d;
+  float t, tend;
+
+  SbVec3s voxel;
+  int step[3];
+  float tnext[3], tdelta[3];
+};
+
+// *************************************************************************
+
+// The range of voxel values within each brick of BRICKSIZE^3 voxels,
+// for skipping bricks which are fully transparent. The ranges are
+// found the first time a brick is asked for, and isTransparent() can
+// safely be called from several threads at once.
+
+class CvrBrickRanges {
+public:
+  enum { BRICKSIZE = 16 };
+
+  CvrBrickRanges(void);
+  ~CvrBrickRanges();
+
+  void setVolume(const uint8_t * voxels, const unsigned int bytesprvoxel,
+                 const SbVec3s & dimensions, const uint32_t volumeid);
+
+  static void countOpaque(const CvrCLUT * clut, unsigned int opaquecount[257]);
+  SbBool isTransparent(const SbVec3s & voxel, const unsigned int opaquecount[257]);
+
+private:
+  const uint8_t * voxels;
+  unsigned int bytesprvoxel;
+  SbVec3s dimensions;
+  uint32_t volumeid;
+  unsigned int nrbricks[3];
+  // Minimum value in the low byte, maximum in the high byte.
+  uint16_t * ranges;
+};
+
+// *************************************************************************
+
+#endif // !SIMVOLEON_CVRVOXELRAY_H
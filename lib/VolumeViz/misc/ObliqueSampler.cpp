@@ -0,0 +1,444 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <VolumeViz/misc/CvrObliqueSampler.h>
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <Inventor/SbLinear.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
+
+#include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrUtil.h>
+
+// *************************************************************************
+
+// One band of image rows, resampled by a single thread.
+struct cvr_resample_job {
+  const CvrObliqueSampler * sampler;
+  // Position of the center of the first pixel, and the steps to the
+  // next pixel along a row and to the next row, in voxel space.
+  SbVec3f start, colstep, rowstep;
+  SbVec2s size;
+  SbBool linear;
+  float outsidevalue;
+  float * buffer;
+  int firstrow, endrow;
+};
+
+// A share of the points for CvrObliqueSampler::probe().
+struct cvr_probe_job {
+  const CvrObliqueSampler * sampler;
+  const SbVec3f * points;
+  SbBool linear;
+  float outsidevalue;
+  float * buffer;
+  int firstpoint, endpoint;
+};
+
+// *************************************************************************
+
+CvrObliqueSampler::CvrObliqueSampler(const uint8_t * voxels,
+                                     const unsigned int bytesprvoxel,
+                                     const SbVec3s & dimensions,
+                                     const SbBox3f & volumebox)
+{
+  assert((bytesprvoxel == 1) || (bytesprvoxel == 2));
+
+  this->voxels = voxels;
+  this->bytesprvoxel = bytesprvoxel;
+  this->dimensions = dimensions;
+  this->volumebox = volumebox;
+
+  const SbVec3f size = volumebox.getMax() - volumebox.getMin();
+  for (int i = 0; i < 3; i++) {
+    this->scale[i] = (size[i] > 0.0f) ? (dimensions[i] / size[i]) : 0.0f;
+  }
+}
+
+// Maps a position in object space to voxel space, where voxel
+// <i, j, k> covers [i, i+1> x [j, j+1> x [k, k+1>. This matches
+// CvrVoxelBlockElement::objectCoordsToIJK().
+SbVec3f
+CvrObliqueSampler::toVoxelSpace(const SbVec3f & objectpos) const
+{
+  const SbVec3f d = objectpos - this->volumebox.getMin();
+  return SbVec3f(d[0] * this->scale[0], d[1] * this->scale[1], d[2] * this->scale[2]);
+}
+
+// Finds the smallest rectangle in the plane which covers the
+// intersection of the plane with the volume box. Returns FALSE if the
+// plane doesn't cut through the volume.
+//
+// "origo" is set to the upper left corner of the rectangle,
+// "horizspan" points rightwards and "verticalspan" downwards, like
+// for CvrVoxelBlockElement::getPageGeometry().
+SbBool
+CvrObliqueSampler::getSliceRectangle(const SbPlane & plane, SbVec3f & origo,
+                                     SbVec3f & horizspan,
+                                     SbVec3f & verticalspan) const
+{
+  const SbVec3f & n = plane.getNormal();
+  const float dist = plane.getDistanceFromOrigin();
+
+  // Orientation of the rectangle: Y is "up" unless the plane is close
+  // to perpendicular to it, then Z is used. For a plane normal to
+  // the Z axis, this gives the same orientation as an SoOrthoSlice.
+  const SbVec3f up = (fabs(n[1]) < 0.9f) ? SbVec3f(0, 1, 0) : SbVec3f(0, 0, 1);
+  SbVec3f u = up.cross(n);
+  u.normalize();
+  SbVec3f v = n.cross(u);
+  v.normalize();
+
+  SbVec3f bmin, bmax;
+  this->volumebox.getBounds(bmin, bmax);
+
+  SbVec3f corners[8];
+  for (int i = 0; i < 8; i++) {
+    corners[i] = SbVec3f((i & 1) ? bmax[0] : bmin[0],
+                         (i & 2) ? bmax[1] : bmin[1],
+                         (i & 4) ? bmax[2] : bmin[2]);
+  }
+
+  float umin = FLT_MAX, umax = -FLT_MAX, vmin = FLT_MAX, vmax = -FLT_MAX;
+  SbBool hit = FALSE;
+
+  // Intersect the plane with the 12 edges of the box, where an edge
+  // connects two corners differing in only one bit of their index.
+  for (int i = 0; i < 8; i++) {
+    for (int bit = 1; bit < 8; bit <<= 1) {
+      if (i & bit) { continue; }
+      const SbVec3f & p0 = corners[i];
+      const SbVec3f & p1 = corners[i | bit];
+      const float d0 = n.dot(p0) - dist;
+      const float d1 = n.dot(p1) - dist;
+      if ((d0 > 0.0f && d1 > 0.0f) || (d0 < 0.0f && d1 < 0.0f)) { continue; }
+
+      const float t = (d0 == d1) ? 0.0f : (d0 / (d0 - d1));
+      const SbVec3f p = p0 + (p1 - p0) * t;
+      const float pu = p.dot(u);
+      const float pv = p.dot(v);
+      umin = SbMin(umin, pu); umax = SbMax(umax, pu);
+      vmin = SbMin(vmin, pv); vmax = SbMax(vmax, pv);
+      hit = TRUE;
+    }
+  }
+
+  if (!hit || (umax <= umin) || (vmax <= vmin)) { return FALSE; }
+
+  origo = n * dist + u * umin + v * vmax;
+  horizspan = u * (umax - umin);
+  verticalspan = -v * (vmax - vmin);
+  return TRUE;
+}
+
+// Returns the image size which gives about one sample per voxel
+// along the sides of the given rectangle.
+SbVec2s
+CvrObliqueSampler::getNativeResolution(const SbVec3f & horizspan,
+                                       const SbVec3f & verticalspan) const
+{
+  const SbVec3f h(horizspan[0] * this->scale[0], horizspan[1] * this->scale[1],
+                  horizspan[2] * this->scale[2]);
+  const SbVec3f v(verticalspan[0] * this->scale[0], verticalspan[1] * this->scale[1],
+                  verticalspan[2] * this->scale[2]);
+
+  const float w = SbMin((float)ceil(h.length()), 4096.0f);
+  const float r = SbMin((float)ceil(v.length()), 4096.0f);
+  return SbVec2s((short)SbMax(w, 1.0f), (short)SbMax(r, 1.0f));
+}
+
+// *************************************************************************
+
+// Trilinear interpolation between the eight voxels around "p", or
+// the value of the voxel containing "p" if "linear" is FALSE.
+template <class Type>
+static inline float
+cvr_sample(const Type * voxels, const int dims[3], const SbVec3f & p,
+           const SbBool linear)
+{
+  const int rowlen = dims[0];
+  const int slicelen = dims[0] * dims[1];
+
+  if (!linear) {
+    const int x = SbMin((int)p[0], dims[0] - 1);
+    const int y = SbMin((int)p[1], dims[1] - 1);
+    const int z = SbMin((int)p[2], dims[2] - 1);
+    return (float)voxels[z * slicelen + y * rowlen + x];
+  }
+
+  // Voxel centers are at half-integer positions.
+  const float fx = p[0] - 0.5f, fy = p[1] - 0.5f, fz = p[2] - 0.5f;
+  const int x0 = (int)floor(fx), y0 = (int)floor(fy), z0 = (int)floor(fz);
+  const float tx = fx - x0, ty = fy - y0, tz = fz - z0;
+
+  const int xa = SbClamp(x0, 0, dims[0] - 1), xb = SbClamp(x0 + 1, 0, dims[0] - 1);
+  const int ya = SbClamp(y0, 0, dims[1] - 1) * rowlen, yb = SbClamp(y0 + 1, 0, dims[1] - 1) * rowlen;
+  const int za = SbClamp(z0, 0, dims[2] - 1) * slicelen, zb = SbClamp(z0 + 1, 0, dims[2] - 1) * slicelen;
+
+  const float c00 = voxels[za + ya + xa] + (voxels[za + ya + xb] - (float)voxels[za + ya + xa]) * tx;
+  const float c10 = voxels[za + yb + xa] + (voxels[za + yb + xb] - (float)voxels[za + yb + xa]) * tx;
+  const float c01 = voxels[zb + ya + xa] + (voxels[zb + ya + xb] - (float)voxels[zb + ya + xa]) * tx;
+  const float c11 = voxels[zb + yb + xa] + (voxels[zb + yb + xb] - (float)voxels[zb + yb + xa]) * tx;
+
+  const float c0 = c00 + (c10 - c00) * ty;
+  const float c1 = c01 + (c11 - c01) * ty;
+  return c0 + (c1 - c0) * tz;
+}
+
+template <class Type>
+static void
+cvr_resample_rows(const Type * voxels, const SbVec3s & dimensions,
+                  const struct cvr_resample_job * job)
+{
+  const int dims[3] = { dimensions[0], dimensions[1], dimensions[2] };
+  const float maxpos[3] = { (float)dims[0], (float)dims[1], (float)dims[2] };
+
+  for (int row = job->firstrow; row < job->endrow; row++) {
+    // Positions are stepped incrementally along the row, so there is
+    // no per-sample transformation.
+    SbVec3f p = job->start + job->rowstep * (float)row;
+    float * out = job->buffer + row * job->size[0];
+
+    for (int col = 0; col < job->size[0]; col++, p += job->colstep) {
+      if ((p[0] < 0.0f) || (p[0] > maxpos[0]) ||
+          (p[1] < 0.0f) || (p[1] > maxpos[1]) ||
+          (p[2] < 0.0f) || (p[2] > maxpos[2])) {
+        out[col] = job->outsidevalue;
+      }
+      else {
+        out[col] = cvr_sample(voxels, dims, p, job->linear);
+      }
+    }
+  }
+}
+
+void
+CvrObliqueSampler::resampleRows(const struct cvr_resample_job * job) const
+{
+  if (this->bytesprvoxel == 1) {
+    cvr_resample_rows(this->voxels, this->dimensions, job);
+  }
+  else {
+    cvr_resample_rows((const uint16_t *)this->voxels, this->dimensions, job);
+  }
+}
+
+void *
+CvrObliqueSampler::resampleThread(void * closure)
+{
+  const struct cvr_resample_job * job = (const struct cvr_resample_job *)closure;
+  job->sampler->resampleRows(job);
+  return NULL;
+}
+
+// Resamples the given rectangle into "buffer", which must have room
+// for size[0] * size[1] values. Rows are stored from the "origo"
+// edge and out along "verticalspan". Samples outside the volume are
+// set to "outsidevalue".
+//
+// The rows are split in bands over a number of threads, which can be
+// set with the CVR_RESAMPLE_THREADS environment variable (default 4).
+void
+CvrObliqueSampler::resample(const SbVec3f & origo, const SbVec3f & horizspan,
+                            const SbVec3f & verticalspan, const SbVec2s & size,
+                            const SbBool linear, const float outsidevalue,
+                            float * buffer) const
+{
+  if ((size[0] <= 0) || (size[1] <= 0)) { return; }
+
+  struct cvr_resample_job job;
+  job.sampler = this;
+  const SbVec3f o = this->toVoxelSpace(origo);
+  job.colstep = this->toVoxelSpace(origo + horizspan / (float)size[0]) - o;
+  job.rowstep = this->toVoxelSpace(origo + verticalspan / (float)size[1]) - o;
+  job.start = o + (job.colstep + job.rowstep) * 0.5f;
+  job.size = size;
+  job.linear = linear;
+  job.outsidevalue = outsidevalue;
+  job.buffer = buffer;
+
+  // Small images aren't worth the thread overhead.
+  const int nrbands =
+    SbMax(SbMin(CvrUtil::maxWorkerThreads(), ((int)size[0] * size[1]) / (64 * 64)), 1);
+
+  SbList<struct cvr_resample_job> jobs;
+  for (int i = 0; i < nrbands; i++) {
+    job.firstrow = (size[1] * i) / nrbands;
+    job.endrow = (size[1] * (i + 1)) / nrbands;
+    jobs.append(job);
+  }
+
+  CvrUtil::runJobs((void *)jobs.getArrayPtr(), jobs.getLength(),
+                   sizeof(struct cvr_resample_job), CvrObliqueSampler::resampleThread);
+}
+
+template <class Type>
+static void
+cvr_probe_points(const Type * voxels, const SbVec3s & dimensions,
+                 const SbVec3f & volumemin, const SbVec3f & scale,
+                 const struct cvr_probe_job * job)
+{
+  const int dims[3] = { dimensions[0], dimensions[1], dimensions[2] };
+  const float maxpos[3] = { (float)dims[0], (float)dims[1], (float)dims[2] };
+
+  for (int i = job->firstpoint; i < job->endpoint; i++) {
+    const SbVec3f & o = job->points[i];
+    const SbVec3f p((o[0] - volumemin[0]) * scale[0],
+                    (o[1] - volumemin[1]) * scale[1],
+                    (o[2] - volumemin[2]) * scale[2]);
+    if ((p[0] < 0.0f) || (p[0] > maxpos[0]) ||
+        (p[1] < 0.0f) || (p[1] > maxpos[1]) ||
+        (p[2] < 0.0f) || (p[2] > maxpos[2])) {
+      job->buffer[i] = job->outsidevalue;
+    }
+    else {
+      job->buffer[i] = cvr_sample(voxels, dims, p, job->linear);
+    }
+  }
+}
+
+void
+CvrObliqueSampler::probePoints(const struct cvr_probe_job * job) const
+{
+  if (this->bytesprvoxel == 1) {
+    cvr_probe_points(this->voxels, this->dimensions, this->volumebox.getMin(),
+                     this->scale, job);
+  }
+  else {
+    cvr_probe_points((const uint16_t *)this->voxels, this->dimensions,
+                     this->volumebox.getMin(), this->scale, job);
+  }
+}
+
+void *
+CvrObliqueSampler::probeThread(void * closure)
+{
+  const struct cvr_probe_job * job = (const struct cvr_probe_job *)closure;
+  job->sampler->probePoints(job);
+  return NULL;
+}
+
+// Samples the volume at each of the "numpoints" positions in
+// "points", given in object space, into "buffer". Samples outside
+// the volume are set to "outsidevalue".
+//
+// The points are split over threads as for resample().
+void
+CvrObliqueSampler::probe(const SbVec3f * points, const int numpoints,
+                         const SbBool linear, const float outsidevalue,
+                         float * buffer) const
+{
+  if (numpoints <= 0) { return; }
+
+  struct cvr_probe_job job;
+  job.sampler = this;
+  job.points = points;
+  job.linear = linear;
+  job.outsidevalue = outsidevalue;
+  job.buffer = buffer;
+
+  // Few points aren't worth the thread overhead.
+  const int nrjobs = SbMax(SbMin(CvrUtil::maxWorkerThreads(), numpoints / 4096), 1);
+
+  SbList<struct cvr_probe_job> jobs;
+  for (int i = 0; i < nrjobs; i++) {
+    job.firstpoint = (int)(((double)numpoints * i) / nrjobs);
+    job.endpoint = (int)(((double)numpoints * (i + 1)) / nrjobs);
+    jobs.append(job);
+  }
+
+  CvrUtil::runJobs((void *)jobs.getArrayPtr(), jobs.getLength(),
+                   sizeof(struct cvr_probe_job), CvrObliqueSampler::probeThread);
+}
+
+// *************************************************************************
+
+// Resamples the given rectangle, as for resample(), and looks the
+// values up in "clut" into "rgba", with 4 bytes per sample. Samples
+// outside the volume are fully transparent.
+void
+CvrObliqueSampler::resampleRGBA(const SbVec3f & origo, const SbVec3f & horizspan,
+                                const SbVec3f & verticalspan, const SbVec2s & size,
+                                const SbBool linear, const CvrCLUT * clut,
+                                uint8_t * rgba) const
+{
+  const int nrsamples = size[0] * size[1];
+  float * values = new float[nrsamples];
+  this->resample(origo, horizspan, verticalspan, size, linear, -1.0f, values);
+
+  // The CLUT covers 8 bits, so 16-bit values are scaled down.
+  const unsigned int shift = (this->bytesprvoxel == 2) ? 8 : 0;
+  const unsigned int maxidx = clut->getNumEntries() - 1;
+
+  for (int i = 0; i < nrsamples; i++) {
+    uint8_t * c = &rgba[i * 4];
+    if (values[i] < 0.0f) { // outside the volume
+      c[0] = c[1] = c[2] = c[3] = 0;
+      continue;
+    }
+    const unsigned int idx = ((unsigned int)(values[i] + 0.5f)) >> shift;
+    clut->lookupRGBA(SbMin(idx, maxidx), c);
+  }
+
+  delete[] values;
+}
+
+// Renders samples from resampleRGBA() as a mesh of colored quads,
+// with one vertex per sample.
+void
+CvrObliqueSampler::renderRGBA(const SbVec3f & origo, const SbVec3f & horizspan,
+                              const SbVec3f & verticalspan, const SbVec2s & size,
+                              const uint8_t * rgba)
+{
+  const int width = size[0];
+  const int height = size[1];
+  const SbVec3f colstep = horizspan / (float)width;
+  const SbVec3f rowstep = verticalspan / (float)height;
+  const SbVec3f start = origo + (colstep + rowstep) * 0.5f;
+
+  for (int row = 0; row < (height - 1); row++) {
+    glBegin(GL_QUAD_STRIP);
+    for (int col = 0; col < width; col++) {
+      for (int r = row; r <= (row + 1); r++) {
+        const SbVec3f v = start + colstep * (float)col + rowstep * (float)r;
+        glColor4ubv(&rgba[(r * width + col) * 4]);
+        glVertex3fv(v.getValue());
+      }
+    }
+    glEnd();
+  }
+}
@@ -32,18 +32,48 @@
 
 #include <VolumeViz/misc/CvrResourceManager.h>
 
+#include <stdlib.h>
+
+#include <Inventor/C/tidbits.h>
 #include <Inventor/elements/SoGLCacheContextElement.h>
+#include <Inventor/errors/SoDebugError.h>
+#include <Inventor/lists/SbPList.h>
+#include <Inventor/threads/SbMutex.h>
+#include <Inventor/threads/SbThreadMutex.h>
 #include <Inventor/misc/SoContextHandler.h>
 
 // *************************************************************************
 
 SbDict * CvrResourceManager::managers = NULL;
 
+// Maps GL context ids to the id of the first context in their share
+// group. Contexts not declared to be sharing are not in here.
+SbDict * CvrResourceManager::sharegroups = NULL;
+
+SbThreadMutex * CvrResourceManager::managersmutex = NULL;
+
+// *************************************************************************
+
+void
+CvrResourceManager::initClass(void)
+{
+  assert(CvrResourceManager::managersmutex == NULL);
+  CvrResourceManager::managersmutex = new SbThreadMutex;
+}
+
 // *************************************************************************
 
+// Returns the resource manager for the given GL context. Contexts in
+// the same share group, as set up with setShareGroup(), get the same
+// instance, so textures and other GL objects are made only once for
+// all of them.
 CvrResourceManager *
 CvrResourceManager::getInstance(uint32_t ctxid)
 {
+  CvrResourceManager::managersmutex->lock();
+
+  ctxid = CvrResourceManager::getShareGroup(ctxid);
+
   if (CvrResourceManager::managers == NULL) {
     // FIXME: this causes a static mem-leak. 20041111 mortene.
     CvrResourceManager::managers = new SbDict;
@@ -58,16 +88,94 @@ CvrResourceManager::getInstance(uint32_t ctxid)
     const SbBool newentry = CvrResourceManager::managers->enter(key, value);
     assert(newentry);
   }
+
+  CvrResourceManager::managersmutex->unlock();
+  return (CvrResourceManager *)value;
+}
+
+// Returns the resource manager for the GL context with id \a ctxid,
+// or NULL if none has been set up yet. Unlike getInstance(), this
+// doesn't count as the context being used.
+CvrResourceManager *
+CvrResourceManager::findInstance(uint32_t ctxid)
+{
+  CvrResourceManager::managersmutex->lock();
+
+  ctxid = CvrResourceManager::getShareGroup(ctxid);
+
+  void * value = NULL;
+  if (CvrResourceManager::managers != NULL) {
+    const unsigned long key = (unsigned long)ctxid;
+    if (!CvrResourceManager::managers->find(key, value)) { value = NULL; }
+  }
+
+  CvrResourceManager::managersmutex->unlock();
   return (CvrResourceManager *)value;
 }
 
+// Declare that the GL context with id \a ctxid shares its objects
+// (textures, buffers, programs) with the context \a sharectxid.
+//
+// This must be set up before anything is rendered in \a ctxid.
+void
+CvrResourceManager::setShareGroup(uint32_t ctxid, uint32_t sharectxid)
+{
+  CvrResourceManager::managersmutex->lock();
+
+  if (CvrResourceManager::sharegroups == NULL) {
+    // FIXME: this causes a static mem-leak. 20041111 mortene.
+    CvrResourceManager::sharegroups = new SbDict;
+  }
+
+  const uint32_t group = CvrResourceManager::getShareGroup(sharectxid);
+  void * value;
+  if (ctxid == group) {
+    // Nothing to do.
+  }
+  else if (CvrResourceManager::managers &&
+           CvrResourceManager::managers->find((unsigned long)ctxid, value)) {
+    SoDebugError::postWarning("CvrResourceManager::setShareGroup",
+                              "GL context %u has already been rendered to, "
+                              "can not make it share resources with "
+                              "context %u", ctxid, sharectxid);
+  }
+  else {
+    (void)CvrResourceManager::sharegroups->enter((unsigned long)group,
+                                                 (void *)(unsigned long)group);
+    (void)CvrResourceManager::sharegroups->enter((unsigned long)ctxid,
+                                                 (void *)(unsigned long)group);
+  }
+
+  CvrResourceManager::managersmutex->unlock();
+}
+
+// Returns the id of the context representing the share group \a
+// ctxid is in, or \a ctxid itself if it is not sharing with any
+// other context.
+uint32_t
+CvrResourceManager::getShareGroup(uint32_t ctxid)
+{
+  CvrResourceManager::managersmutex->lock();
+  void * value;
+  if (CvrResourceManager::sharegroups &&
+      CvrResourceManager::sharegroups->find((unsigned long)ctxid, value)) {
+    ctxid = (uint32_t)(unsigned long)value;
+  }
+  CvrResourceManager::managersmutex->unlock();
+  return ctxid;
+}
+
+// *************************************************************************
+
 CvrResourceManager::CvrResourceManager(uint32_t ctxid)
 {
   this->ctxid = ctxid;
+  this->mutex = new SbMutex;
 }
 
 CvrResourceManager::~CvrResourceManager()
 {
+  delete this->mutex;
 }
 
 // *************************************************************************
@@ -76,6 +184,8 @@ void
 CvrResourceManager::set(const void * resourceholder, void * resource,
                         ToBeDeletedCB * cb, void * cbclosure)
 {
+  this->mutex->lock();
+
   const unsigned long dictkey = (unsigned long)resourceholder;
   const SbBool newentry = this->resourceholders.enter(dictkey, resource);
   assert(newentry);
@@ -84,18 +194,25 @@ CvrResourceManager::set(const void * resourceholder, void * resource,
     struct cb s = { resourceholder, cb, cbclosure };
     this->cblist.append(s);
   }
+
+  this->mutex->unlock();
 }
 
 SbBool
 CvrResourceManager::get(const void * resourceholder, void *& resource) const
 {
+  this->mutex->lock();
   const unsigned long dictkey = (unsigned long)resourceholder;
-  return this->resourceholders.find(dictkey, resource);
+  const SbBool found = this->resourceholders.find(dictkey, resource);
+  this->mutex->unlock();
+  return found;
 }
 
 void
 CvrResourceManager::remove(const void * resourceholder)
 {
+  this->mutex->lock();
+
   const unsigned long dictkey = (unsigned long)resourceholder;
   const SbBool ok = this->resourceholders.remove(dictkey);
   assert(ok);
@@ -106,12 +223,23 @@ CvrResourceManager::remove(const void * resourceholder)
       break;
     }
   }
+
+  this->mutex->unlock();
 }
 
 // *************************************************************************
 
 void
 CvrResourceManager::killTexture(const GLuint id)
+{
+  this->mutex->lock();
+  this->scheduleTextureDeletion(id);
+  this->mutex->unlock();
+}
+
+// Must be called with the mutex locked.
+void
+CvrResourceManager::scheduleTextureDeletion(const GLuint id)
 {
   // If first item, schedule a callback to be invoked the next time
   // the context is made current.
@@ -124,19 +252,86 @@ CvrResourceManager::killTexture(const GLuint id)
   this->dyingtextureids.append(id);
 }
 
+// Instead of deleting a texture which is no longer needed, keep it
+// around for reuse by a new texture of the same size and format, so
+// the GL storage need not be reallocated. Only a few textures are
+// kept, the oldest ones are deleted as new ones are recycled.
+//
+// The texture recycling can be disabled by setting the environment
+// variable CVR_TEXTURE_RECYCLING to "0", or the number of textures
+// kept can be set with it (default is 8).
+void
+CvrResourceManager::recycleTexture(const GLuint id, const SbVec3s & dimensions,
+                                   const GLenum internalformat, const GLenum format)
+{
+  static int maxrecycled = -1;
+  if (maxrecycled == -1) {
+    const char * env = coin_getenv("CVR_TEXTURE_RECYCLING");
+    maxrecycled = env ? SbMax(atoi(env), 0) : 8;
+  }
+
+  this->mutex->lock();
+
+  if (maxrecycled == 0) {
+    this->scheduleTextureDeletion(id);
+  }
+  else {
+    if (this->recycledtextures.getLength() >= maxrecycled) {
+      this->scheduleTextureDeletion(this->recycledtextures[0].id);
+      this->recycledtextures.remove(0);
+    }
+
+    struct recycledtexture t = { id, dimensions, internalformat, format };
+    this->recycledtextures.append(t);
+  }
+
+  this->mutex->unlock();
+}
+
+// Returns a previously recycled texture of the given size and format,
+// if there is one.
+SbBool
+CvrResourceManager::reuseTexture(const SbVec3s & dimensions,
+                                 const GLenum internalformat, const GLenum format,
+                                 GLuint & id)
+{
+  SbBool found = FALSE;
+
+  this->mutex->lock();
+
+  // Search from the end, to get the most recently used texture.
+  for (int i = this->recycledtextures.getLength() - 1; (i >= 0) && !found; i--) {
+    const struct recycledtexture & t = this->recycledtextures[i];
+    if ((t.dimensions == dimensions) &&
+        (t.internalformat == internalformat) && (t.format == format)) {
+      id = t.id;
+      this->recycledtextures.remove(i);
+      found = TRUE;
+    }
+  }
+
+  this->mutex->unlock();
+
+  return found;
+}
+
 // *************************************************************************
 
 void
 CvrResourceManager::GLContextMadeCurrent(uint32_t contextid)
 {
-  assert(contextid == this->ctxid);
+  // Note that contextid may differ from this->ctxid for contexts
+  // in a share group (see leaveShareGroup()), which is fine, as any
+  // context in the group will do for deleting the textures.
 
+  this->mutex->lock();
   const unsigned int len = (unsigned int)this->dyingtextureids.getLength();
   for (unsigned int i=0; i < len; i++) {
     const GLuint id = this->dyingtextureids[i];
     glDeleteTextures(1, &id);
   }
   this->dyingtextureids.truncate(0);
+  this->mutex->unlock();
 }
 
 void
@@ -150,6 +345,18 @@ CvrResourceManager::GLContextMadeCurrentCB(void * closure, uint32_t contextid)
 void
 CvrResourceManager::GLContextDestructionCB(uint32_t contextid, void * userdata)
 {
+  // Note: the callbacks below will call back into this class, which
+  // is why the mutex must be recursive.
+  CvrResourceManager::managersmutex->lock();
+
+  if (CvrResourceManager::leaveShareGroup(contextid)) {
+    // Other contexts in the share group are still alive, so the
+    // resources must be kept.
+    CvrResourceManager::managersmutex->unlock();
+    return;
+  }
+
+  const uint32_t group = CvrResourceManager::getShareGroup(contextid);
   CvrResourceManager * rm = CvrResourceManager::getInstance(contextid);
 
   while (rm->cblist.getLength()) {
@@ -160,13 +367,75 @@ CvrResourceManager::GLContextDestructionCB(uint32_t contextid, void * userdata)
     if (len == rm->cblist.getLength()) { rm->remove(cbstruct->resourceholder); }
   }
 
-  // Clean out any resources recently added.
+  // Clean out any resources recently added, and the textures kept
+  // for reuse.
+  rm->mutex->lock();
+  for (int i = 0; i < rm->recycledtextures.getLength(); i++) {
+    rm->dyingtextureids.append(rm->recycledtextures[i].id);
+  }
+  rm->recycledtextures.truncate(0);
+  rm->mutex->unlock();
   rm->GLContextMadeCurrent(contextid);
 
-  const unsigned long key = (unsigned long)contextid;
+  if (CvrResourceManager::sharegroups) {
+    (void)CvrResourceManager::sharegroups->remove((unsigned long)contextid);
+  }
+
+  const unsigned long key = (unsigned long)group;
   const SbBool ok = CvrResourceManager::managers->remove(key);
   assert(ok);
   delete rm;
+
+  CvrResourceManager::managersmutex->unlock();
+}
+
+// *************************************************************************
+
+// Removes a dying context from its share group, and returns TRUE,
+// if there are other contexts left in the group. The group keeps its
+// id (and its resource manager) until the last context dies.
+SbBool
+CvrResourceManager::leaveShareGroup(uint32_t contextid)
+{
+  if (CvrResourceManager::sharegroups == NULL) { return FALSE; }
+
+  void * value;
+  if (!CvrResourceManager::sharegroups->find((unsigned long)contextid, value)) {
+    return FALSE;
+  }
+  const unsigned long group = (unsigned long)value;
+
+  SbPList keys, values;
+  CvrResourceManager::sharegroups->makePList(keys, values);
+  uint32_t survivor = contextid;
+  for (int i=0; (i < keys.getLength()) && (survivor == contextid); i++) {
+    if (((unsigned long)values[i] == group) &&
+        ((unsigned long)keys[i] != contextid)) {
+      survivor = (uint32_t)(unsigned long)keys[i];
+    }
+  }
+  if (survivor == contextid) { return FALSE; }
+
+  (void)CvrResourceManager::sharegroups->remove((unsigned long)contextid);
+
+  if (CvrResourceManager::managers &&
+      CvrResourceManager::managers->find(group, value)) {
+    CvrResourceManager * rm = (CvrResourceManager *)value;
+    if (rm->ctxid == contextid) {
+      // Deferred deletion must be done from a context which is still
+      // alive.
+      rm->mutex->lock();
+      rm->ctxid = survivor;
+      if (rm->dyingtextureids.getLength() > 0) {
+        SoGLCacheContextElement::scheduleDeleteCallback(survivor,
+                                                        CvrResourceManager::GLContextMadeCurrentCB,
+                                                        rm);
+      }
+      rm->mutex->unlock();
+    }
+  }
+
+  return TRUE;
 }
 
 // *************************************************************************
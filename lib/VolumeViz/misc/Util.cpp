@@ -37,6 +37,12 @@
 #include <Inventor/SbRotation.h>
 #include <Inventor/SbLinear.h>
 #include <Inventor/C/tidbits.h>
+#include <Inventor/system/gl.h>
+#include <Inventor/elements/SoClipPlaneElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/threads/SbThread.h>
 
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
@@ -219,3 +225,121 @@ CvrUtil::getTransformFromVolumeBoxDimensions(const CvrVoxelBlockElement * vd,
 
   m.setTransform(localtrans, SbRotation::identity(), localspan);
 }
+
+// Returns FALSE if the given box, in the current local coordinate
+// system, is completely outside the view volume. Used to avoid
+// building, uploading and slicing textures for off-screen parts of
+// the volume.
+SbBool
+CvrUtil::isInsideViewVolume(SoState * state, const SbBox3f & box)
+{
+  // Make it possible to turn off view frustum culling, for debugging
+  // purposes.
+  static int noculling = -1;
+  if (noculling == -1) {
+    const char * envstr = coin_getenv("CVR_NO_FRUSTUM_CULLING");
+    noculling = envstr && atoi(envstr) > 0;
+  }
+  if (noculling) { return TRUE; }
+
+  SbBox3f worldbox = box;
+  worldbox.transform(SoModelMatrixElement::get(state));
+  return SoViewVolumeElement::get(state).intersect(worldbox);
+}
+
+// Restricts rendering to the given box, in the current local
+// coordinate system, by enabling two OpenGL clip planes for each
+// axis set in \a axismask (bit 0 is X, bit 1 is Y and bit 2 is
+// Z). The planes are allocated after the ones used by SoClipPlane
+// nodes in the scene graph.
+//
+// Returns FALSE, and enables no planes, if there are not enough clip
+// planes available.
+SbBool
+CvrUtil::enableClipBox(SoState * state, const SbBox3f & box,
+                       const unsigned int axismask)
+{
+  const int first = SoClipPlaneElement::getInstance(state)->getNum();
+
+  int needed = 0;
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    if (axismask & (1 << axis)) { needed += 2; }
+  }
+
+  GLint maxplanes = 0;
+  glGetIntegerv(GL_MAX_CLIP_PLANES, &maxplanes);
+  if (first + needed > maxplanes) { return FALSE; }
+
+  SbVec3f boxmin, boxmax;
+  box.getBounds(boxmin, boxmax);
+
+  int plane = first;
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    if (!(axismask & (1 << axis))) { continue; }
+
+    GLdouble eq[4] = { 0.0, 0.0, 0.0, 0.0 };
+    eq[axis] = 1.0;
+    eq[3] = - boxmin[axis];
+    glClipPlane(GL_CLIP_PLANE0 + plane, eq);
+    glEnable(GL_CLIP_PLANE0 + plane);
+    plane++;
+
+    eq[axis] = -1.0;
+    eq[3] = boxmax[axis];
+    glClipPlane(GL_CLIP_PLANE0 + plane, eq);
+    glEnable(GL_CLIP_PLANE0 + plane);
+    plane++;
+  }
+
+  return TRUE;
+}
+
+// Disables the clip planes enabled by enableClipBox().
+void
+CvrUtil::disableClipBox(SoState * state, const unsigned int axismask)
+{
+  const int first = SoClipPlaneElement::getInstance(state)->getNum();
+
+  int plane = first;
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    if (!(axismask & (1 << axis))) { continue; }
+    glDisable(GL_CLIP_PLANE0 + plane++);
+    glDisable(GL_CLIP_PLANE0 + plane++);
+  }
+}
+
+// Max number of threads to split work on the CPU over, e.g. oblique
+// slice resampling and ray picking, from the CVR_RESAMPLE_THREADS
+// environment variable (default 4).
+int
+CvrUtil::maxWorkerThreads(void)
+{
+  static int maxthreads = -1;
+  if (maxthreads == -1) {
+    const char * env = coin_getenv("CVR_RESAMPLE_THREADS");
+    maxthreads = env ? SbMax(atoi(env), 1) : 4;
+  }
+  return maxthreads;
+}
+
+// Runs "func" on each of the "nrjobs" jobs in the "jobs" array, of
+// "jobsize" bytes each, in separate threads. The calling thread does
+// the first job itself.
+void
+CvrUtil::runJobs(void * jobs, const int nrjobs, const unsigned int jobsize,
+                 void * (*func)(void *))
+{
+  if (nrjobs <= 0) { return; }
+
+  SbList<SbThread *> threads;
+  for (int i = 1; i < nrjobs; i++) {
+    threads.append(SbThread::create(func, (char *)jobs + i * jobsize));
+  }
+
+  (void)func(jobs);
+
+  for (int i = 0; i < threads.getLength(); i++) {
+    threads[i]->join();
+    SbThread::destroy(threads[i]);
+  }
+}
@@ -0,0 +1,72 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
+
+#include <assert.h>
+#include <VolumeViz/elements/CvrVoxelBlockElement.h>
+
+// *************************************************************************
+
+SbThreadMutex * CvrVolumeRenderLock::mutexes[CvrVolumeRenderLock::NRMUTEXES];
+
+// *************************************************************************
+
+void
+CvrVolumeRenderLock::init(void)
+{
+  for (unsigned int i=0; i < CvrVolumeRenderLock::NRMUTEXES; i++) {
+    assert(CvrVolumeRenderLock::mutexes[i] == NULL);
+    CvrVolumeRenderLock::mutexes[i] = new SbThreadMutex;
+  }
+}
+
+// *************************************************************************
+
+// Locks the volume of the SoVolumeData node currently on the state
+// stack. Nodes rendered without an SoVolumeData all share the same
+// lock.
+CvrVolumeRenderLock::CvrVolumeRenderLock(SoState * state)
+{
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  const uint32_t nodeid = vbelem ? vbelem->getNodeId() : 0;
+
+  this->mutex = CvrVolumeRenderLock::mutexes[nodeid % CvrVolumeRenderLock::NRMUTEXES];
+  this->mutex->lock();
+}
+
+CvrVolumeRenderLock::~CvrVolumeRenderLock()
+{
+  this->mutex->unlock();
+}
+
+// *************************************************************************
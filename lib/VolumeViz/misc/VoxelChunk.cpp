@@ -41,6 +41,8 @@
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/misc/SoState.h>
 #include <Inventor/SbVec3f.h>
+#include <Inventor/lists/SbPList.h>
+#include <Inventor/threads/SbRWMutex.h>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -74,6 +76,19 @@ const unsigned int COLOR_TABLE_PREDEF_SIZE = 256;
 uint8_t CvrVoxelChunk::PREDEFGRADIENTS[SoTransferFunction::SEISMIC + 1][COLOR_TABLE_PREDEF_SIZE][4];
 
 SbDict * CvrVoxelChunk::CLUTdict = NULL;
+SbDict * CvrVoxelChunk::CLUTcontentdict = NULL;
+SbRWMutex * CvrVoxelChunk::CLUTdictmutex = NULL;
+
+// *************************************************************************
+
+void
+CvrVoxelChunk::initClass(void)
+{
+  assert(CvrVoxelChunk::CLUTdictmutex == NULL);
+  CvrVoxelChunk::CLUTdictmutex = new SbRWMutex(SbRWMutex::READ_PRECEDENCE);
+  CvrVoxelChunk::CLUTdict = new SbDict;
+  CvrVoxelChunk::CLUTcontentdict = new SbDict;
+}
 
 // *************************************************************************
 
@@ -169,7 +184,9 @@ CvrVoxelChunk::getUnitSize(void) const
 
 // Converts the transferfunction's colormap into a CvrCLUT object.
 CvrCLUT *
-CvrVoxelChunk::makeCLUT(const SoTransferFunctionElement * tfelement, CvrCLUT::AlphaUse alphause)
+CvrVoxelChunk::makeCLUT(const SoTransferFunction * transferfunc,
+                        const uint32_t transparencythresholds[2],
+                        CvrCLUT::AlphaUse alphause)
 {
   static SbBool init_predefs = TRUE;
   if (init_predefs) {
@@ -177,7 +194,6 @@ CvrVoxelChunk::makeCLUT(const SoTransferFunctionElement * tfelement, CvrCLUT::Al
     CvrVoxelChunk::initPredefGradients();
   }
 
-  SoTransferFunction * transferfunc = tfelement->getTransferFunction();
   assert(transferfunc != NULL);
 
   const int predefmapidx = transferfunc->predefColorMap.getValue();
@@ -210,9 +226,6 @@ CvrVoxelChunk::makeCLUT(const SoTransferFunctionElement * tfelement, CvrCLUT::Al
     clut = new CvrCLUT(nrcols, nrcomponents, colormap, alphause);
   }
 
-  uint32_t transparencythresholds[2];
-  tfelement->getTransparencyThresholds(transparencythresholds[0],
-                                       transparencythresholds[1]);
   clut->setTransparencyThresholds(transparencythresholds[0],
                                   SbMin(nrcols - 1, transparencythresholds[1]));
   return clut;
@@ -221,45 +234,203 @@ CvrVoxelChunk::makeCLUT(const SoTransferFunctionElement * tfelement, CvrCLUT::Al
 
 // Fetch a CLUT that represents the current
 // SoTransferFunction. Facilitates sharing of palettes.
+//
+// The returned CLUT is ref()'ed for the caller, which must unref() it
+// when done. The cache keeps it alive until the SoTransferFunction
+// node changes or is destructed. Identical color maps from different
+// nodes give back the same CvrCLUT instance.
 CvrCLUT *
 CvrVoxelChunk::getCLUT(const SoTransferFunctionElement * tfelement, CvrCLUT::AlphaUse alphause)
 {
-  if (!CvrVoxelChunk::CLUTdict) {
-    // FIXME: dealloc at exit
-    CvrVoxelChunk::CLUTdict = new SbDict;
-  }
+  uint32_t transparencythresholds[2];
+  tfelement->getTransparencyThresholds(transparencythresholds[0],
+                                       transparencythresholds[1]);
+  return CvrVoxelChunk::getCLUT(tfelement->getTransferFunction(),
+                                transparencythresholds, alphause);
+}
 
-  SoTransferFunction * transferfunc = tfelement->getTransferFunction();
+// Fetch the CLUT for an SoTransferFunction node outside of any scene
+// graph traversal. The transparency thresholds are read from the
+// node's fields, as SoTransferFunction does when setting the element,
+// so this gives the same CLUT as when rendering.
+CvrCLUT *
+CvrVoxelChunk::getCLUT(const SoTransferFunction * transferfunc, CvrCLUT::AlphaUse alphause)
+{
+  const uint32_t transparencythresholds[2] = {
+    (uint32_t)transferfunc->remapLow.getValue(),
+    (uint32_t)transferfunc->remapHigh.getValue()
+  };
+  return CvrVoxelChunk::getCLUT(transferfunc, transparencythresholds, alphause);
+}
+
+CvrCLUT *
+CvrVoxelChunk::getCLUT(const SoTransferFunction * transferfunc,
+                       const uint32_t transparencythresholds[2],
+                       CvrCLUT::AlphaUse alphause)
+{
   assert(transferfunc != NULL);
+  const unsigned long key = (unsigned long)transferfunc;
+  const uint32_t nodeid = transferfunc->getNodeId();
 
-  void * clutptr;
-  CvrCLUT * clut;
-  void * alphauseptr;
-  SbDict * alphadict;
-  if (CvrVoxelChunk::CLUTdict->find(transferfunc->getNodeId(), alphauseptr)) {
-    alphadict = (SbDict *) alphauseptr;
-    if (alphadict->find(alphause, clutptr)) {
-      clut = (CvrCLUT *) clutptr;
-    } else {
-      clut = CvrVoxelChunk::makeCLUT(tfelement, alphause);
-      // FIXME: ref(), or else we'd get dangling pointers to destructed
-      // CvrCLUT entries in the dict. Should provide a "destructing now"
-      // callback on the CvrCLUT class to clean up the design, as this
-      // is a resource leak as it now stands.
+  // The common case is a hit, which can be done concurrently from
+  // all render threads. The caller's reference is taken while the
+  // lock is held, so the CLUT can't be released under it.
+  CvrCLUT * clut = NULL;
+  void * ptr;
+  CvrVoxelChunk::CLUTdictmutex->readLock();
+  if (CvrVoxelChunk::CLUTdict->find(key, ptr)) {
+    struct CLUTNodeEntry * entry = (struct CLUTNodeEntry *)ptr;
+    if ((entry->nodeid == nodeid) && entry->cluts[alphause] &&
+        (entry->thresholds[alphause][0] == transparencythresholds[0]) &&
+        (entry->thresholds[alphause][1] == transparencythresholds[1])) {
+      clut = entry->cluts[alphause];
       clut->ref();
-      alphadict->enter(alphause, clut);
     }
   }
+  CvrVoxelChunk::CLUTdictmutex->readUnlock();
+  if (clut) { return clut; }
+
+  CvrVoxelChunk::CLUTdictmutex->writeLock();
+
+  struct CLUTNodeEntry * entry;
+  if (CvrVoxelChunk::CLUTdict->find(key, ptr)) {
+    entry = (struct CLUTNodeEntry *)ptr;
+  }
   else {
-    alphadict = new SbDict;
-    SbBool r = CvrVoxelChunk::CLUTdict->enter(transferfunc->getNodeId(), alphadict);
-    assert(r == TRUE && "clut should not exist on nodeid");
-    return CvrVoxelChunk::getCLUT(tfelement, alphause);
+    entry = new struct CLUTNodeEntry;
+    entry->nodeid = nodeid;
+    for (unsigned int i=0; i <= CvrCLUT::ALPHA_BINARY; i++) { entry->cluts[i] = NULL; }
+    const SbBool r = CvrVoxelChunk::CLUTdict->enter(key, entry);
+    assert(r);
+  }
+
+  if (entry->nodeid != nodeid) {
+    // The node has been changed since the CLUTs were made.
+    CvrVoxelChunk::releaseCLUTNodeEntry(entry);
+    entry->nodeid = nodeid;
+    CvrVoxelChunk::releaseUnusedCLUTs();
+  }
+
+  clut = entry->cluts[alphause];
+  if (clut &&
+      ((entry->thresholds[alphause][0] != transparencythresholds[0]) ||
+       (entry->thresholds[alphause][1] != transparencythresholds[1]))) {
+    // Made for other transparency thresholds.
+    clut->unref();
+    clut = entry->cluts[alphause] = NULL;
+    CvrVoxelChunk::releaseUnusedCLUTs();
+  }
+
+  if (clut == NULL) { // (could have been made by another thread)
+    clut = CvrVoxelChunk::findSharedCLUT(CvrVoxelChunk::makeCLUT(transferfunc,
+                                                                 transparencythresholds,
+                                                                 alphause));
+    clut->ref(); // the node entry's reference
+    entry->cluts[alphause] = clut;
+    entry->thresholds[alphause][0] = transparencythresholds[0];
+    entry->thresholds[alphause][1] = transparencythresholds[1];
   }
 
+  clut->ref(); // the caller's reference
+  CvrVoxelChunk::CLUTdictmutex->writeUnlock();
   return clut;
 }
 
+// Returns an equal CLUT from the cache if there is one, in which case
+// the incoming CLUT is destructed. If not, the incoming CLUT is
+// stored in the cache. CLUTdictmutex must be write-locked.
+CvrCLUT *
+CvrVoxelChunk::findSharedCLUT(CvrCLUT * clut)
+{
+  const unsigned long key = clut->getChecksum();
+  SbList<CvrCLUT *> * l;
+  void * ptr;
+  if (CvrVoxelChunk::CLUTcontentdict->find(key, ptr)) {
+    l = (SbList<CvrCLUT *> *)ptr;
+    for (int i=0; i < l->getLength(); i++) {
+      if (*((*l)[i]) == *clut) {
+        clut->ref();
+        clut->unref();
+        return (*l)[i];
+      }
+    }
+  }
+  else {
+    l = new SbList<CvrCLUT *>;
+    const SbBool r = CvrVoxelChunk::CLUTcontentdict->enter(key, l);
+    assert(r);
+  }
+
+  clut->ref(); // the cache's reference
+  l->append(clut);
+  return clut;
+}
+
+// Releases the CLUTs used by a node. CLUTdictmutex must be
+// write-locked.
+void
+CvrVoxelChunk::releaseCLUTNodeEntry(struct CLUTNodeEntry * entry)
+{
+  for (unsigned int i=0; i <= CvrCLUT::ALPHA_BINARY; i++) {
+    if (entry->cluts[i]) {
+      entry->cluts[i]->unref();
+      entry->cluts[i] = NULL;
+    }
+  }
+}
+
+// Throws out the CLUTs no longer in use by any node, texture or
+// renderer, i.e. the ones where the cache holds the only
+// reference. CLUTdictmutex must be write-locked.
+void
+CvrVoxelChunk::releaseUnusedCLUTs(void)
+{
+  SbPList keys, values;
+  CvrVoxelChunk::CLUTcontentdict->makePList(keys, values);
+  for (int i=0; i < keys.getLength(); i++) {
+    SbList<CvrCLUT *> * l = (SbList<CvrCLUT *> *)values[i];
+    for (int j=0; j < l->getLength(); j++) {
+      CvrCLUT * clut = (*l)[j];
+      if (clut->getRefCount() == 1) {
+        l->removeFast(j);
+        j--;
+        clut->unref();
+      }
+    }
+    if (l->getLength() == 0) {
+      const SbBool r = CvrVoxelChunk::CLUTcontentdict->remove((unsigned long)keys[i]);
+      assert(r);
+      delete l;
+    }
+  }
+}
+
+// Called when an SoTransferFunction node is destructed, to throw out
+// the CLUTs made for it.
+void
+CvrVoxelChunk::releaseCLUTs(const SoTransferFunction * node)
+{
+  // Node destruction before SoVolumeRendering::init() is possible
+  // if the application only instantiates the node for e.g. type
+  // checking.
+  if (CvrVoxelChunk::CLUTdictmutex == NULL) { return; }
+
+  CvrVoxelChunk::CLUTdictmutex->writeLock();
+
+  const unsigned long key = (unsigned long)node;
+  void * ptr;
+  if (CvrVoxelChunk::CLUTdict->find(key, ptr)) {
+    struct CLUTNodeEntry * entry = (struct CLUTNodeEntry *)ptr;
+    CvrVoxelChunk::releaseCLUTNodeEntry(entry);
+    const SbBool r = CvrVoxelChunk::CLUTdict->remove(key);
+    assert(r);
+    delete entry;
+    CvrVoxelChunk::releaseUnusedCLUTs();
+  }
+
+  CvrVoxelChunk::CLUTdictmutex->writeUnlock();
+}
+
 
 void
 CvrVoxelChunk::transfer(const SoGLRenderAction * action, const CvrCLUT * clut,
@@ -290,9 +461,11 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
   // non-fully-transparent. This could be used to optimize texture
   // rendering. 20021201 mortene.
 
-  // FIXME: in addition to the "invisible" area, we could keep an
-  // "opaqueness" area, to make it possible to optimize rendering by
-  // occlusion culling. 20021201 mortene.
+  // Note: in addition to the "invisible" flag, we record whether or
+  // not the texture is fully opaque, to make it possible to optimize
+  // rendering by occlusion culling. For paletted textures, this is
+  // done by storing which indices are used, as the palette can change
+  // without the texture being regenerated.
 
   SoState * state = action->getState();
   const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
@@ -328,15 +501,12 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
   // bug mentioned above manifests itself for 3d-textures (probably
   // not -- the code-paths in the driver is likely to be different).
   // 20050419 mortene.
-#if 1
-  const SbVec3s texsize(coin_next_power_of_two(size[0] - 1),
-                        coin_next_power_of_two(size[1] - 1),
-                        coin_next_power_of_two(size[2] - 1));
-#else
-  const SbVec3s texsize(SbMax((uint32_t)4, coin_next_power_of_two(size[0] - 1)),
-                        SbMax((uint32_t)4, coin_next_power_of_two(size[1] - 1)),
-                        SbMax((uint32_t)4, coin_next_power_of_two(size[2] - 1)));
-#endif
+  //
+  // UPDATE: the texture object's dimensions are now used directly,
+  // as they are no longer necessarily power-of-two's (if the GL
+  // driver supports NPOT textures), and the texture buffers are
+  // allocated to exactly those dimensions anyway.
+  const SbVec3s texsize = texobj->getDimensions();
 
   invisible = TRUE;
 
@@ -386,6 +556,10 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
   CvrGradient * grad = new CvrCentralDifferenceGradient((uint8_t *) inputbytebuffer, size, 
                                                         CvrUtil::useFlippedYAxis());
 
+  uint32_t usedindices[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  SbBool opaque = TRUE;
+  SbBox3s indexboxes[256]; // constructor initializes them to empty boxes
+
   for (unsigned int z = 0; z < (unsigned int)  size[2]; z++) {
     for (unsigned int y = 0; y < (unsigned int) size[1]; y++) {
       for (unsigned int x = 0; x < (unsigned int) size[0]; x++) {
@@ -407,7 +581,10 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
           uint8_t voldataidx;
           if (unitsize == 1) voldataidx = ((uint8_t *) inputbytebuffer)[voxelidx];
           else voldataidx = (((uint16_t *) inputbytebuffer)[voxelidx] >> 8); // Shift value to 8bit
-          output[texelidx] = (uint8_t) (voldataidx << shiftval) + offsetval;
+          const uint8_t colidx = (uint8_t) (voldataidx << shiftval) + offsetval;
+          output[texelidx] = colidx;
+          usedindices[colidx >> 5] |= (1u << (colidx & 0x1f));
+          indexboxes[colidx].extendBy(SbVec3s((short)x, (short)y, (short)z));
           if (lighting) {
             SbVec3f voxgrad = grad->getGradientRangeCompressed(x, y, z);
             output[texelidx+1] = (uint8_t) voxgrad[0];
@@ -420,6 +597,7 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
           const uint32_t colidx = (voldataidx << shiftval) + offsetval;
           clut->lookupRGBA(colidx, &output[texelidx * 4]);
           SbBool inv = output[texelidx * 4 + 3] == 0x00;
+          opaque = opaque && (output[texelidx * 4 + 3] == 0xff);
           if (lighting && !inv) {
             SbVec3f voxgrad = grad->getGradient(x, y, z);
             float diffuseLight = SbMax(voxgrad.dot(lightDir), 0.0f);
@@ -457,6 +635,12 @@ CvrVoxelChunk::transfer3D(const SoGLRenderAction * action, const CvrCLUT * clut,
   if (palettetex)
     invisible = FALSE;
 
+  if (palettetex) {
+    palettetex->setUsedIndices(usedindices);
+    palettetex->setIndexBoxes(indexboxes);
+  }
+  else { rgbatex->setOpaque(opaque); }
+
   clut->unref();
 }
 
@@ -942,3 +1126,59 @@ CvrVoxelChunk::buildSubCube(const SbBox3s & cutcube)
 
   return output;
 }
+
+
+// Returns the bounding box, in voxel coordinates of this chunk, of all
+// voxels which are not fully transparent when looked up in \a clut.
+// The box will be empty if all voxels are invisible.
+SbBox3s
+CvrVoxelChunk::getVisibleBox(const SoGLRenderAction * action, const CvrCLUT * clut) const
+{
+  const SbVec3s & size = this->getDimensions();
+  SbBox3s box;
+
+  // Only 8-bit data is transferred to RGBA textures, so don't bother
+  // with anything else.
+  if (this->getUnitSize() != 1) {
+    box.setBounds(SbVec3s(0, 0, 0), size - SbVec3s(1, 1, 1));
+    return box;
+  }
+
+  const SoTransferFunctionElement * tfelement =
+    SoTransferFunctionElement::getInstance(action->getState());
+  assert(tfelement != NULL);
+  const SoTransferFunction * transferfunc = tfelement->getTransferFunction();
+  assert(transferfunc != NULL);
+
+  const int32_t shiftval = transferfunc->shift.getValue();
+  const int32_t offsetval = transferfunc->offset.getValue();
+
+  // Mapping from voxel value to visibility, to avoid doing a palette
+  // lookup per voxel.
+  SbBool visible[256];
+  for (uint32_t v = 0; v < 256; v++) {
+    uint8_t rgba[4];
+    clut->lookupRGBA((v << shiftval) + offsetval, rgba);
+    visible[v] = (rgba[3] != 0x00);
+  }
+
+  const uint8_t * voxels = this->getBuffer8();
+  for (short z = 0; z < size[2]; z++) {
+    for (short y = 0; y < size[1]; y++) {
+      const uint8_t * row = &voxels[(z * size[0] * size[1]) + (y * size[0])];
+
+      short first = 0;
+      while ((first < size[0]) && !visible[row[first]]) { first++; }
+      if (first == size[0]) { continue; }
+
+      short last = size[0] - 1;
+      while (!visible[row[last]]) { last--; }
+
+      box.extendBy(SbVec3s(first, y, z));
+      box.extendBy(SbVec3s(last, y, z));
+    }
+  }
+
+  return box;
+}
+
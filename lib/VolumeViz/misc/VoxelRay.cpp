@@ -0,0 +1,335 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+
+#include <VolumeViz/misc/CvrVoxelRay.h>
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+
+#include <VolumeViz/misc/CvrCLUT.h>
+
+// *************************************************************************
+
+// Value ranges not yet found are marked with min > max.
+#define CVR_RANGE_UNKNOWN 0x00ff
+
+// *************************************************************************
+
+CvrVoxelRay::CvrVoxelRay(const uint8_t * voxels, const unsigned int bytesprvoxel,
+                         const SbVec3s & dimensions, const SbBox3f & volumebox)
+{
+  assert((bytesprvoxel == 1) || (bytesprvoxel == 2));
+
+  this->voxels = voxels;
+  this->bytesprvoxel = bytesprvoxel;
+  this->dimensions = dimensions;
+  this->volumemin = volumebox.getMin();
+  const SbVec3f size = volumebox.getMax() - volumebox.getMin();
+  for (int a = 0; a < 3; a++) { this->voxelsize[a] = size[a] / dimensions[a]; }
+}
+
+// Sets up the ray from \a from to \a to, and moves to the first voxel
+// along it. Returns FALSE if the ray misses the volume.
+SbBool
+CvrVoxelRay::start(const SbVec3f & from, const SbVec3f & to)
+{
+  this->from = from;
+  this->rayvec = to - from;
+
+  // In voxel space, voxel i spans [i, i+1) along each axis.
+  for (int a = 0; a < 3; a++) {
+    this->p0[a] = (from[a] - this->volumemin[a]) / this->voxelsize[a];
+    this->d[a] = this->rayvec[a] / this->voxelsize[a];
+  }
+
+  // Clip the ray to the voxel block.
+  this->t = 0.0f;
+  this->tend = 1.0f;
+  for (int a = 0; a < 3; a++) {
+    if (this->d[a] == 0.0f) {
+      if ((this->p0[a] < 0.0f) || (this->p0[a] > this->dimensions[a])) { return FALSE; }
+      continue;
+    }
+    float t0 = -this->p0[a] / this->d[a];
+    float t1 = (this->dimensions[a] - this->p0[a]) / this->d[a];
+    if (t0 > t1) { const float tmp = t0; t0 = t1; t1 = tmp; }
+    this->t = SbMax(this->t, t0);
+    this->tend = SbMin(this->tend, t1);
+  }
+  if (this->t > this->tend) { return FALSE; }
+
+  for (int a = 0; a < 3; a++) {
+    const int i = (int)floor(this->p0[a] + this->d[a] * this->t);
+    this->voxel[a] = (short)SbClamp(i, 0, this->dimensions[a] - 1);
+  }
+  this->setupSteps();
+  return TRUE;
+}
+
+// Sets up the stepping from the current voxel.
+void
+CvrVoxelRay::setupSteps(void)
+{
+  for (int a = 0; a < 3; a++) {
+    if (this->d[a] > 0.0f) {
+      this->step[a] = 1;
+      this->tdelta[a] = 1.0f / this->d[a];
+      this->tnext[a] = (this->voxel[a] + 1 - this->p0[a]) / this->d[a];
+    }
+    else if (this->d[a] < 0.0f) {
+      this->step[a] = -1;
+      this->tdelta[a] = -1.0f / this->d[a];
+      this->tnext[a] = (this->voxel[a] - this->p0[a]) / this->d[a];
+    }
+    else {
+      this->step[a] = 0;
+      this->tdelta[a] = FLT_MAX;
+      this->tnext[a] = FLT_MAX;
+    }
+  }
+}
+
+// Moves to the next voxel along the ray. Returns FALSE when the end of
+// the ray, or the side of the volume, is reached.
+SbBool
+CvrVoxelRay::next(void)
+{
+  int axis = 0;
+  if (this->tnext[1] < this->tnext[axis]) { axis = 1; }
+  if (this->tnext[2] < this->tnext[axis]) { axis = 2; }
+
+  this->t = this->tnext[axis];
+  if (this->t > this->tend) { return FALSE; }
+
+  const int i = this->voxel[axis] + this->step[axis];
+  if ((i < 0) || (i >= this->dimensions[axis])) { return FALSE; }
+  this->voxel[axis] = (short)i;
+  this->tnext[axis] += this->tdelta[axis];
+  return TRUE;
+}
+
+// Moves to the first voxel after the brick of \a bricksize^3 voxels
+// the current voxel is in. Returns FALSE when the end of the ray, or
+// the side of the volume, is reached.
+SbBool
+CvrVoxelRay::skipBrick(const unsigned int bricksize)
+{
+  int exitaxis = -1, exitboundary = 0;
+  float texit = FLT_MAX;
+  for (int a = 0; a < 3; a++) {
+    if (this->step[a] == 0) { continue; }
+    const int brick = this->voxel[a] / bricksize;
+    const int boundary = (this->step[a] > 0) ? (brick + 1) * bricksize : brick * bricksize;
+    const float tb = (boundary - this->p0[a]) / this->d[a];
+    if (tb < texit) { texit = tb; exitaxis = a; exitboundary = boundary; }
+  }
+  if ((exitaxis == -1) || (texit >= this->tend)) { return FALSE; }
+
+  this->t = texit;
+  for (int a = 0; a < 3; a++) {
+    int i;
+    if (a == exitaxis) {
+      i = (this->step[a] > 0) ? exitboundary : (exitboundary - 1);
+      if ((i < 0) || (i >= this->dimensions[a])) { return FALSE; }
+    }
+    else {
+      i = SbClamp((int)floor(this->p0[a] + this->d[a] * this->t), 0, this->dimensions[a] - 1);
+    }
+    this->voxel[a] = (short)i;
+  }
+  this->setupSteps();
+  return TRUE;
+}
+
+// Returns the index of the current voxel.
+const SbVec3s &
+CvrVoxelRay::getVoxel(void) const
+{
+  return this->voxel;
+}
+
+// Returns the position where the ray enters the current voxel.
+SbVec3f
+CvrVoxelRay::getPosition(void) const
+{
+  return this->from + this->rayvec * this->t;
+}
+
+// Returns the value of the current voxel. 16-bit values are scaled
+// down to 8 bits, as for CLUT lookups.
+uint32_t
+CvrVoxelRay::getValue(void) const
+{
+  return this->getValue(this->voxel);
+}
+
+// Returns the value of \a voxel, as for getValue().
+uint32_t
+CvrVoxelRay::getValue(const SbVec3s & voxel) const
+{
+  // FIXME: As SIMVoleon does not support 16bits voxels 100% yet,
+  // we'll have to scale down the value to 8bit if needed before
+  // passing on the data. (20100806 handegar)
+  const size_t idx =
+    ((size_t)voxel[2] * this->dimensions[1] + voxel[1]) * this->dimensions[0] + voxel[0];
+  if (this->bytesprvoxel == 1) { return this->voxels[idx]; }
+  return ((const uint16_t *)this->voxels)[idx] >> 8;
+}
+
+// Returns the last voxel along the ray.
+SbVec3s
+CvrVoxelRay::getLastVoxel(void) const
+{
+  SbVec3s last;
+  for (int a = 0; a < 3; a++) {
+    const int i = (int)floor(this->p0[a] + this->d[a] * this->tend);
+    last[a] = (short)SbClamp(i, 0, this->dimensions[a] - 1);
+  }
+  return last;
+}
+
+// Returns the position where the ray leaves the volume (or ends).
+SbVec3f
+CvrVoxelRay::getEndPosition(void) const
+{
+  return this->from + this->rayvec * this->tend;
+}
+
+// *************************************************************************
+
+CvrBrickRanges::CvrBrickRanges(void)
+{
+  this->voxels = NULL;
+  this->bytesprvoxel = 0;
+  this->dimensions.setValue(0, 0, 0);
+  this->volumeid = 0;
+  this->ranges = NULL;
+}
+
+CvrBrickRanges::~CvrBrickRanges()
+{
+  delete[] this->ranges;
+}
+
+// Sets the voxel block to find ranges for. The ranges found so far
+// are kept if this is the same volume as before. This must not be
+// called while other threads are using the instance.
+void
+CvrBrickRanges::setVolume(const uint8_t * voxels, const unsigned int bytesprvoxel,
+                          const SbVec3s & dimensions, const uint32_t volumeid)
+{
+  if ((this->voxels == voxels) && (this->bytesprvoxel == bytesprvoxel) &&
+      (this->dimensions == dimensions) && (this->volumeid == volumeid)) {
+    return;
+  }
+
+  this->voxels = voxels;
+  this->bytesprvoxel = bytesprvoxel;
+  this->dimensions = dimensions;
+  this->volumeid = volumeid;
+
+  unsigned int total = 1;
+  for (int a = 0; a < 3; a++) {
+    this->nrbricks[a] = (dimensions[a] + BRICKSIZE - 1) / BRICKSIZE;
+    total *= this->nrbricks[a];
+  }
+
+  delete[] this->ranges;
+  this->ranges = new uint16_t[total];
+  for (unsigned int i = 0; i < total; i++) { this->ranges[i] = CVR_RANGE_UNKNOWN; }
+}
+
+// Sets \a opaquecount[v] to the number of entries below \a v in the
+// 256 first entries of \a clut which are not fully transparent.
+void
+CvrBrickRanges::countOpaque(const CvrCLUT * clut, unsigned int opaquecount[257])
+{
+  opaquecount[0] = 0;
+  for (unsigned int i = 0; i < 256; i++) {
+    uint8_t rgba[4];
+    clut->lookupRGBA(i, rgba);
+    opaquecount[i + 1] = opaquecount[i] + ((rgba[3] != 0) ? 1 : 0);
+  }
+}
+
+// Returns TRUE if all values in the brick containing \a voxel are
+// fully transparent, according to the counts from countOpaque().
+SbBool
+CvrBrickRanges::isTransparent(const SbVec3s & voxel, const unsigned int opaquecount[257])
+{
+  assert(this->ranges != NULL);
+
+  const unsigned int bx = voxel[0] / BRICKSIZE;
+  const unsigned int by = voxel[1] / BRICKSIZE;
+  const unsigned int bz = voxel[2] / BRICKSIZE;
+  const unsigned int idx = (bz * this->nrbricks[1] + by) * this->nrbricks[0] + bx;
+
+  // Threads finding the same brick at the same time will store the
+  // same value, in a single write.
+  uint16_t range = this->ranges[idx];
+  if (range == CVR_RANGE_UNKNOWN) {
+    const size_t dimx = this->dimensions[0];
+    const size_t dimxy = dimx * this->dimensions[1];
+    const int xend = SbMin((int)this->dimensions[0], (int)(bx + 1) * BRICKSIZE);
+    const int yend = SbMin((int)this->dimensions[1], (int)(by + 1) * BRICKSIZE);
+    const int zend = SbMin((int)this->dimensions[2], (int)(bz + 1) * BRICKSIZE);
+
+    uint8_t minval = 255, maxval = 0;
+    for (int z = bz * BRICKSIZE; z < zend; z++) {
+      for (int y = by * BRICKSIZE; y < yend; y++) {
+        const size_t rowstart = z * dimxy + y * dimx;
+        for (int x = bx * BRICKSIZE; x < xend; x++) {
+          // Scaled down to 8 bits, as for the CLUT lookups.
+          const uint8_t v = (this->bytesprvoxel == 1) ?
+            this->voxels[rowstart + x] :
+            (uint8_t)(((const uint16_t *)this->voxels)[rowstart + x] >> 8);
+          if (v < minval) { minval = v; }
+          if (v > maxval) { maxval = v; }
+        }
+      }
+    }
+
+    range = (uint16_t)((maxval << 8) | minval);
+    this->ranges[idx] = range;
+  }
+
+  const unsigned int minval = range & 0xff;
+  const unsigned int maxval = range >> 8;
+  return (opaquecount[maxval + 1] - opaquecount[minval]) == 0;
+}
+
+// *************************************************************************
+
+#undef CVR_RANGE_UNKNOWN
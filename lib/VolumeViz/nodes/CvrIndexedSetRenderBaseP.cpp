@@ -128,6 +128,7 @@ CvrIndexedSetRenderBaseP::GLRender(SoGLRenderAction * action,
     this->cube->setPalette(c);
     this->clut = c;
   }
+  c->unref();
 
   // Fetch texture quality
   float texturequality = SoTextureQualityElement::get(state);
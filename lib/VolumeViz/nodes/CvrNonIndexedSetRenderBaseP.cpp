@@ -130,6 +130,7 @@ CvrNonIndexedSetRenderBaseP::GLRender(SoGLRenderAction * action,
     this->cube->setPalette(c);
     this->clut = c;
   }
+  c->unref();
 
   // Fetch texture quality
   float texturequality = SoTextureQualityElement::get(state);
@@ -0,0 +1,790 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoMultiSlice VolumeViz/nodes/SoMultiSlice.h
+  \brief Render a set of slices through the volume in a single pass.
+
+  Insert a node of this type after an SoVolumeData node in the scene
+  graph to render any number of axis-aligned and oblique slices from
+  the volume data set.
+
+  This gives the same result as a set of SoOrthoSlice and
+  SoObliqueSlice nodes, but is considerably faster when there are
+  many slices, as the OpenGL state, the locking of the volume and the
+  color lookup table are only set up once for all of them. The
+  slices are also rendered in back-to-front order against each
+  other, so partly transparent slices blend correctly.
+
+  Here is a simple example, in the form of an iv-file:
+
+  \verbatim
+  #Inventor V2.1 ascii
+
+  SoVolumeData { fileName "ENGINE.VOL" }
+  SoTransferFunction { predefColorMap TEMPERATURE }
+
+  SoMultiSlice {
+    sliceNumber [ 0, 10, 20, 30 ]
+    axis [ Z, Z, Z, X ]
+    plane [ 1 1 0  0 ]
+  }
+  \endverbatim
+
+  With 3D texture support, the slices are cut through the same 3D
+  texture bricks as used by SoVolumeRender. Otherwise, the ortho
+  slices are rendered from 2D texture pages, while the oblique
+  slices are resampled on the CPU, as for SoObliqueSlice.
+
+  Note that slices intersecting each other are only sorted by the
+  bricks they are split into, so where transparent slices cross, the
+  blending may not be exact.
+
+  \sa SoOrthoSlice, SoObliqueSlice
+  \since SIM Voleon 2.1
+*/
+
+// *************************************************************************
+
+#include <Inventor/C/glue/gl.h>
+#include <Inventor/C/tidbits.h>
+#include <Inventor/SbBox3s.h>
+#include <Inventor/SbLinear.h>
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/elements/SoLazyElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/errors/SoDebugError.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
+
+#include <VolumeViz/nodes/SoMultiSlice.h>
+
+#include <VolumeViz/details/SoObliqueSliceDetail.h>
+#include <VolumeViz/details/SoOrthoSliceDetail.h>
+#include <VolumeViz/elements/CvrGLInterpolationElement.h>
+#include <VolumeViz/elements/CvrPageSizeElement.h>
+#include <VolumeViz/elements/CvrVoxelBlockElement.h>
+#include <VolumeViz/elements/SoTransferFunctionElement.h>
+#include <VolumeViz/nodes/SoVolumeRendering.h>
+#include <VolumeViz/render/2D/Cvr2DTexPage.h>
+#include <VolumeViz/render/3D/CvrCubeHandler.h>
+#include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrObliqueSampler.h>
+#include <VolumeViz/misc/CvrUtil.h>
+#include <VolumeViz/misc/CvrVoxelChunk.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
+
+// *************************************************************************
+
+SO_NODE_SOURCE(SoMultiSlice);
+
+// *************************************************************************
+
+class SoMultiSliceP {
+public:
+  SoMultiSliceP(SoMultiSlice * master)
+  {
+    this->master = master;
+    this->cubehandler = NULL;
+  }
+
+  ~SoMultiSliceP()
+  {
+    delete this->cubehandler;
+    for (int i = 0; i < this->cachedpages.getLength(); i++) {
+      delete this->cachedpages[i].page;
+    }
+    for (int i = 0; i < this->cachedsamples.getLength(); i++) {
+      delete[] this->cachedsamples[i].colors;
+    }
+  }
+
+  int getAxis(const int idx) const;
+  SbBool getSlicePlane(const CvrVoxelBlockElement * vbelem, const int idx,
+                       SbPlane & plane) const;
+  SbBool use3DTexturing(SoGLRenderAction * action) const;
+  void render3D(SoGLRenderAction * action);
+  void render2D(SoGLRenderAction * action);
+  Cvr2DTexPage * getPage(const SoGLRenderAction * action, const int axis, const int slice);
+  int getSamples(const SoGLRenderAction * action, const CvrObliqueSampler & sampler,
+                 const SbPlane & plane, const CvrCLUT * clut);
+
+  CvrCubeHandler * cubehandler;
+
+  // Pages for the ortho slices, when rendering without 3D
+  // textures. Only the pages used in the last frame are kept.
+  struct CachedPage {
+    Cvr2DTexPage * page;
+    int axis, slice;
+    uint32_t volumedataid;
+    SbBool used;
+  };
+  SbList<struct CachedPage> cachedpages;
+
+  // The oblique slices resampled on the CPU, when rendering without
+  // 3D textures. Only the slices used in the last frame are kept.
+  struct CachedSamples {
+    SbPlane plane;
+    uint32_t volumedataid;
+    uint32_t clutchecksum;
+    int alphause, interpolation;
+    SbVec3f origo, horizspan, verticalspan;
+    SbVec2s size;
+    uint8_t * colors; // NULL if the plane misses the volume
+    SbBool used;
+  };
+  SbList<struct CachedSamples> cachedsamples;
+
+private:
+  SoMultiSlice * master;
+};
+
+#define PRIVATE(p) (p->pimpl)
+#define PUBLIC(p) (p->master)
+
+// *************************************************************************
+
+/*!
+  \var SoMFUInt32 SoMultiSlice::sliceNumber
+
+  The positions of the axis-aligned slices, one value per slice.
+
+  Default is to have no axis-aligned slices.
+*/
+
+/*!
+  \var SoMFEnum SoMultiSlice::axis
+
+  The axis each of the slices in SoMultiSlice::sliceNumber is
+  perpendicular to. If there are fewer values than slices, the last
+  value is used for the rest.
+
+  Default value is SoMultiSlice::Z.
+*/
+
+/*!
+  \var SoMFPlane SoMultiSlice::plane
+
+  Oblique slices, given as planes in the same coordinate system as
+  the volume box, like for SoObliqueSlice::plane.
+
+  Default is to have no oblique slices.
+*/
+
+/*!
+  \var SoSFEnum SoMultiSlice::interpolation
+
+  Interpolation used when rendering the slices.
+
+  Default value is SoMultiSlice::LINEAR.
+*/
+
+/*!
+  \var SoSFEnum SoMultiSlice::alphaUse
+
+  How to handle the alpha values of the slices, see
+  SoOrthoSlice::alphaUse.
+
+  Default value is SoMultiSlice::ALPHA_BINARY.
+*/
+
+// *************************************************************************
+
+SoMultiSlice::SoMultiSlice(void)
+{
+  SO_NODE_CONSTRUCTOR(SoMultiSlice);
+
+  PRIVATE(this) = new SoMultiSliceP(this);
+
+  SO_NODE_DEFINE_ENUM_VALUE(Axis, X);
+  SO_NODE_DEFINE_ENUM_VALUE(Axis, Y);
+  SO_NODE_DEFINE_ENUM_VALUE(Axis, Z);
+  SO_NODE_SET_MF_ENUM_TYPE(axis, Axis);
+
+  SO_NODE_DEFINE_ENUM_VALUE(Interpolation, NEAREST);
+  SO_NODE_DEFINE_ENUM_VALUE(Interpolation, LINEAR);
+  SO_NODE_SET_SF_ENUM_TYPE(interpolation, Interpolation);
+
+  SO_NODE_DEFINE_ENUM_VALUE(AlphaUse, ALPHA_AS_IS);
+  SO_NODE_DEFINE_ENUM_VALUE(AlphaUse, ALPHA_OPAQUE);
+  SO_NODE_DEFINE_ENUM_VALUE(AlphaUse, ALPHA_BINARY);
+  SO_NODE_SET_SF_ENUM_TYPE(alphaUse, AlphaUse);
+
+  SO_NODE_ADD_FIELD(sliceNumber, (0));
+  SO_NODE_ADD_FIELD(axis, (Z));
+  SO_NODE_ADD_FIELD(plane, (SbPlane(SbVec3f(0, 0, 1), 0)));
+  SO_NODE_ADD_FIELD(interpolation, (LINEAR));
+  SO_NODE_ADD_FIELD(alphaUse, (ALPHA_BINARY));
+
+  this->sliceNumber.setNum(0);
+  this->sliceNumber.setDefault(TRUE);
+  this->plane.setNum(0);
+  this->plane.setDefault(TRUE);
+}
+
+SoMultiSlice::~SoMultiSlice()
+{
+  delete PRIVATE(this);
+}
+
+// Doc from parent class.
+void
+SoMultiSlice::initClass(void)
+{
+  SO_NODE_INIT_CLASS(SoMultiSlice, SoShape, "SoShape");
+
+  SO_ENABLE(SoGLRenderAction, SoTransferFunctionElement);
+  SO_ENABLE(SoGLRenderAction, SoModelMatrixElement);
+  SO_ENABLE(SoGLRenderAction, SoLazyElement);
+  SO_ENABLE(SoGLRenderAction, CvrGLInterpolationElement);
+
+  SO_ENABLE(SoRayPickAction, SoTransferFunctionElement);
+  SO_ENABLE(SoRayPickAction, SoModelMatrixElement);
+}
+
+// *************************************************************************
+
+int
+SoMultiSliceP::getAxis(const int idx) const
+{
+  const int num = PUBLIC(this)->axis.getNum();
+  if (num == 0) { return SoMultiSlice::Z; }
+  return PUBLIC(this)->axis[SbMin(idx, num - 1)];
+}
+
+// Sets "plane" to the plane of slice "idx", in object space. The
+// ortho slices come first, then the oblique slices. Returns FALSE
+// for ortho slices outside the volume.
+SbBool
+SoMultiSliceP::getSlicePlane(const CvrVoxelBlockElement * vbelem, const int idx,
+                             SbPlane & plane) const
+{
+  const int numortho = PUBLIC(this)->sliceNumber.getNum();
+  if (idx >= numortho) {
+    plane = PUBLIC(this)->plane[idx - numortho];
+    return TRUE;
+  }
+
+  const int axis = this->getAxis(idx);
+  const unsigned int slice = PUBLIC(this)->sliceNumber[idx];
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+  if (slice >= (unsigned int)dims[axis]) { return FALSE; }
+
+  SbVec3f spacemin, spacemax;
+  vbelem->getUnitDimensionsBox().getBounds(spacemin, spacemax);
+  const float depthprslice = (spacemax[axis] - spacemin[axis]) / dims[axis];
+
+  SbVec3f normal(0.0f, 0.0f, 0.0f);
+  normal[axis] = 1.0f;
+  plane = SbPlane(normal, spacemin[axis] + (slice + 0.5f) * depthprslice);
+  return TRUE;
+}
+
+// Same check as for SoObliqueSlice: 3D textures are used unless they
+// are unavailable or have been found to be slow in this context.
+SbBool
+SoMultiSliceP::use3DTexturing(SoGLRenderAction * action) const
+{
+  if (CvrUtil::force2DTextureRendering()) { return FALSE; }
+
+  const uint32_t ctxid = action->getCacheContext();
+  const cc_glglue * glue = cc_glglue_instance(ctxid);
+  if (!cc_glglue_has_3d_textures(glue)) { return FALSE; }
+
+  return (SoVolumeRendering::get3DTextureAcceleration(ctxid) ==
+          SoVolumeRendering::NO) ? FALSE : TRUE;
+}
+
+void
+SoMultiSlice::GLRender(SoGLRenderAction * action)
+{
+  // One lock for all the slices.
+  CvrVolumeRenderLock lock(action->getState());
+
+  if (!this->shouldGLRender(action)) return;
+
+  // Render at the end, in case the volume is partly (or fully)
+  // transparent.
+  if (!action->isRenderingDelayedPaths()) {
+    action->addDelayedPath(action->getCurPath()->copy());
+    return;
+  }
+
+  SoState * state = action->getState();
+
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  if (vbelem == NULL) {
+    static SbBool first = TRUE;
+    if (first) {
+      SoDebugError::post("SoMultiSlice::GLRender",
+                         "no SoVolumeData in scene graph before "
+                         "SoMultiSlice node -- rendering aborted");
+      first = FALSE;
+    }
+    return;
+  }
+
+  const SoTransferFunctionElement * tfelement =
+    SoTransferFunctionElement::getInstance(state);
+  if (tfelement->getTransferFunction() == NULL) {
+    static SbBool first = TRUE;
+    if (first) {
+      SoDebugError::post("SoMultiSlice::GLRender",
+                         "no SoTransferFunction in scene graph before "
+                         "SoMultiSlice node -- rendering aborted");
+      first = FALSE;
+    }
+    return;
+  }
+
+  state->push();
+
+  GLenum interp;
+  switch (this->interpolation.getValue()) {
+  case NEAREST: interp = GL_NEAREST; break;
+  case LINEAR: interp = GL_LINEAR; break;
+  default: assert(FALSE && "invalid value in interpolation field"); break;
+  }
+  CvrGLInterpolationElement::set(state, interp);
+
+  if (PRIVATE(this)->use3DTexturing(action)) {
+    PRIVATE(this)->render3D(action);
+  }
+  else {
+    PRIVATE(this)->render2D(action);
+  }
+
+  state->pop();
+}
+
+// Renders all slices through the 3D texture bricks.
+void
+SoMultiSliceP::render3D(SoGLRenderAction * action)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+
+  SbMatrix volumetransform;
+  CvrUtil::getTransformFromVolumeBoxDimensions(vbelem, volumetransform);
+  SoModelMatrixElement::mult(state, PUBLIC(this), volumetransform);
+
+  // All slices are set up as planes in the local coordinate system of
+  // the 3D texture cube, which has one unit per voxel and origo in the
+  // center of the volume.
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+  SbList<SbPlane> planes;
+
+  for (int i = 0; i < PUBLIC(this)->sliceNumber.getNum(); i++) {
+    const int axis = this->getAxis(i);
+    const unsigned int slice = PUBLIC(this)->sliceNumber[i];
+    if (slice >= (unsigned int)dims[axis]) { continue; }
+
+    SbVec3f normal(0.0f, 0.0f, 0.0f);
+    normal[axis] = 1.0f;
+    planes.append(SbPlane(normal, -dims[axis] / 2.0f + slice + 0.5f));
+  }
+
+  const SbMatrix tolocal = volumetransform.inverse();
+  for (int i = 0; i < PUBLIC(this)->plane.getNum(); i++) {
+    SbPlane p = PUBLIC(this)->plane[i];
+    p.transform(tolocal);
+    planes.append(p);
+  }
+
+  if (planes.getLength() == 0) { return; }
+
+  if (!this->cubehandler) { this->cubehandler = new CvrCubeHandler(); }
+
+  this->cubehandler->renderSlices(action,
+                                  (CvrCLUT::AlphaUse)PUBLIC(this)->alphaUse.getValue(),
+                                  planes.getArrayPtr(), planes.getLength());
+}
+
+// Renders the ortho slices from 2D texture pages, and the oblique
+// slices resampled on the CPU, back-to-front.
+void
+SoMultiSliceP::render2D(SoGLRenderAction * action)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+
+  // Work in a 1x1x1 volume in unit coordinates, like SoOrthoSlice.
+  const SbBox3f & localbox = vbelem->getUnitDimensionsBox();
+  SbMatrix m;
+  m.setTransform((localbox.getMax() - localbox.getMin()) / 2.0f + localbox.getMin(),
+                 SbRotation::identity(),
+                 localbox.getMax() - localbox.getMin());
+  SoModelMatrixElement::mult(state, PUBLIC(this), m);
+
+  // The resampled oblique slices are set up in object space.
+  const SbMatrix tounit = m.inverse();
+
+  SbViewVolume viewvolumeinv = SoViewVolumeElement::get(state);
+  viewvolumeinv.transform(SoModelMatrixElement::get(state).inverse());
+  const SbPlane invcamplane = viewvolumeinv.getPlane(0.0f);
+  const SbBool orthographic =
+    (viewvolumeinv.getProjectionType() == SbViewVolume::ORTHOGRAPHIC);
+  const SbVec3f eye = viewvolumeinv.getProjectionPoint();
+
+  const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
+  CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, (CvrCLUT::AlphaUse)PUBLIC(this)->alphaUse.getValue());
+
+  const CvrObliqueSampler sampler(vbelem->getVoxels(), vbelem->getBytesPrVoxel(),
+                                  vbelem->getVoxelCubeDimensions(), localbox);
+
+  for (int i = 0; i < this->cachedpages.getLength(); i++) {
+    this->cachedpages[i].used = FALSE;
+  }
+  for (int i = 0; i < this->cachedsamples.getLength(); i++) {
+    this->cachedsamples[i].used = FALSE;
+  }
+
+  // Sort the slices back-to-front, by the distance to their
+  // centers. For oblique slices, the index of their samples is kept.
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+  const int numortho = PUBLIC(this)->sliceNumber.getNum();
+  const int numslices = numortho + PUBLIC(this)->plane.getNum();
+  SbList<int> order, samples;
+  SbList<float> distances;
+  for (int i = 0; i < numslices; i++) {
+    SbVec3f center(0.0f, 0.0f, 0.0f);
+    int sampleidx = -1;
+    if (i < numortho) {
+      const int axis = this->getAxis(i);
+      const unsigned int slice = PUBLIC(this)->sliceNumber[i];
+      if (slice >= (unsigned int)dims[axis]) { continue; }
+      center[axis] = -0.5f + (slice + 0.5f) / dims[axis];
+    }
+    else {
+      sampleidx = this->getSamples(action, sampler,
+                                   PUBLIC(this)->plane[i - numortho], c);
+      const struct CachedSamples & cs = this->cachedsamples[sampleidx];
+      if (cs.colors == NULL) { continue; }
+      tounit.multVecMatrix(cs.origo + (cs.horizspan + cs.verticalspan) * 0.5f, center);
+    }
+
+    const float dist = orthographic ?
+      -invcamplane.getDistance(center) : (eye - center).length();
+
+    int pos = order.getLength();
+    while ((pos > 0) && (distances[pos - 1] < dist)) { pos--; }
+    order.insert(i, pos);
+    samples.insert(sampleidx, pos);
+    distances.insert(dist, pos);
+  }
+
+  // This must be done, as we want to control stuff in the GL state
+  // machine. Without it, state changes could trigger outside our
+  // control.
+  SoGLLazyElement::getInstance(state)->send(state, SoLazyElement::ALL_MASK);
+
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+  glDisable(GL_LIGHTING);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  for (int i = 0; i < order.getLength(); i++) {
+    if (samples[i] != -1) {
+      const struct CachedSamples & cs = this->cachedsamples[samples[i]];
+      glDisable(GL_TEXTURE_2D);
+      glPushMatrix();
+      glMultMatrixf((float *)tounit);
+      CvrObliqueSampler::renderRGBA(cs.origo, cs.horizspan, cs.verticalspan,
+                                    cs.size, cs.colors);
+      glPopMatrix();
+      continue;
+    }
+
+    const int axis = this->getAxis(order[i]);
+    const int slicenr = PUBLIC(this)->sliceNumber[order[i]];
+
+    // This is done to support client code depending on an old bug:
+    // data along the Y axis used to be rendered flipped.
+    int pageslice = slicenr;
+    if (CvrUtil::useFlippedYAxis() && (axis == SoMultiSlice::Y)) {
+      pageslice = (dims[SoMultiSlice::Y] - 1) - pageslice;
+    }
+
+    Cvr2DTexPage * texpage = this->getPage(action, axis, pageslice);
+
+    const CvrCLUT * pageclut = texpage->getPalette();
+    if ((pageclut == NULL) || (*pageclut != *c)) { texpage->setPalette(c); }
+
+    SbVec3f origo, horizspan, verticalspan;
+    vbelem->getPageGeometry(axis, slicenr, origo, horizspan, verticalspan);
+    glEnable(GL_TEXTURE_2D);
+    texpage->render(action, origo, horizspan, verticalspan);
+  }
+
+  glPopAttrib();
+
+  c->unref();
+
+  // Throw out the pages and samples of slices which have been moved
+  // or removed.
+  for (int i = this->cachedpages.getLength() - 1; i >= 0; i--) {
+    if (!this->cachedpages[i].used) {
+      delete this->cachedpages[i].page;
+      this->cachedpages.remove(i);
+    }
+  }
+  for (int i = this->cachedsamples.getLength() - 1; i >= 0; i--) {
+    if (!this->cachedsamples[i].used) {
+      delete[] this->cachedsamples[i].colors;
+      this->cachedsamples.remove(i);
+    }
+  }
+}
+
+// Returns the index in cachedsamples of the oblique slice along
+// "plane" resampled on the CPU, resampling it if it is not cached.
+int
+SoMultiSliceP::getSamples(const SoGLRenderAction * action,
+                          const CvrObliqueSampler & sampler,
+                          const SbPlane & plane, const CvrCLUT * clut)
+{
+  const CvrVoxelBlockElement * vbelem =
+    CvrVoxelBlockElement::getInstance(action->getState());
+  const int alphause = PUBLIC(this)->alphaUse.getValue();
+  const int interpolation = PUBLIC(this)->interpolation.getValue();
+
+  for (int i = 0; i < this->cachedsamples.getLength(); i++) {
+    struct CachedSamples & cs = this->cachedsamples[i];
+    if ((cs.plane.getNormal() == plane.getNormal()) &&
+        (cs.plane.getDistanceFromOrigin() == plane.getDistanceFromOrigin()) &&
+        (cs.volumedataid == vbelem->getNodeId()) &&
+        (cs.clutchecksum == clut->getChecksum()) &&
+        (cs.alphause == alphause) && (cs.interpolation == interpolation) &&
+        !cs.used) { // (the same plane can be given twice)
+      cs.used = TRUE;
+      return i;
+    }
+  }
+
+  struct CachedSamples cs;
+  cs.plane = plane;
+  cs.volumedataid = vbelem->getNodeId();
+  cs.clutchecksum = clut->getChecksum();
+  cs.alphause = alphause;
+  cs.interpolation = interpolation;
+  cs.colors = NULL;
+  cs.used = TRUE;
+
+  if (sampler.getSliceRectangle(plane, cs.origo, cs.horizspan, cs.verticalspan)) {
+    // Keep the number of vertices per frame down, as for
+    // SoObliqueSlice.
+    const SbVec2s native = sampler.getNativeResolution(cs.horizspan, cs.verticalspan);
+    cs.size = SbVec2s(SbMax(SbMin(native[0], (short)512), (short)2),
+                      SbMax(SbMin(native[1], (short)512), (short)2));
+    cs.colors = new uint8_t[cs.size[0] * cs.size[1] * 4];
+    sampler.resampleRGBA(cs.origo, cs.horizspan, cs.verticalspan, cs.size,
+                         (interpolation == SoMultiSlice::LINEAR) ? TRUE : FALSE,
+                         clut, cs.colors);
+  }
+
+  this->cachedsamples.append(cs);
+  return this->cachedsamples.getLength() - 1;
+}
+
+Cvr2DTexPage *
+SoMultiSliceP::getPage(const SoGLRenderAction * action,
+                       const int axis, const int slice)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+
+  for (int i = 0; i < this->cachedpages.getLength(); i++) {
+    struct CachedPage & cp = this->cachedpages[i];
+    if ((cp.axis == axis) && (cp.slice == slice) &&
+        (cp.volumedataid == vbelem->getNodeId())) {
+      cp.used = TRUE;
+      return cp.page;
+    }
+  }
+
+  const SbVec3s & pagesize = CvrPageSizeElement::get(state);
+  // Pagesize according to axis: X => [Z, Y], Y => [X, Z], Z => [X, Y].
+  const SbVec2s subpagesize =
+    SbVec2s(pagesize[(axis == 0) ? 2 : 0], pagesize[(axis == 1) ? 2 : 1]);
+
+  struct CachedPage cp;
+  cp.page = new Cvr2DTexPage(action, axis, slice, subpagesize);
+  cp.axis = axis;
+  cp.slice = slice;
+  cp.volumedataid = vbelem->getNodeId();
+  cp.used = TRUE;
+  this->cachedpages.append(cp);
+  return cp.page;
+}
+
+// *************************************************************************
+
+void
+SoMultiSlice::rayPick(SoRayPickAction * action)
+{
+  if (!this->shouldRayPick(action)) return;
+
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  if (vbelem == NULL) { return; }
+
+  this->computeObjectSpaceRay(action);
+  const SbLine & ray = action->getLine();
+
+  const SbVec3s & voxcubedims = vbelem->getVoxelCubeDimensions();
+  const SbBox3s voxcubebounds(SbVec3s(0, 0, 0), voxcubedims - SbVec3s(1, 1, 1));
+
+  const int numortho = this->sliceNumber.getNum();
+  const int numslices = numortho + this->plane.getNum();
+
+  for (int i = 0; i < numslices; i++) {
+    SbPlane sliceplane;
+    if (!PRIVATE(this)->getSlicePlane(vbelem, i, sliceplane)) { continue; }
+
+    SbVec3f intersection;
+    if (!sliceplane.intersect(ray, intersection) || // returns FALSE if parallel
+        !action->isBetweenPlanes(intersection)) { continue; }
+
+    const SbVec3s ijk = vbelem->objectCoordsToIJK(intersection);
+    if (!voxcubebounds.intersect(ijk)) { continue; }
+
+    SoPickedPoint * pp = action->addIntersection(intersection);
+    // if NULL, something else is obstructing the view to the volume,
+    // and the app programmer only want the nearest
+    if (pp == NULL) { continue; }
+    pp->setObjectNormal(sliceplane.getNormal());
+
+    if (i < numortho) {
+      SoOrthoSliceDetail * detail = new SoOrthoSliceDetail;
+      detail->objectcoords = intersection;
+      detail->ijkcoords = ijk;
+      detail->voxelvalue = vbelem->getVoxelValue(ijk);
+      pp->setDetail(detail, this);
+    }
+    else {
+      SoObliqueSliceDetail * detail = new SoObliqueSliceDetail;
+      detail->objectcoords = intersection;
+      detail->ijkcoords = ijk;
+      detail->voxelvalue = vbelem->getVoxelValue(ijk);
+      pp->setDetail(detail, this);
+    }
+  }
+}
+
+void
+SoMultiSlice::generatePrimitives(SoAction * action)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  if (vbelem == NULL) { return; }
+
+  const CvrObliqueSampler sampler(vbelem->getVoxels(), vbelem->getBytesPrVoxel(),
+                                  vbelem->getVoxelCubeDimensions(),
+                                  vbelem->getUnitDimensionsBox());
+
+  const int numslices = this->sliceNumber.getNum() + this->plane.getNum();
+
+  SoPrimitiveVertex vertex;
+  this->beginShape(action, SoShape::QUADS);
+  for (int i = 0; i < numslices; i++) {
+    SbPlane sliceplane;
+    if (!PRIVATE(this)->getSlicePlane(vbelem, i, sliceplane)) { continue; }
+
+    SbVec3f origo, horizspan, verticalspan;
+    if (!sampler.getSliceRectangle(sliceplane, origo, horizspan, verticalspan)) {
+      continue;
+    }
+
+    // Emit the quad counterclockwise as seen along the normal.
+    const SbVec3f & normal = sliceplane.getNormal();
+    const SbBool ccw = horizspan.cross(verticalspan).dot(normal) > 0.0f;
+    const SbVec3f corners[4] = {
+      origo, origo + horizspan, origo + horizspan + verticalspan, origo + verticalspan
+    };
+    const SbVec4f texcoords[4] = {
+      SbVec4f(0, 0, 0, 1), SbVec4f(1, 0, 0, 1), SbVec4f(1, 1, 0, 1), SbVec4f(0, 1, 0, 1)
+    };
+
+    vertex.setNormal(normal);
+    for (int j = 0; j < 4; j++) {
+      const int k = ccw ? j : (3 - j);
+      vertex.setPoint(corners[k]);
+      vertex.setTextureCoords(texcoords[k]);
+      this->shapeVertex(&vertex);
+    }
+  }
+  this->endShape();
+}
+
+// doc in super
+void
+SoMultiSlice::computeBBox(SoAction * action, SbBox3f & box, SbVec3f & center)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  if (vbelem == NULL) return;
+
+  // Oblique slices can cover any part of the volume, so the full
+  // volume box is used when there are any of them.
+  const SbBox3f & vdbox = vbelem->getUnitDimensionsBox();
+  if (this->plane.getNum() > 0) {
+    box.extendBy(vdbox);
+    center = vdbox.getCenter();
+    return;
+  }
+
+  SbVec3f bmin, bmax;
+  vdbox.getBounds(bmin, bmax);
+  const SbVec3s & dimensions = vbelem->getVoxelCubeDimensions();
+
+  SbBox3f slicesbox;
+  for (int i = 0; i < this->sliceNumber.getNum(); i++) {
+    const int axis = PRIVATE(this)->getAxis(i);
+    SbVec3f smin = bmin, smax = bmax;
+    smin[axis] = smax[axis] = bmin[axis] +
+      (bmax[axis] - bmin[axis]) / dimensions[axis] * (this->sliceNumber[i] + 0.5f);
+    slicesbox.extendBy(SbBox3f(smin, smax));
+  }
+
+  if (slicesbox.isEmpty()) { return; }
+  box.extendBy(slicesbox);
+  center = slicesbox.getCenter();
+}
+
+// *************************************************************************
@@ -66,12 +66,14 @@
   }
   \endverbatim
 
-  Please note that SoObliqueSlice will not work with older OpenGL
-  drivers as they usually lack 3D-texture support. OpenGL drivers of
-  version 1.2 and onwards supports 3D-texturing, as does older OpenGL
-  drivers with the \c GL_EXT_texture3D extension. If none of these are
-  available, a warning message will be printed using Coin's
-  SoDebugError::postWarning().
+  SoObliqueSlice is rendered with 3D textures when possible. OpenGL
+  drivers of version 1.2 and onwards supports 3D-texturing, as does
+  older OpenGL drivers with the \c GL_EXT_texture3D extension. If 3D
+  textures are not available, or have been found to not be
+  accelerated (see SoVolumeRendering::get3DTextureAcceleration()), the
+  slice is instead resampled on the CPU, like with
+  SoVolumeData::resampleObliqueSlice(), and rendered as plain colored
+  geometry.
 
   \sa SoVolumeRender, SoOrthoSlice
   \sa SoVolumeTriangleStripSet, SoVolumeIndexedTriangleStripSet, 
@@ -101,9 +103,13 @@
 #include <VolumeViz/elements/CvrStorageHintElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
+#include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <VolumeViz/render/3D/CvrCubeHandler.h>
+#include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrObliqueSampler.h>
 #include <VolumeViz/misc/CvrUtil.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrVoxelChunk.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
 
 // *************************************************************************
 
@@ -117,10 +123,32 @@ public:
   {
     this->master = master;
     this->cubehandler = NULL;
+    this->samplecolors = NULL;
+    this->samplesize = SbVec2s(0, 0);
+    this->samplenodeid = 0;
   }
 
+  ~SoObliqueSliceP()
+  {
+    delete this->cubehandler;
+    delete[] this->samplecolors;
+  }
+
+  SbBool use3DTexturing(SoGLRenderAction * action) const;
+  void renderResampled(SoGLRenderAction * action);
+
   CvrCubeHandler * cubehandler;
 
+  // The slice as last resampled on the CPU, in RGBA.
+  uint8_t * samplecolors;
+  SbVec2s samplesize;
+  SbVec3f sampleorigo, samplehorizspan, sampleverticalspan;
+  SbPlane sampleplane;
+  uint32_t samplenodeid;
+  uint32_t sampleclutchecksum;
+  int samplealphause;
+  int sampleinterpolation;
+
 private:
   SoObliqueSlice * master;
 };
@@ -155,7 +183,6 @@ SoObliqueSlice::SoObliqueSlice(void)
 
 SoObliqueSlice::~SoObliqueSlice()
 {
-  delete PRIVATE(this)->cubehandler;
   delete PRIVATE(this);
 }
 
@@ -251,9 +278,8 @@ void
 SoObliqueSlice::GLRender(SoGLRenderAction * action)
 {
   // This will automatically lock and unlock a mutex stopping multiple
-  // render threads for SIM Voleon nodes. FIXME: should really make
-  // code re-entrant / threadsafe. 20041112 mortene.
-  CvrGlobalRenderLock lock;
+  // render threads from rendering the same volume at the same time.
+  CvrVolumeRenderLock lock(action->getState());
 
   // FIXME: need to make sure we're not cached in a renderlist
   if (!this->shouldGLRender(action)) return;
@@ -315,26 +341,18 @@ SoObliqueSlice::GLRender(SoGLRenderAction * action)
   // control.
   state->push();
 
+  // Without (fast) 3D textures, resample the slice on the CPU
+  // instead.
+  if (!PRIVATE(this)->use3DTexturing(action)) {
+    PRIVATE(this)->renderResampled(action);
+    state->pop();
+    return;
+  }
+
   SbMatrix volumetransform;
   CvrUtil::getTransformFromVolumeBoxDimensions(vbelem, volumetransform);
   SoModelMatrixElement::mult(state, this, volumetransform);
 
-  const SbVec3s & voxcubedims = vbelem->getVoxelCubeDimensions();
-
-  const cc_glglue * glue = cc_glglue_instance(action->getCacheContext());
-  if (!cc_glglue_has_3d_textures(glue)) {
-    static SbBool flag = FALSE;
-    if (!flag) {
-      SoDebugError::postWarning("SoObliqueSlice::GLRender", 
-                                "Your OpenGL driver does not support 3D "
-                                "textures, which is needed for rendering the "
-                                "SoObliqueSlice.");
-      flag = TRUE;
-    }
-    goto done;
-  }
-
-     
   if (!PRIVATE(this)->cubehandler) {
     PRIVATE(this)->cubehandler = new CvrCubeHandler();
   }
@@ -357,10 +375,100 @@ SoObliqueSlice::GLRender(SoGLRenderAction * action)
     
   PRIVATE(this)->cubehandler->renderObliqueSlice(action, alphause, this->plane.getValue());
 
- done:
   state->pop();
 }
 
+// Returns FALSE if 3D textures are not available, or have been
+// found to be slow (e.g. software rendering), in the current context.
+SbBool
+SoObliqueSliceP::use3DTexturing(SoGLRenderAction * action) const
+{
+  if (CvrUtil::force2DTextureRendering()) { return FALSE; }
+
+  const uint32_t ctxid = action->getCacheContext();
+  const cc_glglue * glue = cc_glglue_instance(ctxid);
+  if (!cc_glglue_has_3d_textures(glue)) { return FALSE; }
+
+  return (SoVolumeRendering::get3DTextureAcceleration(ctxid) ==
+          SoVolumeRendering::NO) ? FALSE : TRUE;
+}
+
+// Resamples the slice on the CPU, and renders it as a mesh of
+// colored quads, with one vertex per sample. The samples are kept
+// until the plane, volume data or transfer function changes.
+void
+SoObliqueSliceP::renderResampled(SoGLRenderAction * action)
+{
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  assert(vbelem != NULL);
+
+  const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
+  const int alphause = PUBLIC(this)->alphaUse.getValue();
+  CvrCLUT * clut = CvrVoxelChunk::getCLUT(tfelement, (CvrCLUT::AlphaUse)alphause);
+
+  const SbPlane plane = PUBLIC(this)->plane.getValue();
+  const int interpolation = PUBLIC(this)->interpolation.getValue();
+
+  if ((this->samplecolors == NULL) ||
+      (this->samplenodeid != vbelem->getNodeId()) ||
+      (this->sampleclutchecksum != clut->getChecksum()) ||
+      (this->samplealphause != alphause) ||
+      (this->sampleinterpolation != interpolation) ||
+      (this->sampleplane.getNormal() != plane.getNormal()) ||
+      (this->sampleplane.getDistanceFromOrigin() != plane.getDistanceFromOrigin())) {
+
+    delete[] this->samplecolors;
+    this->samplecolors = NULL;
+    this->samplenodeid = vbelem->getNodeId();
+    this->sampleclutchecksum = clut->getChecksum();
+    this->samplealphause = alphause;
+    this->sampleinterpolation = interpolation;
+    this->sampleplane = plane;
+
+    const CvrObliqueSampler sampler(vbelem->getVoxels(), vbelem->getBytesPrVoxel(),
+                                    vbelem->getVoxelCubeDimensions(),
+                                    vbelem->getUnitDimensionsBox());
+
+    if (sampler.getSliceRectangle(plane, this->sampleorigo,
+                                  this->samplehorizspan, this->sampleverticalspan)) {
+      // Keep the number of vertices per frame down.
+      const SbVec2s native =
+        sampler.getNativeResolution(this->samplehorizspan, this->sampleverticalspan);
+      this->samplesize = SbVec2s(SbMax(SbMin(native[0], (short)512), (short)2),
+                                 SbMax(SbMin(native[1], (short)512), (short)2));
+
+      this->samplecolors = new uint8_t[this->samplesize[0] * this->samplesize[1] * 4];
+      sampler.resampleRGBA(this->sampleorigo, this->samplehorizspan,
+                           this->sampleverticalspan, this->samplesize,
+                           (interpolation == SoObliqueSlice::LINEAR) ? TRUE : FALSE,
+                           clut, this->samplecolors);
+    }
+  }
+
+  clut->unref();
+
+  if (this->samplecolors == NULL) { return; }
+
+  // This must be done, as we want to control stuff in the GL state
+  // machine. Without it, state changes could trigger outside our
+  // control.
+  SoGLLazyElement::getInstance(state)->send(state, SoLazyElement::ALL_MASK);
+
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  CvrObliqueSampler::renderRGBA(this->sampleorigo, this->samplehorizspan,
+                                this->sampleverticalspan, this->samplesize,
+                                this->samplecolors);
+
+  glPopAttrib();
+}
+
 void
 SoObliqueSlice::rayPick(SoRayPickAction * action)
 {
@@ -58,11 +58,20 @@
 
   <center><img src="http://doc.coin3d.org/images/SIMVoleon/nodes/twoorthos.png"></center>
 
+  If 3D textures are in use for the volume in the current OpenGL
+  context, the slice is cut directly through the 3D texture bricks
+  shared with SoVolumeRender, instead of from a separate 2D texture
+  page. Setting the environment variable CVR_ORTHOSLICE_3D_TEXTURES=0
+  forces the use of 2D texture pages.
+
   \sa SoVolumeRender
 */
 
 // *************************************************************************
 
+#include <stdlib.h>
+
+#include <Inventor/C/glue/gl.h>
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/actions/SoRayPickAction.h>
 #include <Inventor/elements/SoGLClipPlaneElement.h>
@@ -81,14 +90,18 @@
 #include <VolumeViz/details/SoOrthoSliceDetail.h>
 #include <VolumeViz/elements/CvrGLInterpolationElement.h>
 #include <VolumeViz/elements/CvrPageSizeElement.h>
+#include <VolumeViz/elements/CvrStorageHintElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
 #include <VolumeViz/nodes/SoTransferFunction.h>
+#include <VolumeViz/nodes/SoVolumeData.h>
+#include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <VolumeViz/render/2D/Cvr2DTexPage.h>
+#include <VolumeViz/render/3D/CvrCubeHandler.h>
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
 #include <VolumeViz/misc/CvrUtil.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
 
 // *************************************************************************
 
@@ -101,6 +114,7 @@ public:
   SoOrthoSliceP(SoOrthoSlice * master)
   {
     this->master = master;
+    this->cubehandler = NULL;
 
     if (SoOrthoSliceP::debug == -1) {
       SoOrthoSliceP::debug = coin_getenv("CVR_DEBUG_ORTHOSLICE") ? 1 : 0;
@@ -110,16 +124,15 @@ public:
   ~SoOrthoSliceP()
   {
     this->invalidatePageCache();
+    delete this->cubehandler;
   }
 
   void invalidatePageCache(void)
   {
-    for (int axis=0; axis < 3; axis++) {
-      while (this->cachedpages[axis].getLength() > 0) {
-        const int idx = this->cachedpages[axis].getLength() - 1;
-        delete this->cachedpages[axis][idx];
-        this->cachedpages[axis].remove(idx);
-      }
+    while (this->cachedpages.getLength() > 0) {
+      const int idx = this->cachedpages.getLength() - 1;
+      delete this->cachedpages[idx];
+      this->cachedpages.remove(idx);
     }
   }
 
@@ -127,17 +140,21 @@ public:
   Cvr2DTexPage * getPage(const SoGLRenderAction * action, const int axis, const int slice);
   SbPlane getSliceAsPlane(SoAction * action) const;
   SbBool confirmValidInContext(SoState * state) const;
+  static SbBool use3DTexturing(SoGLRenderAction * action);
 
   SoColorPacker colorpacker;
+  CvrCubeHandler * cubehandler;
 
   static int debug;
 
 private:
   class CachedPage {
   public:
-    CachedPage(Cvr2DTexPage * page, SoOrthoSlice * node)
+    CachedPage(Cvr2DTexPage * page, const int axis, const int slice)
     {
       this->page = page;
+      this->axis = axis;
+      this->slice = slice;
     }
 
     ~CachedPage()
@@ -152,9 +169,13 @@ private:
 
     uint32_t volumedataid;
     Cvr2DTexPage * page;
+    int axis, slice;
   };
 
-  SbList<CachedPage*> cachedpages[3];
+  // The most recently used pages, in order of use with the latest
+  // first. Only a few pages are kept, so scrubbing through a large
+  // volume won't make the cache grow to cover the full axis.
+  SbList<CachedPage*> cachedpages;
   SoOrthoSlice * master;
 };
 
@@ -358,9 +379,8 @@ void
 SoOrthoSlice::GLRender(SoGLRenderAction * action)
 {
   // This will automatically lock and unlock a mutex stopping multiple
-  // render threads for SIM Voleon nodes. FIXME: should really make
-  // code re-entrant / threadsafe. 20041112 mortene.
-  CvrGlobalRenderLock lock;
+  // render threads from rendering the same volume at the same time.
+  CvrVolumeRenderLock lock(action->getState());
 
   SoState * state = action->getState();
 
@@ -437,6 +457,48 @@ SoOrthoSlice::GLRender(SoGLRenderAction * action)
   // debug
   if (SoOrthoSliceP::debug) { SoOrthoSliceP::renderBox(action, slicebox); }
 
+  const int axisidx = this->axis.getValue();
+  const int slicenr = this->sliceNumber.getValue();
+
+  int pageslice = slicenr;
+
+  // This is done to support client code depending on an old bug: data
+  // along the Y axis used to be rendered flipped.
+  if (CvrUtil::useFlippedYAxis() && (axisidx == Y)) {
+    const short ydim = vbelem->getVoxelCubeDimensions()[Y];
+    pageslice = (ydim - 1) - pageslice;
+  }
+
+  GLenum interp;
+  switch (this->interpolation.getValue()) {
+  case NEAREST: interp = GL_NEAREST; break;
+  case LINEAR: interp = GL_LINEAR; break;
+  default: assert(FALSE && "invalid value in interpolation field"); break;
+  }
+  CvrGLInterpolationElement::set(state, interp);
+
+  // When 3D textures are in use for the volume, slice through the
+  // same bricks as SoVolumeRender instead of extracting a 2D page
+  // for every new slice position. (The bricks are already built
+  // flipped if CVR_USE_FLIPPED_Y_AXIS is set, so the slice number is
+  // used as is.)
+  if (SoOrthoSliceP::use3DTexturing(action)) {
+    SbMatrix volumetransform;
+    CvrUtil::getTransformFromVolumeBoxDimensions(vbelem, volumetransform);
+    SoModelMatrixElement::mult(state, this, volumetransform);
+
+    if (!PRIVATE(this)->cubehandler) {
+      PRIVATE(this)->cubehandler = new CvrCubeHandler();
+    }
+    PRIVATE(this)->cubehandler->renderOrthoSlice(action,
+                                                 (CvrCLUT::AlphaUse)this->alphaUse.getValue(),
+                                                 axisidx, slicenr);
+
+    state->pop();
+    SoOrthoSlice::doAction(action);
+    return;
+  }
+
   // Extract volume placement and scale information, and place it on
   // the model matrix stack. This lets the subsequent render code work
   // with a 1x1x1 size volume in unit coordinates, without
@@ -457,26 +519,12 @@ SoOrthoSlice::GLRender(SoGLRenderAction * action)
     SoModelMatrixElement::mult(state, this, m);
   }
 
-
-  const int axisidx = this->axis.getValue();
-  const int slicenr = this->sliceNumber.getValue();
-
-  int pageslice = slicenr;
-
-  // This is done to support client code depending on an old bug: data
-  // along the Y axis used to be rendered flipped.
-  if (CvrUtil::useFlippedYAxis() && (axisidx == Y)) {
-    const short ydim = vbelem->getVoxelCubeDimensions()[Y];
-    pageslice = (ydim - 1) - pageslice;
-  }
-
   Cvr2DTexPage * texpage =
     PRIVATE(this)->getPage(action, axisidx, pageslice);
 
   const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
   CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, (CvrCLUT::AlphaUse)this->alphaUse.getValue());
 
-  c->ref();
   const CvrCLUT * pageclut = texpage->getPalette();
   if ((pageclut == NULL) || (*pageclut != *c)) { texpage->setPalette(c); }
   c->unref();
@@ -498,14 +546,6 @@ SoOrthoSlice::GLRender(SoGLRenderAction * action)
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  GLenum interp;
-  switch (this->interpolation.getValue()) {
-  case NEAREST: interp = GL_NEAREST; break;
-  case LINEAR: interp = GL_LINEAR; break;
-  default: assert(FALSE && "invalid value in interpolation field"); break;
-  }
-  CvrGLInterpolationElement::set(state, interp);
-
   SbVec3f origo, horizspan, verticalspan;
   vbelem->getPageGeometry(axisidx, slicenr, origo, horizspan, verticalspan);
 
@@ -523,18 +563,56 @@ SoOrthoSlice::GLRender(SoGLRenderAction * action)
   SoOrthoSlice::doAction(action);
 }
 
+// Returns TRUE if the slice should be rendered from 3D texture
+// bricks. This is only done when 3D texturing has already been found
+// to be accelerated in the current context (i.e. by SoVolumeRender),
+// so the bricks are likely to be resident and shared.
+SbBool
+SoOrthoSliceP::use3DTexturing(SoGLRenderAction * action)
+{
+  static int use3d = -1;
+  if (use3d == -1) {
+    const char * env = coin_getenv("CVR_ORTHOSLICE_3D_TEXTURES");
+    use3d = env ? (atoi(env) > 0 ? 1 : 0) : 1;
+  }
+  if (!use3d || CvrUtil::force2DTextureRendering()) { return FALSE; }
+
+  SoState * state = action->getState();
+  const int storagehint = CvrStorageHintElement::get(state);
+  if ((storagehint != SoVolumeData::TEX3D) &&
+      (storagehint != SoVolumeData::AUTO) &&
+      (storagehint != SoVolumeData::VOLUMEPRO)) { return FALSE; }
+
+  const cc_glglue * glue = cc_glglue_instance(action->getCacheContext());
+  if (!cc_glglue_has_3d_textures(glue)) { return FALSE; }
+
+  const uint32_t ctxid = action->getCacheContext();
+  return (SoVolumeRendering::get3DTextureAcceleration(ctxid) ==
+          SoVolumeRendering::YES) ? TRUE : FALSE;
+}
+
 Cvr2DTexPage *
 SoOrthoSliceP::getPage(const SoGLRenderAction * action,
                        const int axis, const int slice)
 {
-  while (this->cachedpages[axis].getLength() <= slice) {
-    this->cachedpages[axis].append(NULL);
+  static int maxpages = -1;
+  if (maxpages == -1) {
+    const char * env = coin_getenv("CVR_ORTHOSLICE_CACHED_PAGES");
+    maxpages = env ? SbMax(atoi(env), 1) : 8;
   }
 
   SoState * state = action->getState();
   const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
 
-  SoOrthoSliceP::CachedPage * cp = this->cachedpages[axis][slice];
+  SoOrthoSliceP::CachedPage * cp = NULL;
+  for (int i = 0; i < this->cachedpages.getLength(); i++) {
+    SoOrthoSliceP::CachedPage * p = this->cachedpages[i];
+    if ((p->axis == axis) && (p->slice == slice)) {
+      this->cachedpages.remove(i);
+      cp = p;
+      break;
+    }
+  }
 
   // Check validity.
   //
@@ -548,13 +626,22 @@ SoOrthoSliceP::getPage(const SoGLRenderAction * action,
     SbVec2s subpagesize =
       SbVec2s(pagesize[(axis == 0) ? 2 : 0], pagesize[(axis == 1) ? 2 : 1]);
 
+    // Throw out the least recently used page first, so its textures
+    // can be recycled for the new page.
+    while (this->cachedpages.getLength() >= maxpages) {
+      const int idx = this->cachedpages.getLength() - 1;
+      delete this->cachedpages[idx];
+      this->cachedpages.remove(idx);
+    }
+
     Cvr2DTexPage * page = new Cvr2DTexPage(action, axis, slice, subpagesize);
 
-    this->cachedpages[axis][slice] = cp =
-      new SoOrthoSliceP::CachedPage(page, PUBLIC(this));
+    cp = new SoOrthoSliceP::CachedPage(page, axis, slice);
     cp->volumedataid = vbelem->getNodeId();
   }
 
+  this->cachedpages.insert(cp, 0);
+
   return cp->getPage();
 }
 
@@ -33,9 +33,6 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-// FIXME: class not yet properly implemented. 20040505 mortene.
-
-
 #include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <Inventor/fields/SoSFBox3s.h>
 #include <Inventor/fields/SoSFBool.h>
@@ -84,7 +81,6 @@ protected:
 
   virtual void GLRender(SoGLRenderAction * action);
 
-  // FIXME: Implement these functions... torbjorv 07312002
   virtual void doAction(SoAction * action);
   virtual void callback(SoCallbackAction * action);
   virtual void getBoundingBox(SoGetBoundingBoxAction * action);
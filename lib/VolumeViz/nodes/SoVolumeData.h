@@ -43,9 +43,12 @@
 #include <Inventor/SbBox3s.h>
 #include <Inventor/SbBox2s.h>
 #include <Inventor/SbBox2f.h>
+#include <Inventor/SbVec2s.h>
 #include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <Inventor/nodes/SoSubNode.h>
 
+class SbLine;
+class SbPlane;
 class SoVolumeReader;
 class SoState;
 class SoTransferFunction;
@@ -90,6 +93,24 @@ public:
 
   uint32_t getVoxelValue(const SbVec3s & voxelpos) const;
 
+  SbBool getObliqueSliceGeometry(const SbPlane & plane, SbVec3f & origo,
+                                 SbVec3f & horizspan, SbVec3f & verticalspan,
+                                 SbVec2s & nativesize) const;
+  SbBool resampleObliqueSlice(const SbPlane & plane, const SbVec2s & size,
+                              float * buffer, SbBool linear = TRUE) const;
+  SbBool sampleValues(const SbVec3f * points, const int numpoints,
+                      float * values, SbBool linear = TRUE,
+                      const float outsidevalue = 0.0f) const;
+  SbBool sampleProfile(const SbVec3f * vertices, const int numvertices,
+                       const int numsamples, float * values,
+                       SbBool linear = TRUE,
+                       const float outsidevalue = 0.0f) const;
+
+  int pickRays(const SbLine * rays, const int numrays,
+               const SoTransferFunction * transferfunction,
+               SbBool * hits, SbVec3f * positions = NULL,
+               unsigned int * values = NULL, const float opacity = 0.0f) const;
+
   void setVolumeSize(const SbBox3f & size);
   SbBox3f getVolumeSize(void) const;
 
@@ -55,7 +55,7 @@ public:
 
   enum Interpolation { NEAREST, LINEAR };
   enum Composition { MAX_INTENSITY, SUM_INTENSITY, ALPHA_BLENDING };
-  enum NumSlicesControl { ALL, MANUAL, AUTOMATIC };
+  enum NumSlicesControl { ALL, MANUAL, AUTOMATIC, TIME_BUDGET };
 
   enum AbortCode { CONTINUE, ABORT, SKIP };
   typedef AbortCode SoVolumeRenderAbortCB(int totalslices, int thisslice, 
@@ -63,6 +63,19 @@ public:
 
   void setAbortCallback(SoVolumeRenderAbortCB * func, void * userdata = NULL);
 
+  typedef void SoVolumeRenderTimeBudgetCB(int numslices, float frametime,
+                                          void * userdata);
+
+  void setTimeBudgetCallback(SoVolumeRenderTimeBudgetCB * func, void * userdata = NULL);
+
+  void setInteractiveQuality(float slicefraction);
+  float getInteractiveQuality(void) const;
+  void setInteracting(SbBool flag);
+  SbBool isInteracting(void) const;
+
+  void setImageCaching(SbBool flag);
+  SbBool getImageCaching(void) const;
+
   SoSFEnum interpolation;
   SoSFEnum composition;
   SoSFBool lighting;
@@ -71,6 +84,7 @@ public:
   SoSFEnum numSlicesControl;
   SoSFInt32 numSlices;
   SoSFBool viewAlignedSlices;
+  SoSFFloat frameTimeBudget;
 
 protected:
   ~SoVolumeRender();
@@ -61,6 +61,14 @@ public:
   static void setDelayedRendering(SbBool flag);
   static SbBool getDelayedRendering(void);
 
+  static void setContextSharing(uint32_t cachecontext, uint32_t sharecachecontext);
+
+  static void setBatchRendering(SbBool flag);
+  static SbBool getBatchRendering(void);
+
+  static HW_SupportStatus get3DTextureAcceleration(uint32_t cachecontext);
+  static void set3DTextureAcceleration(uint32_t cachecontext, HW_SupportStatus status);
+
 protected:
   ~SoVolumeRendering();
 
@@ -295,6 +295,7 @@ SoTransferFunction::SoTransferFunction(void)
 
 SoTransferFunction::~SoTransferFunction()
 {
+  CvrVoxelChunk::releaseCLUTs(this);
   delete PRIVATE(this);
 }
 
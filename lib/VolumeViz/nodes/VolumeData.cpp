@@ -82,9 +82,11 @@
 #include <VolumeViz/nodes/SoVolumeData.h>
 
 #include <limits.h>
+#include <stdlib.h>
 #include <float.h> // FLT_MAX
 
 #include <Inventor/C/tidbits.h>
+#include <Inventor/SbLinear.h>
 #include <Inventor/SbVec3s.h>
 #include <Inventor/actions/SoCallbackAction.h>
 #include <Inventor/actions/SoGLRenderAction.h>
@@ -93,6 +95,8 @@
 #include <Inventor/elements/SoGLCacheContextElement.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/sensors/SoFieldSensor.h>
+#include <Inventor/threads/SbMutex.h>
+#include <Inventor/lists/SbList.h>
 #include <Inventor/lists/SbStringList.h>
 #include <Inventor/system/gl.h>
 
@@ -103,7 +107,13 @@
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/readers/SoVRMemReader.h>
 #include <VolumeViz/readers/SoVRVolFileReader.h>
+#include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrObliqueSampler.h>
 #include <VolumeViz/misc/CvrUtil.h>
+#include <VolumeViz/misc/CvrVoxelChunk.h>
+#include <VolumeViz/misc/CvrVoxelRay.h>
+
+#include "volumeraypickintersection.h"
 
 // *************************************************************************
 
@@ -181,6 +191,10 @@
   the library will fall back on non-compressed textures automatically
   if that is the case.
 
+  Where the driver supports S3TC compressed 3D textures, the 3D
+  texture bricks are compressed by the library itself before upload,
+  instead of leaving the job to the driver.
+
   Default value is \c TRUE. To secure no loss of visual quality, set
   this field to \c FALSE.
 
@@ -243,6 +257,10 @@ public:
   int * histogram;
   unsigned int histogramlength;
 
+  // For skipping transparent parts of the volume in pickRays().
+  CvrBrickRanges * brickranges;
+  SbMutex pickmutex;
+
   void downSample(SbVec3s dimensions, SoVolumeData::SubMethod subMethod, void * data);
   void overSample(SbVec3s dimensions, SoVolumeData::OverMethod overMethod, void * data);
 
@@ -298,12 +316,14 @@ SoVolumeData::SoVolumeData(void)
   PRIVATE(this)->filenamesensor->attach(&this->fileName);
   PRIVATE(this)->histogram = NULL;
   PRIVATE(this)->histogramlength = 0;
+  PRIVATE(this)->brickranges = NULL;
 }
 
 
 SoVolumeData::~SoVolumeData()
 {
   delete PRIVATE(this)->filenamesensor;
+  delete PRIVATE(this)->brickranges;
   delete PRIVATE(this);
 }
 
@@ -518,6 +538,339 @@ SoVolumeData::getVoxelValue(const SbVec3s & voxelpos) const
   return val;
 }
 
+/*!
+  Finds the placement of a slice through the volume along \a plane,
+  given in the same coordinate system as the volume box (see
+  SoVolumeData::setVolumeSize()).
+
+  The slice is the smallest rectangle in the plane covering all of
+  the plane's intersection with the volume box. \a origo is set to
+  its upper left corner, and \a horizspan and \a verticalspan to its
+  horizontal (rightwards) and vertical (downwards) sides. \a
+  nativesize is set to the image size giving about one sample per
+  voxel.
+
+  Returns \c FALSE if the plane does not intersect the volume.
+
+  \sa SoVolumeData::resampleObliqueSlice()
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeData::getObliqueSliceGeometry(const SbPlane & plane, SbVec3f & origo,
+                                      SbVec3f & horizspan, SbVec3f & verticalspan,
+                                      SbVec2s & nativesize) const
+{
+  if ((PRIVATE(this)->reader == NULL) || (PRIVATE(this)->reader->m_data == NULL)) {
+    return FALSE;
+  }
+
+  const CvrObliqueSampler sampler((const uint8_t *)PRIVATE(this)->reader->m_data,
+                                  (PRIVATE(this)->datatype == UNSIGNED_SHORT) ? 2 : 1,
+                                  PRIVATE(this)->dimensions, this->getVolumeSize());
+  if (!sampler.getSliceRectangle(plane, origo, horizspan, verticalspan)) {
+    return FALSE;
+  }
+  nativesize = sampler.getNativeResolution(horizspan, verticalspan);
+  return TRUE;
+}
+
+/*!
+  Resamples the voxel values along \a plane into \a buffer, as a 2D
+  image of \a size[0] by \a size[1] values, covering the rectangle
+  returned from SoVolumeData::getObliqueSliceGeometry(). Rows are
+  stored from top to bottom. \a buffer must have room for \a
+  size[0] * \a size[1] values.
+
+  If \a linear is \c TRUE, trilinear interpolation is used between
+  the voxels, otherwise the nearest voxel's value. Samples outside the
+  volume are set to 0.
+
+  This is done on the CPU, split over several threads, and is useful
+  for e.g. exporting oblique slices as images. The number of threads
+  can be set with the environment variable CVR_RESAMPLE_THREADS
+  (default 4).
+
+  Returns \c FALSE if the plane does not intersect the volume.
+
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeData::resampleObliqueSlice(const SbPlane & plane, const SbVec2s & size,
+                                   float * buffer, SbBool linear) const
+{
+  if ((PRIVATE(this)->reader == NULL) || (PRIVATE(this)->reader->m_data == NULL)) {
+    return FALSE;
+  }
+
+  const CvrObliqueSampler sampler((const uint8_t *)PRIVATE(this)->reader->m_data,
+                                  (PRIVATE(this)->datatype == UNSIGNED_SHORT) ? 2 : 1,
+                                  PRIVATE(this)->dimensions, this->getVolumeSize());
+
+  SbVec3f origo, horizspan, verticalspan;
+  if (!sampler.getSliceRectangle(plane, origo, horizspan, verticalspan)) {
+    return FALSE;
+  }
+
+  sampler.resample(origo, horizspan, verticalspan, size, linear, 0.0f, buffer);
+  return TRUE;
+}
+
+/*!
+  Samples the voxel values at the \a numpoints positions in \a
+  points, given in the same coordinate system as the volume box (see
+  SoVolumeData::setVolumeSize()), into \a values.
+
+  If \a linear is \c TRUE, trilinear interpolation is used between
+  the voxels, otherwise the nearest voxel's value. Samples outside the
+  volume are set to \a outsidevalue, so these can be told apart from
+  voxels with the value 0 by passing a value outside the data range,
+  e.g. -1.
+
+  This is much faster than calling SoVolumeData::getVoxelValue() for
+  each point, and is split over threads as for
+  SoVolumeData::resampleObliqueSlice().
+
+  Returns \c FALSE if there is no volume data.
+
+  \sa SoVolumeData::sampleProfile()
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeData::sampleValues(const SbVec3f * points, const int numpoints,
+                           float * values, SbBool linear,
+                           const float outsidevalue) const
+{
+  if ((PRIVATE(this)->reader == NULL) || (PRIVATE(this)->reader->m_data == NULL)) {
+    return FALSE;
+  }
+
+  const CvrObliqueSampler sampler((const uint8_t *)PRIVATE(this)->reader->m_data,
+                                  (PRIVATE(this)->datatype == UNSIGNED_SHORT) ? 2 : 1,
+                                  PRIVATE(this)->dimensions, this->getVolumeSize());
+  sampler.probe(points, numpoints, linear, outsidevalue, values);
+  return TRUE;
+}
+
+/*!
+  Samples the voxel values along the polyline through the \a
+  numvertices positions in \a vertices into \a values, for
+  e.g. plotting a profile. The \a numsamples samples are evenly
+  spaced along the polyline's length, the first at the first vertex
+  and the last at the last vertex.
+
+  Interpolation and samples outside the volume are handled as for
+  SoVolumeData::sampleValues().
+
+  Returns \c FALSE if there is no volume data, or if \a numvertices
+  or \a numsamples is less than 1.
+
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeData::sampleProfile(const SbVec3f * vertices, const int numvertices,
+                            const int numsamples, float * values,
+                            SbBool linear, const float outsidevalue) const
+{
+  if ((numvertices < 1) || (numsamples < 1)) { return FALSE; }
+
+  // Find the length of the polyline up to each vertex.
+  float * lengths = new float[numvertices];
+  lengths[0] = 0.0f;
+  for (int i = 1; i < numvertices; i++) {
+    lengths[i] = lengths[i - 1] + (vertices[i] - vertices[i - 1]).length();
+  }
+  const float totallength = lengths[numvertices - 1];
+
+  SbVec3f * points = new SbVec3f[numsamples];
+  int segment = 0;
+  for (int i = 0; i < numsamples; i++) {
+    const float t =
+      (numsamples > 1) ? (totallength * i) / (numsamples - 1) : 0.0f;
+    while ((segment < numvertices - 2) && (lengths[segment + 1] < t)) {
+      segment++;
+    }
+
+    if (numvertices == 1) {
+      points[i] = vertices[0];
+      continue;
+    }
+
+    const float seglength = lengths[segment + 1] - lengths[segment];
+    const float f = (seglength > 0.0f) ?
+      SbClamp((t - lengths[segment]) / seglength, 0.0f, 1.0f) : 0.0f;
+    points[i] = vertices[segment] + (vertices[segment + 1] - vertices[segment]) * f;
+  }
+
+  const SbBool ok = this->sampleValues(points, numsamples, values, linear,
+                                       outsidevalue);
+
+  delete[] points;
+  delete[] lengths;
+  return ok;
+}
+
+// *************************************************************************
+
+// A share of the rays for SoVolumeData::pickRays(), handled by a
+// single thread.
+struct cvr_pick_job {
+  const SoVolumeData * volumedata;
+  const uint8_t * voxels;
+  unsigned int bytesprvoxel;
+  SbVec3s dimensions;
+  SbBox3f volumebox;
+  const CvrCLUT * clut;
+  const unsigned int * opaquecount;
+  CvrBrickRanges * brickranges;
+  float opacity;
+
+  const SbLine * rays;
+  SbBool * hits;
+  SbVec3f * positions;
+  unsigned int * values;
+  int firstray, endray;
+  int nrhits;
+};
+
+static void *
+cvr_pick_rays(void * closure)
+{
+  struct cvr_pick_job * job = (struct cvr_pick_job *)closure;
+  CvrVoxelRay ray(job->voxels, job->bytesprvoxel, job->dimensions, job->volumebox);
+
+  for (int i = job->firstray; i < job->endray; i++) {
+    job->hits[i] = FALSE;
+
+    SbVec3f intersects[2];
+    if (!cvr_volumelineintersection(job->volumebox, job->rays[i], intersects) ||
+        !ray.start(intersects[0], intersects[1])) {
+      continue;
+    }
+
+    float accumulated = 0.0f;
+    SbBool more = TRUE;
+    while (more) {
+      // Fully transparent bricks add nothing to the opacity.
+      if (job->brickranges->isTransparent(ray.getVoxel(), job->opaquecount)) {
+        more = ray.skipBrick(CvrBrickRanges::BRICKSIZE);
+        continue;
+      }
+
+      uint8_t rgba[4];
+      job->clut->lookupRGBA(ray.getValue(), rgba);
+      if (rgba[3] != 0) {
+        accumulated += (1.0f - accumulated) * (rgba[3] / 255.0f);
+        if (accumulated >= job->opacity) {
+          job->hits[i] = TRUE;
+          job->nrhits++;
+          if (job->positions) { job->positions[i] = ray.getPosition(); }
+          if (job->values) { job->values[i] = job->volumedata->getVoxelValue(ray.getVoxel()); }
+          break;
+        }
+      }
+
+      more = ray.next();
+    }
+  }
+
+  return NULL;
+}
+
+/*!
+  Picks \a numrays rays through the volume at once, which is much
+  faster than using an SoRayPickAction for each of them when there
+  are many rays, e.g. for measurement tools or probe lines. The rays
+  are given in the same coordinate system as the volume box (see
+  SoVolumeData::setVolumeSize()), and are traversed through the full
+  volume from the side nearest each ray's position, as for the
+  picking done by SoVolumeRender.
+
+  For each ray, \a hits[i] is set to \c TRUE if the ray hits a voxel
+  which is not fully transparent with \a transferfunction, with its
+  SoTransferFunction::remapLow and SoTransferFunction::remapHigh
+  thresholds applied as when rendering. If \a opacity is larger than
+  0, a hit is instead where the accumulated opacity of the voxels
+  along the ray (composited front-to-back, one sample per voxel)
+  reaches \a opacity.
+
+  If not \c NULL, \a positions[i] is set to where the ray enters the
+  voxel hit, and \a values[i] to the value of that voxel. These are
+  left untouched for rays not hitting anything.
+
+  The rays are split over threads as for
+  SoVolumeData::resampleObliqueSlice().
+
+  Returns the number of rays which hit the volume.
+
+  \since SIM Voleon 2.1
+*/
+int
+SoVolumeData::pickRays(const SbLine * rays, const int numrays,
+                       const SoTransferFunction * transferfunction,
+                       SbBool * hits, SbVec3f * positions,
+                       unsigned int * values, const float opacity) const
+{
+  assert(transferfunction != NULL);
+  assert(hits != NULL);
+
+  if ((PRIVATE(this)->reader == NULL) || (PRIVATE(this)->reader->m_data == NULL)) {
+    for (int i = 0; i < numrays; i++) { hits[i] = FALSE; }
+    return 0;
+  }
+
+  CvrCLUT * clut = CvrVoxelChunk::getCLUT(transferfunction, CvrCLUT::ALPHA_AS_IS);
+  unsigned int opaquecount[257];
+  CvrBrickRanges::countOpaque(clut, opaquecount);
+
+  const uint8_t * voxels = (const uint8_t *)PRIVATE(this)->reader->m_data;
+  const unsigned int bytesprvoxel = (PRIVATE(this)->datatype == UNSIGNED_SHORT) ? 2 : 1;
+
+  PRIVATE(this)->pickmutex.lock();
+
+  if (PRIVATE(this)->brickranges == NULL) {
+    PRIVATE(this)->brickranges = new CvrBrickRanges;
+  }
+  PRIVATE(this)->brickranges->setVolume(voxels, bytesprvoxel,
+                                        PRIVATE(this)->dimensions, this->getNodeId());
+
+  struct cvr_pick_job job;
+  job.volumedata = this;
+  job.voxels = voxels;
+  job.bytesprvoxel = bytesprvoxel;
+  job.dimensions = PRIVATE(this)->dimensions;
+  job.volumebox = this->getVolumeSize();
+  job.clut = clut;
+  job.opaquecount = opaquecount;
+  job.brickranges = PRIVATE(this)->brickranges;
+  job.opacity = opacity;
+  job.rays = rays;
+  job.hits = hits;
+  job.positions = positions;
+  job.values = values;
+  job.nrhits = 0;
+
+  // Few rays aren't worth the thread overhead.
+  const int nrjobs = SbMax(SbMin(CvrUtil::maxWorkerThreads(), numrays / 256), 1);
+
+  SbList<struct cvr_pick_job> jobs;
+  for (int i = 0; i < nrjobs; i++) {
+    job.firstray = (numrays * i) / nrjobs;
+    job.endray = (numrays * (i + 1)) / nrjobs;
+    jobs.append(job);
+  }
+
+  CvrUtil::runJobs((void *)jobs.getArrayPtr(), jobs.getLength(),
+                   sizeof(struct cvr_pick_job), cvr_pick_rays);
+
+  int nrhits = 0;
+  for (int i = 0; i < jobs.getLength(); i++) { nrhits += jobs[i].nrhits; }
+
+  PRIVATE(this)->pickmutex.unlock();
+
+  clut->unref();
+  return nrhits;
+}
+
 /*!
 
   Sets the largest internal size of texture pages and texture cubes.
@@ -75,7 +75,7 @@
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
 #include <VolumeViz/misc/CvrUtil.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
 
 #include "CvrFaceSetRenderP.h"
 
@@ -136,9 +136,8 @@ void
 SoVolumeFaceSet::GLRender(SoGLRenderAction * action)
 {
   // This will automatically lock and unlock a mutex stopping multiple
-  // render threads for SIM Voleon nodes. FIXME: should really make
-  // code re-entrant / threadsafe. 20041112 mortene.
-  CvrGlobalRenderLock lock;
+  // render threads from rendering the same volume at the same time.
+  CvrVolumeRenderLock lock(action->getState());
 
 
   // FIXME: need to make sure we're not cached in a renderlist
@@ -45,6 +45,7 @@
 
 #include <VolumeViz/nodes/SoVolumeRender.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <limits.h> // UINT_MAX
 #include <float.h> // DBL_MAX
@@ -54,6 +55,7 @@
 #include <Inventor/SbLine.h>
 #include <Inventor/SbPlane.h>
 #include <Inventor/SbRotation.h>
+#include <Inventor/SbString.h>
 #include <Inventor/SbTime.h>
 #include <Inventor/SoPickedPoint.h>
 #include <Inventor/actions/SoGLRenderAction.h>
@@ -63,14 +65,20 @@
 #include <Inventor/elements/SoGLTextureEnabledElement.h>
 #include <Inventor/elements/SoLazyElement.h>
 #include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoProjectionMatrixElement.h>
+#include <Inventor/elements/SoViewingMatrixElement.h>
 #include <Inventor/elements/SoShapeStyleElement.h>
 #include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoClipPlaneElement.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/system/gl.h>
 #include <Inventor/nodes/SoDrawStyle.h>
 #include <Inventor/nodes/SoCube.h>
+#include <Inventor/sensors/SoAlarmSensor.h>
 
+#include <VolumeViz/nodes/SoTransferFunction.h>
 #include <VolumeViz/nodes/SoVolumeData.h>
+#include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <VolumeViz/elements/CvrGLInterpolationElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/CvrStorageHintElement.h>
@@ -78,12 +86,14 @@
 #include <VolumeViz/render/2D/CvrPageHandler.h>
 #include <VolumeViz/render/3D/CvrCubeHandler.h>
 #include <VolumeViz/render/Pointset/PointRendering.h>
+#include <VolumeViz/render/common/CvrImageCache.h>
 #include <VolumeViz/details/SoVolumeRenderDetail.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrUtil.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
 #include <VolumeViz/elements/CvrLightingElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
 #include <VolumeViz/Coin/gl/CoinGLPerformance.h>
 
 #include "volumeraypickintersection.h"
@@ -154,18 +164,42 @@ public:
     this->abortfunc = NULL;
     this->abortfuncdata = NULL;
     this->linestylevolumecube = NULL;
+    this->budgetfunc = NULL;
+    this->budgetfuncdata = NULL;
+    this->budgetfactor = 1.0f;
+    this->frametime = -1.0;
+    this->lastframe = SbTime::zero();
+    this->interactivequality = 1.0f;
+    this->interacting = FALSE;
+    this->userinteracting = FALSE;
+    this->refinesensor = new SoAlarmSensor(SoVolumeRenderP::refineCB, this);
+    this->imagecache = NULL;
+    this->capturingimage = FALSE;
+    this->imagecacheframe = FALSE;
   }
 
   ~SoVolumeRenderP()
   {
+    delete this->refinesensor;
+    delete this->imagecache;
     if (this->linestylevolumecube) this->linestylevolumecube->unref();
     if (this->pagehandler) delete this->pagehandler;
     if (this->cubehandler) delete this->cubehandler;
   }
 
+  int getNumSlicesControl(void) const;
+  void updateTimeBudget(void);
+  unsigned int applyTimeBudget(unsigned int allslices);
+  SbBool checkInteraction(SoGLRenderAction * action);
+  SbBool renderCachedImage(SoGLRenderAction * action,
+                           const SbMatrix & modelmatrix, const SbBox3f & box,
+                           int rendermethod, unsigned int numslices,
+                           GLenum interp, SbBool interacting);
+  static void refineCB(void * closure, SoSensor * sensor);
   unsigned int calculateNrOf2DSlices(SoGLRenderAction * action, const SbVec3s & dimensions);
   unsigned int calculateNrOf3DSlices(SoGLRenderAction * action, const SbVec3s & dimensions);
-  SbBool use3DTexturing(const cc_glglue * glglue) const;
+  SbBool use3DTexturing(SoGLRenderAction * action) const;
+  static SbBool probe3DTextureAcceleration(const cc_glglue * glglue);
 
   static void setupPerformanceTest(const cc_glglue * glglue, void *);
   static void cleanupPerformanceTest(const cc_glglue * glglue, void *);
@@ -179,6 +213,37 @@ public:
   SoVolumeRender::SoVolumeRenderAbortCB * abortfunc;
   void * abortfuncdata;
 
+  // For the TIME_BUDGET strategy: the fraction of the full number of
+  // slices to render, and the smoothed time between frames.
+  SoVolumeRender::SoVolumeRenderTimeBudgetCB * budgetfunc;
+  void * budgetfuncdata;
+  float budgetfactor;
+  double frametime;
+  SbTime lastframe;
+
+  // For reduced quality rendering during interaction. The camera
+  // matrices of the previous frame are kept per GL context, to
+  // detect camera movement.
+  struct CameraState {
+    uint32_t context;
+    SbMatrix viewmatrix;
+    SbMatrix projmatrix;
+  };
+  SbList<CameraState> camerastates;
+  float interactivequality;
+  SbBool interacting;
+  SbBool userinteracting;
+  SoAlarmSensor * refinesensor;
+
+  // The composited image of the volume, set up when image caching
+  // is on.
+  CvrImageCache * imagecache;
+  SbBool capturingimage;
+  // Set if the last frame was drawn from the cached image, or
+  // rendered twice to capture it, so its timing says nothing about
+  // the cost of rendering the slices.
+  SbBool imagecacheframe;
+
   // A cube used as line-style rep. for the volume
   SoCube * linestylevolumecube;
   
@@ -250,7 +315,8 @@ GLuint SoVolumeRenderP::texture2dids[2];
 
   Please note that SoVolumeRender::NumSlicesControl will always be
   considered as SoVolumeRender::ALL if the SoVolumeRender::numSlices
-  field is less or equal to 0.
+  field is less or equal to 0 (except for
+  SoVolumeRender::TIME_BUDGET, which does not use that field).
 */
 /*!
   \var SoVolumeRender::NumSlicesControl SoVolumeRender::MANUAL
@@ -273,6 +339,30 @@ GLuint SoVolumeRenderP::texture2dids[2];
 
   For \a "this->numSlices", see SoVolumeRender::numSlices.
 */
+/*!
+  \var SoVolumeRender::NumSlicesControl SoVolumeRender::TIME_BUDGET
+
+  The number of slices will be adjusted from frame to frame, by
+  measuring the time spent between frames, to keep it close to the
+  value of the SoVolumeRender::frameTimeBudget field.
+
+  The number of slices will be reduced when frames take more than 10%
+  longer than the budget, and increased again (up to the number used
+  for SoVolumeRender::ALL) when frames take less than 80% of it. The
+  gap between the two thresholds is there to avoid the quality
+  flipping back and forth from one frame to the next.
+
+  Note that the time measured is the wall-clock time between two
+  renderings of the node, so it includes the rendering of the rest of
+  the scene. Pauses in the redrawing, e.g. when the camera is not
+  moving, are detected and ignored.
+
+  When SoVolumeRendering::getBatchRendering() is \c TRUE, this will
+  be considered as SoVolumeRender::ALL.
+
+  \sa SoVolumeRender::setTimeBudgetCallback()
+  \since SIM Voleon 2.1
+*/
 
 /*!
   \var SoSFEnum SoVolumeRender::numSlicesControl
@@ -305,6 +395,18 @@ GLuint SoVolumeRenderP::texture2dids[2];
   Note that the default value of the field is 0.
 */
 
+/*!
+  \var SoSFFloat SoVolumeRender::frameTimeBudget
+
+  The target time for rendering a frame, in seconds, when
+  SoVolumeRender::numSlicesControl is set to
+  SoVolumeRender::TIME_BUDGET.
+
+  Default value is 0.05, i.e. 20 frames per second.
+
+  \since SIM Voleon 2.1
+*/
+
 // *************************************************************************
 
 /*!
@@ -389,6 +491,7 @@ SoVolumeRender::SoVolumeRender(void)
   SO_NODE_DEFINE_ENUM_VALUE(NumSlicesControl, ALL);
   SO_NODE_DEFINE_ENUM_VALUE(NumSlicesControl, MANUAL);
   SO_NODE_DEFINE_ENUM_VALUE(NumSlicesControl, AUTOMATIC);
+  SO_NODE_DEFINE_ENUM_VALUE(NumSlicesControl, TIME_BUDGET);
   SO_NODE_SET_SF_ENUM_TYPE(numSlicesControl, NumSlicesControl);
 
   SO_NODE_ADD_FIELD(interpolation, (SoVolumeRender::LINEAR));
@@ -399,6 +502,7 @@ SoVolumeRender::SoVolumeRender(void)
   SO_NODE_ADD_FIELD(numSlicesControl, (SoVolumeRender::ALL));
   SO_NODE_ADD_FIELD(numSlices, (0));
   SO_NODE_ADD_FIELD(viewAlignedSlices, (FALSE));
+  SO_NODE_ADD_FIELD(frameTimeBudget, (0.05f));
 
 }
 
@@ -422,6 +526,7 @@ SoVolumeRender::initClass(void)
 
   SO_ENABLE(SoGLRenderAction, CvrGLInterpolationElement);
   SO_ENABLE(SoGLRenderAction, CvrLightingElement);
+  SO_ENABLE(SoGLRenderAction, CvrROIElement);
 }
 
 namespace {
@@ -447,9 +552,8 @@ void
 SoVolumeRender::GLRender(SoGLRenderAction * action)
 {
   // This will automatically lock and unlock a mutex stopping multiple
-  // render threads for SIM Voleon nodes. FIXME: should really make
-  // code re-entrant / threadsafe. 20041112 mortene.
-  CvrGlobalRenderLock lock;
+  // render threads from rendering the same volume at the same time.
+  CvrVolumeRenderLock lock(action->getState());
 
   SoState * state = action->getState();
   SoStatePushPop pushpop(state);
@@ -553,10 +657,19 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
     return;
   }
 
+  // Needed for looking up the cached image, if any.
+  const SbMatrix modelmatrix = SoModelMatrixElement::get(state);
+
   SbMatrix volumetransform;
   CvrUtil::getTransformFromVolumeBoxDimensions(vbelement, volumetransform);
   SoModelMatrixElement::mult(state, this, volumetransform);
 
+  if (PRIVATE(this)->getNumSlicesControl() == SoVolumeRender::TIME_BUDGET) {
+    PRIVATE(this)->updateTimeBudget();
+  }
+
+  const SbBool interacting = PRIVATE(this)->checkInteraction(action);
+
   int rendermethod;
 
   static int renderwithglpoints = -1;
@@ -589,7 +702,7 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
                                  "3D texturing, will fall back on 2D textures.");
         }
       }
-      else if (PRIVATE(this)->use3DTexturing(glue)) {
+      else if (PRIVATE(this)->use3DTexturing(action)) {
         rendermethod = SoVolumeRenderP::TEXTURE3D;
       }
     }
@@ -601,13 +714,17 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
   case LINEAR: interp = GL_LINEAR; break;
   default: assert(FALSE && "invalid value in interpolation field"); break;
   }
+  if (interacting) { interp = GL_NEAREST; }
 
   CvrGLInterpolationElement::set(state, interp);
 
   // viewport-aligned 3D textures
   if (rendermethod == SoVolumeRenderP::TEXTURE3D) {
 
-    const int numslices = PRIVATE(this)->calculateNrOf3DSlices(action, voxcubedims);
+    int numslices = PRIVATE(this)->calculateNrOf3DSlices(action, voxcubedims);
+    if (interacting && (numslices > 0)) {
+      numslices = SbMax(int(numslices * PRIVATE(this)->interactivequality), 1);
+    }
     if (numslices == 0) {
       return;
     }
@@ -624,11 +741,27 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
     default: assert(FALSE && "invalid value in composition field"); break;
     }
 
-    // FIXME: wouldn't it be better to push composition info onto the
-    // state stack instead? 20040715 mortene.
-    PRIVATE(this)->cubehandler->render(action, CvrCLUT::ALPHA_AS_IS, numslices, composit,
-                                       PRIVATE(this)->abortfunc,
-                                       PRIVATE(this)->abortfuncdata);
+    if (PRIVATE(this)->renderCachedImage(action, modelmatrix,
+                                         vbelement->getUnitDimensionsBox(),
+                                         rendermethod, numslices, interp,
+                                         interacting)) {
+      return;
+    }
+
+    // When capturing the image for the cache, the volume is rendered
+    // twice.
+    const int nrpasses = PRIVATE(this)->capturingimage ? 2 : 1;
+    for (int pass = 0; pass < nrpasses; pass++) {
+      if (pass > 0) { PRIVATE(this)->imagecache->nextCapturePass(action); }
+
+      // FIXME: wouldn't it be better to push composition info onto the
+      // state stack instead? 20040715 mortene.
+      PRIVATE(this)->cubehandler->render(action, CvrCLUT::ALPHA_AS_IS, numslices, composit,
+                                         PRIVATE(this)->abortfunc,
+                                         PRIVATE(this)->abortfuncdata);
+    }
+
+    if (PRIVATE(this)->capturingimage) { PRIVATE(this)->imagecache->endCapture(action); }
 
   }
   // axis-aligned 2D textures
@@ -637,7 +770,10 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
     // simply work with a unit cube:
     SoModelMatrixElement::scaleBy(state, this, SbVec3f(voxcubedims[0], voxcubedims[1], voxcubedims[2]));
 
-    const int numslices = PRIVATE(this)->calculateNrOf2DSlices(action, voxcubedims);
+    int numslices = PRIVATE(this)->calculateNrOf2DSlices(action, voxcubedims);
+    if (interacting && (numslices > 0)) {
+      numslices = SbMax(int(numslices * PRIVATE(this)->interactivequality), 1);
+    }
     if (numslices == 0) return;
 
     if (!PRIVATE(this)->pagehandler) {
@@ -652,11 +788,27 @@ SoVolumeRender::GLRender(SoGLRenderAction * action)
     default: assert(FALSE && "invalid value in composition field"); break;
     }
 
-    // FIXME: wouldn't it be better to push composition info onto the
-    // state stack instead? 20040715 mortene.
-    PRIVATE(this)->pagehandler->render(action, CvrCLUT::ALPHA_AS_IS, numslices, composit,
-                                       PRIVATE(this)->abortfunc,
-                                       PRIVATE(this)->abortfuncdata);
+    if (PRIVATE(this)->renderCachedImage(action, modelmatrix,
+                                         vbelement->getUnitDimensionsBox(),
+                                         rendermethod, numslices, interp,
+                                         interacting)) {
+      return;
+    }
+
+    // When capturing the image for the cache, the volume is rendered
+    // twice.
+    const int nrpasses = PRIVATE(this)->capturingimage ? 2 : 1;
+    for (int pass = 0; pass < nrpasses; pass++) {
+      if (pass > 0) { PRIVATE(this)->imagecache->nextCapturePass(action); }
+
+      // FIXME: wouldn't it be better to push composition info onto the
+      // state stack instead? 20040715 mortene.
+      PRIVATE(this)->pagehandler->render(action, CvrCLUT::ALPHA_AS_IS, numslices, composit,
+                                         PRIVATE(this)->abortfunc,
+                                         PRIVATE(this)->abortfuncdata);
+    }
+
+    if (PRIVATE(this)->capturingimage) { PRIVATE(this)->imagecache->endCapture(action); }
   }
   else {
     assert(FALSE && "Rendering method not implemented/supported.");
@@ -724,6 +876,37 @@ SoVolumeRender::computeBBox(SoAction * action, SbBox3f & box, SbVec3f & center)
   const SbBox3f & vdbox = vbelem->getUnitDimensionsBox();
   if (vdbox.isEmpty()) { return; }
 
+  // With a region of interest, only the selected boxes count.
+  const int roiidx = CvrROIElement::getClassStackIndex();
+  const CvrROIElement * roielem = state->isElementEnabled(roiidx) ?
+    CvrROIElement::getInstance(state) : NULL;
+  if (roielem && roielem->isEnabled()) {
+    const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+    SbList<SbBox3s> selection;
+    roielem->getSelection(dims, selection);
+
+    const SbVec3f & vdmin = vdbox.getMin();
+    const SbVec3f voxelsize((vdbox.getMax()[0] - vdmin[0]) / dims[0],
+                            (vdbox.getMax()[1] - vdmin[1]) / dims[1],
+                            (vdbox.getMax()[2] - vdmin[2]) / dims[2]);
+    SbBox3f roibox;
+    for (int i = 0; i < selection.getLength(); i++) {
+      const SbVec3s & smin = selection[i].getMin();
+      const SbVec3s & smax = selection[i].getMax();
+      for (int c = 0; c < 2; c++) {
+        const SbVec3s & s = c ? smax : smin;
+        roibox.extendBy(SbVec3f(vdmin[0] + (s[0] + c) * voxelsize[0],
+                                vdmin[1] + (s[1] + c) * voxelsize[1],
+                                vdmin[2] + (s[2] + c) * voxelsize[2]));
+      }
+    }
+    if (roibox.isEmpty()) { return; }
+
+    box.extendBy(roibox);
+    center = roibox.getCenter();
+    return;
+  }
+
   box.extendBy(vdbox);
   center = vdbox.getCenter();
 }
@@ -780,6 +963,175 @@ SoVolumeRender::setAbortCallback(SoVolumeRenderAbortCB * func, void * userdata)
   PRIVATE(this)->abortfuncdata = userdata;
 }
 
+/*!
+  \typedef void SoVolumeRender::SoVolumeRenderTimeBudgetCB(int numslices, float frametime, void * userdata)
+
+  The function signature for callback function pointers to be passed
+  in to SoVolumeRender::setTimeBudgetCallback().
+
+  \a numslices is the number of slices that was chosen for the frame
+  about to be rendered.
+
+  \a frametime is the (smoothed) measured time between frames, in
+  seconds, which the choice was based on. It will be negative if no
+  measurement has been made yet.
+
+  \a userdata is the second argument given to
+  SoVolumeRender::setTimeBudgetCallback() when the callback was set
+  up.
+
+  \since SIM Voleon 2.1
+*/
+
+/*!
+  Set a callback function which will be invoked for every frame
+  rendered when SoVolumeRender::numSlicesControl is
+  SoVolumeRender::TIME_BUDGET, reporting the number of slices chosen
+  to meet SoVolumeRender::frameTimeBudget.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRender::setTimeBudgetCallback(SoVolumeRenderTimeBudgetCB * func, void * userdata)
+{
+  PRIVATE(this)->budgetfunc = func;
+  PRIVATE(this)->budgetfuncdata = userdata;
+}
+
+/*!
+  Set the quality to use while the user is interacting with the
+  scene, as a fraction of the number of slices otherwise rendered.
+
+  While interacting, the volume will be rendered with \a
+  slicefraction times as many slices as usual, and with
+  SoVolumeRender::NEAREST interpolation. This is useful to keep the
+  frame rate up while e.g. rotating large volumes.
+
+  Interaction is detected automatically as changes to the camera
+  position or projection from one frame to the next, and can also be
+  signalled by the application with SoVolumeRender::setInteracting().
+
+  When the interaction stops, one more rendering will be triggered
+  to refine the image to full quality. If the application sets up an
+  abort callback with SoVolumeRender::setAbortCallback(), it can
+  abort this refinement pass by checking for user input and
+  returning SoVolumeRender::ABORT.
+
+  The default value is 1.0, which means that the quality is not
+  reduced during interaction.
+
+  Reduced quality rendering is never used when
+  SoVolumeRendering::getBatchRendering() is \c TRUE.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRender::setInteractiveQuality(float slicefraction)
+{
+  PRIVATE(this)->interactivequality = SbMin(SbMax(slicefraction, 0.0f), 1.0f);
+}
+
+/*!
+  Returns the value set with SoVolumeRender::setInteractiveQuality().
+
+  \since SIM Voleon 2.1
+*/
+float
+SoVolumeRender::getInteractiveQuality(void) const
+{
+  return PRIVATE(this)->interactivequality;
+}
+
+/*!
+  Tell the node that the user is interacting with the scene, in
+  addition to the automatic detection of camera movement. This can
+  for instance be hooked up to the start and finish callbacks of a
+  viewer.
+
+  When set back to \c FALSE, a refinement pass at full quality will
+  be triggered.
+
+  \sa SoVolumeRender::setInteractiveQuality()
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRender::setInteracting(SbBool flag)
+{
+  const SbBool refine = PRIVATE(this)->userinteracting && !flag;
+  PRIVATE(this)->userinteracting = flag;
+  if (refine) { this->touch(); }
+}
+
+/*!
+  Returns \c TRUE if the last rendering of the node was done with
+  reduced quality because of interaction.
+
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeRender::isInteracting(void) const
+{
+  return PRIVATE(this)->interacting;
+}
+
+/*!
+  Set whether or not the composited image of the volume should be
+  kept, to be reused in later frames where nothing about the volume,
+  the transfer function, the render settings or the camera has
+  changed.
+
+  This is useful for applications which redraw often for changes to
+  other geometry in the scene, like cursors and other overlays. With
+  image caching on, such redraws will only need to draw one textured
+  quad for the volume, instead of slicing and compositing it again.
+
+  When the same settings have been used for two frames in a row, the
+  volume is rendered twice in the next frame to capture the image,
+  on black and on white background, so colors and transparency can
+  be extracted. The image is then drawn for later frames, at the
+  depth of the front of the volume's bounding box.
+
+  Some limitations apply: image caching is only done for
+  SoVolumeRender::ALPHA_BLENDING composition, and not while the user
+  is interacting (see SoVolumeRender::setInteractiveQuality()) or
+  when an abort callback has been set. Geometry that intersects the
+  volume should not move while the cached image is in use, as it
+  will not be seen through the volume. The cached image is captured
+  again when the camera, this node's fields, the volume data, the
+  transfer function, clip planes, the region of interest or the
+  number of slices (which follows SoComplexity::value) change.
+
+  With SoVolumeRender::TIME_BUDGET slice control, the number of
+  slices is not adjusted for the frames drawn from the cached image.
+
+  Image caching is off by default.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRender::setImageCaching(SbBool flag)
+{
+  if (!flag && PRIVATE(this)->imagecache) {
+    delete PRIVATE(this)->imagecache;
+    PRIVATE(this)->imagecache = NULL;
+  }
+  else if (flag && !PRIVATE(this)->imagecache) {
+    PRIVATE(this)->imagecache = new CvrImageCache;
+  }
+}
+
+/*!
+  Returns whether or not image caching is on.
+
+  \sa SoVolumeRender::setImageCaching()
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeRender::getImageCaching(void) const
+{
+  return PRIVATE(this)->imagecache ? TRUE : FALSE;
+}
+
 // Will render the intersection lines for all ray picks attempted so
 // far. For debugging purposes only.
 void
@@ -926,22 +1278,84 @@ SoVolumeRenderP::render3DTexturedTriangles(const cc_glglue *, void *)
   SoVolumeRenderP::renderTexturedTriangles(GL_TEXTURE_3D);
 }
 
+// Look up the result of an earlier probe for the given driver in
+// the file set with the CVR_3D_TEXTURE_PROBE_CACHE environment
+// variable. Each line of the file has the format
+// "<0|1>\t<GL_RENDERER>\t<GL_VERSION>".
+static SoVolumeRendering::HW_SupportStatus
+cvr_read_probe_cache(const char * renderer, const char * version)
+{
+  const char * filename = coin_getenv("CVR_3D_TEXTURE_PROBE_CACHE");
+  if (filename == NULL) { return SoVolumeRendering::UNKNOWN; }
+
+  FILE * f = fopen(filename, "r");
+  if (f == NULL) { return SoVolumeRendering::UNKNOWN; }
+
+  SoVolumeRendering::HW_SupportStatus status = SoVolumeRendering::UNKNOWN;
+  SbString match;
+  match.sprintf("\t%s\t%s\n", renderer, version);
+
+  char line[1024];
+  while ((status == SoVolumeRendering::UNKNOWN) &&
+         (fgets(line, sizeof(line), f) != NULL)) {
+    if ((line[0] == '0' || line[0] == '1') &&
+        (strcmp(line + 1, match.getString()) == 0)) {
+      status = (line[0] == '1') ? SoVolumeRendering::YES : SoVolumeRendering::NO;
+    }
+  }
+
+  (void)fclose(f);
+  return status;
+}
+
+// Append a probe result to the cache file, if any.
+static void
+cvr_write_probe_cache(const char * renderer, const char * version, SbBool result)
+{
+  const char * filename = coin_getenv("CVR_3D_TEXTURE_PROBE_CACHE");
+  if (filename == NULL) { return; }
+
+  FILE * f = fopen(filename, "a");
+  if (f == NULL) {
+    SoDebugError::postWarning("SoVolumeRenderP::use3DTexturing",
+                              "could not open '%s' for writing", filename);
+    return;
+  }
+
+  (void)fprintf(f, "%d\t%s\t%s\n", result ? 1 : 0, renderer, version);
+  (void)fclose(f);
+}
+
 SbBool
-SoVolumeRenderP::use3DTexturing(const cc_glglue * glglue) const
+SoVolumeRenderP::use3DTexturing(SoGLRenderAction * action) const
 {
-  // This check should only be done once.
-  //
-  // FIXME: not correct -- it should be done once for each new GL
-  // context that we need to render in. 20040716 mortene.
-  static int do3dtextures = -1;
+  // The check is done once for each GL context (or share group), and
+  // can also be set up front by the application.
+  const uint32_t ctxid = action->getCacheContext();
+  SoVolumeRendering::HW_SupportStatus status =
+    SoVolumeRendering::get3DTextureAcceleration(ctxid);
+
+  if (status == SoVolumeRendering::UNKNOWN) {
+    // In batch mode, we want the same choice to be made on every run,
+    // so don't depend on timing. 3D texturing is then always used
+    // when available, as it gives the best quality.
+    if (SoVolumeRendering::getBatchRendering()) { return TRUE; }
+
+    const cc_glglue * glglue = cc_glglue_instance(ctxid);
+    status = SoVolumeRenderP::probe3DTextureAcceleration(glglue) ?
+      SoVolumeRendering::YES : SoVolumeRendering::NO;
+    SoVolumeRendering::set3DTextureAcceleration(ctxid, status);
+  }
 
-  if (do3dtextures == 1) return TRUE;
-  else if (do3dtextures == 0) return FALSE;
+  return (status == SoVolumeRendering::YES) ? TRUE : FALSE;
+}
 
+SbBool
+SoVolumeRenderP::probe3DTextureAcceleration(const cc_glglue * glglue)
+{
   // Shall we force 3D texturing?
   const char * envstr = coin_getenv("CVR_FORCE_3D_TEXTURES");
   if (envstr && (atoi(envstr) > 0)) {
-    do3dtextures = 1;
     return TRUE;
   }
 
@@ -951,13 +1365,12 @@ SoVolumeRenderP::use3DTexturing(const cc_glglue * glglue) const
   envstr = coin_getenv("CVR_NO_3D_ACCELERATION_CHECKLISTS");
   const SbBool skiptests = (envstr && (atoi(envstr) > 0)) ? TRUE : FALSE;
 
-  static const GLubyte * rendererstring = glGetString(GL_RENDERER);
+  const GLubyte * rendererstring = glGetString(GL_RENDERER);
   unsigned int i=0;
   while (!skiptests && texture3d_in_hardware[i]) {
     const char * loc = strstr((const char *)rendererstring,
                               texture3d_in_hardware[i++]);
     if (loc != NULL) {
-      do3dtextures = 1;
       if (CvrUtil::doDebugging()) {
         SoDebugError::postInfo("SoVolumeRenderP::use3DTexturing",
                                "Your OpenGL driver and graphics card "
@@ -986,11 +1399,18 @@ SoVolumeRenderP::use3DTexturing(const cc_glglue * glglue) const
                              "(If you wish to force 3D texturing, set the "
                              "envvar CVR_FORCE_3D_TEXTURES=1).",
                              rendererstring);
-      do3dtextures = 0;
       return FALSE;
     }
   }
 
+  // The performance test takes a noticeable amount of time, so the
+  // result can be stored from run to run.
+  const char * versionstring = (const char *)glGetString(GL_VERSION);
+  const SoVolumeRendering::HW_SupportStatus cached =
+    cvr_read_probe_cache((const char *)rendererstring, versionstring);
+  if (cached != SoVolumeRendering::UNKNOWN) {
+    return (cached == SoVolumeRendering::YES) ? TRUE : FALSE;
+  }
 
   // FIXME: The performance test should be properly tested on many
   // different GFX cards to see if the rating threshold is high enough
@@ -1018,12 +1438,12 @@ SoVolumeRenderP::use3DTexturing(const cc_glglue * glglue) const
                            timings[1], timings[0], rating,
                            t.getValue());
   }
-    
-  if (rating < 10.0f) { // 2D should at least be this many times
-                        // faster before 3D texturing is dropped.
-    do3dtextures = 1;
-    return TRUE;
-  }
+
+  // 2D should at least be this many times faster before 3D texturing
+  // is dropped.
+  const SbBool use3d = (rating < 10.0f) ? TRUE : FALSE;
+  cvr_write_probe_cache((const char *)rendererstring, versionstring, use3d);
+  if (use3d) { return TRUE; }
 
   if (CvrUtil::doDebugging()) {
     SoDebugError::postInfo("SoVolumeRenderP::use3DTexturing",
@@ -1034,22 +1454,233 @@ SoVolumeRenderP::use3DTexturing(const cc_glglue * glglue) const
                            "envvar CVR_FORCE_3D_TEXTURES=1)");
   }
 
-  do3dtextures = 0;
   return FALSE;
 }
 
+// Returns the value of the numSlicesControl field, adjusted for the
+// special cases where another strategy should be used.
+int
+SoVolumeRenderP::getNumSlicesControl(void) const
+{
+  const int control = PUBLIC(this)->numSlicesControl.getValue();
+
+  if (control == SoVolumeRender::TIME_BUDGET) {
+    // Timings are meaningless when rendering offscreen in batch
+    // mode, and we should render in full quality anyway.
+    if (SoVolumeRendering::getBatchRendering()) { return SoVolumeRender::ALL; }
+    return control;
+  }
+
+  if (PUBLIC(this)->numSlices.getValue() <= 0) { return SoVolumeRender::ALL; }
+  return control;
+}
+
+// Measure the time since the last frame, and adjust the fraction of
+// slices to render accordingly.
+void
+SoVolumeRenderP::updateTimeBudget(void)
+{
+  const SbTime now = SbTime::getTimeOfDay();
+  const double interval = (now - this->lastframe).getValue();
+  this->lastframe = now;
+
+  // The number of slices is part of the image cache key, so
+  // adjusting it after fast frames from the cache would make the
+  // cache miss again.
+  if (this->imagecacheframe) {
+    this->imagecacheframe = FALSE;
+    return;
+  }
+
+  const double budget = PUBLIC(this)->frameTimeBudget.getValue();
+  if (budget <= 0.0) { return; }
+
+  // A long interval means there was a pause in the redrawing, which
+  // says nothing about the rendering performance.
+  if (interval > (budget * 5.0)) { return; }
+
+  // Smooth the measurements, so single spikes don't cause large
+  // changes.
+  if (this->frametime < 0.0) { this->frametime = interval; }
+  else { this->frametime = this->frametime * 0.75 + interval * 0.25; }
+
+  if (this->frametime > (budget * 1.1)) {
+    // Reduce quickly, but not by more than half at a time.
+    this->budgetfactor *= float(SbMax(budget / this->frametime, 0.5));
+  }
+  else if (this->frametime < (budget * 0.8)) {
+    // Increase slowly, to not overshoot.
+    this->budgetfactor *= 1.1f;
+  }
+
+  this->budgetfactor = SbMin(SbMax(this->budgetfactor, 0.01f), 1.0f);
+}
+
+// Find out whether or not the camera has moved since the last
+// rendering in the same context, and if so, schedule a refinement
+// pass at full quality.
+SbBool
+SoVolumeRenderP::checkInteraction(SoGLRenderAction * action)
+{
+  this->interacting = FALSE;
+  if ((this->interactivequality >= 1.0f) ||
+      SoVolumeRendering::getBatchRendering()) {
+    return FALSE;
+  }
+
+  SoState * state = action->getState();
+  const uint32_t ctxid = action->getCacheContext();
+  const SbMatrix & viewmatrix = SoViewingMatrixElement::get(state);
+  const SbMatrix & projmatrix = SoProjectionMatrixElement::get(state);
+
+  int i;
+  for (i = 0; i < this->camerastates.getLength(); i++) {
+    if (this->camerastates[i].context == ctxid) { break; }
+  }
+
+  if (i == this->camerastates.getLength()) {
+    CameraState cs;
+    cs.context = ctxid;
+    cs.viewmatrix = viewmatrix;
+    cs.projmatrix = projmatrix;
+    this->camerastates.append(cs);
+  }
+  else {
+    CameraState & cs = this->camerastates[i];
+    if ((cs.viewmatrix != viewmatrix) || (cs.projmatrix != projmatrix)) {
+      this->interacting = TRUE;
+      cs.viewmatrix = viewmatrix;
+      cs.projmatrix = projmatrix;
+    }
+  }
+
+  if (this->userinteracting) { this->interacting = TRUE; }
+
+  if (this->interacting) {
+    // Will be rescheduled as long as the interaction goes on.
+    if (this->refinesensor->isScheduled()) { this->refinesensor->unschedule(); }
+    this->refinesensor->setTimeFromNow(SbTime(0.25));
+    this->refinesensor->schedule();
+  }
+
+  return this->interacting;
+}
+
+// Renders the cached image of the volume and returns TRUE if it can
+// be used. If not, checks if the image should be captured while
+// rendering this frame.
+SbBool
+SoVolumeRenderP::renderCachedImage(SoGLRenderAction * action,
+                                   const SbMatrix & modelmatrix,
+                                   const SbBox3f & box,
+                                   int rendermethod, unsigned int numslices,
+                                   GLenum interp, SbBool interacting)
+{
+  this->capturingimage = FALSE;
+  if (this->imagecache == NULL) { return FALSE; }
+
+  if (interacting || (this->abortfunc != NULL) ||
+      (PUBLIC(this)->composition.getValue() != SoVolumeRender::ALPHA_BLENDING)) {
+    this->imagecache->invalidate();
+    return FALSE;
+  }
+
+  SoState * state = action->getState();
+  const SoTransferFunction * transferfunction =
+    SoTransferFunctionElement::getInstance(state)->getTransferFunction();
+
+  // Anything besides the camera and model transform which influences
+  // the rendering. The node ids change when fields are modified.
+  SbList<uint32_t> settings;
+  settings.append(PUBLIC(this)->getNodeId());
+  settings.append(CvrVoxelBlockElement::getInstance(state)->getNodeId());
+  settings.append(transferfunction->getNodeId());
+  settings.append((uint32_t)rendermethod);
+  settings.append((uint32_t)numslices);
+  settings.append((uint32_t)interp);
+  // (The lighting settings are fields of this node, and SoComplexity
+  // only influences the number of slices, so they are covered above.)
+
+  const SoClipPlaneElement * clipelem = SoClipPlaneElement::getInstance(state);
+  for (int i = 0; i < clipelem->getNum(); i++) {
+    const SbPlane & plane = clipelem->get(i);
+    const float values[4] = {
+      plane.getNormal()[0], plane.getNormal()[1], plane.getNormal()[2],
+      plane.getDistanceFromOrigin()
+    };
+    for (unsigned int j = 0; j < 4; j++) {
+      uint32_t bits;
+      (void)memcpy(&bits, &values[j], sizeof(uint32_t));
+      settings.append(bits);
+    }
+  }
+
+  const CvrROIElement * roielem = CvrROIElement::getInstance(state);
+  if (roielem->isEnabled()) {
+    SbList<SbBox3s> roiboxes;
+    roielem->getSelection(CvrVoxelBlockElement::getInstance(state)->getVoxelCubeDimensions(),
+                          roiboxes);
+    for (int i = 0; i < roiboxes.getLength(); i++) {
+      const SbVec3s & bmin = roiboxes[i].getMin();
+      const SbVec3s & bmax = roiboxes[i].getMax();
+      for (unsigned int j = 0; j < 3; j++) {
+        settings.append((uint32_t)bmin[j]);
+        settings.append((uint32_t)bmax[j]);
+      }
+    }
+  }
+
+  if (this->imagecache->lookup(action, modelmatrix, box, settings)) {
+    this->imagecache->render(action);
+    this->imagecacheframe = TRUE;
+    return TRUE;
+  }
+
+  if (this->imagecache->shouldCapture()) {
+    this->imagecache->beginCapture(action);
+    this->capturingimage = TRUE;
+    this->imagecacheframe = TRUE;
+  }
+  return FALSE;
+}
+
+void
+SoVolumeRenderP::refineCB(void * closure, SoSensor * sensor)
+{
+  SoVolumeRenderP * thisp = (SoVolumeRenderP *)closure;
+  // Rendering again with the same camera will be at full quality.
+  if (!thisp->userinteracting) { PUBLIC(thisp)->touch(); }
+}
+
+// Returns the number of slices to render with the TIME_BUDGET
+// strategy, given the number which would be rendered with ALL.
+unsigned int
+SoVolumeRenderP::applyTimeBudget(unsigned int allslices)
+{
+  const unsigned int numslices =
+    SbMax((unsigned int)(allslices * this->budgetfactor), 1u);
+
+  if (this->budgetfunc) {
+    this->budgetfunc(numslices, float(this->frametime), this->budgetfuncdata);
+  }
+
+  return numslices;
+}
+
 unsigned int
 SoVolumeRenderP::calculateNrOf2DSlices(SoGLRenderAction * action,
                                        const SbVec3s & dimensions)
 {
   int numslices = 0;
-  const int control = PUBLIC(this)->numSlicesControl.getValue();
+  const int control = this->getNumSlicesControl();
   const unsigned int AXISIDX = this->pagehandler->getCurrentAxis(action);
 
-  if ((control == SoVolumeRender::ALL) ||
-      (PUBLIC(this)->numSlices.getValue() <= 0)) {
+  if (control == SoVolumeRender::ALL) {
     numslices = dimensions[AXISIDX];
   }
+  else if (control == SoVolumeRender::TIME_BUDGET) {
+    numslices = this->applyTimeBudget(dimensions[AXISIDX]);
+  }
   else if (control == SoVolumeRender::MANUAL) {
     numslices = PUBLIC(this)->numSlices.getValue();
   }
@@ -1075,16 +1706,20 @@ SoVolumeRenderP::calculateNrOf3DSlices(SoGLRenderAction * action,
                                        const SbVec3s & dimensions)
 {
   int numslices = 0;
-  const int control = PUBLIC(this)->numSlicesControl.getValue();
+  const int control = this->getNumSlicesControl();
   const float complexity = PUBLIC(this)->getComplexityValue(action);
 
   if ((control == SoVolumeRender::ALL) ||
-      (PUBLIC(this)->numSlices.getValue() <= 0)) {
+      (control == SoVolumeRender::TIME_BUDGET)) {
     // 'Applying' the Nyquist theorem
     numslices = (unsigned int) sqrt(double(dimensions[0]*dimensions[0] +
                                            dimensions[1]*dimensions[1] +
                                            dimensions[2]*dimensions[2])) * 2;
     numslices = int(complexity * 2.0f * numslices);
+
+    if (control == SoVolumeRender::TIME_BUDGET) {
+      numslices = this->applyTimeBudget(numslices);
+    }
   }
   else if (control == SoVolumeRender::MANUAL) {
     numslices = PUBLIC(this)->numSlices.getValue() + 1;
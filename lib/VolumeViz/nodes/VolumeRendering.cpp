@@ -251,12 +251,49 @@
   distinguishing features in that regard. We duplicate this design
   flaw for the sake of being compatible with code written for the TGS
   VolumeViz extension library.
+
+  <b>Offscreen batch rendering:</b>
+
+  Volumes can be rendered without a window, e.g. for making
+  thumbnails or report images on a server, by using Coin's
+  SoOffscreenRenderer. This also works on systems without a graphics
+  card, with Mesa's software OpenGL implementation (which has full
+  support for 3D textures).
+
+  For such use, SoVolumeRendering::setBatchRendering() should be
+  called with \c TRUE before anything is rendered. The library will
+  then not run its startup performance test of the graphics card, and
+  the choice of rendering method will depend only on the
+  capabilities of the OpenGL driver, making output reproducible from
+  run to run.
+
+  To render many camera views or time steps, keep a single
+  SoOffscreenRenderer instance around and render the same scene
+  graph with it repeatedly. Textures, lookup tables and other
+  resources are kept per OpenGL context, so they will then be reused
+  from frame to frame as long as the volume data and transfer
+  function are unchanged:
+
+  \code
+  SoOffscreenRenderer * renderer =
+    new SoOffscreenRenderer(SbViewportRegion(512, 512));
+  for (int i=0; i < nrviews; i++) {
+    camera->position = viewpositions[i];
+    camera->pointAt(SbVec3f(0, 0, 0));
+    renderer->render(root);
+    renderer->writeToRGB(filenames[i]);
+  }
+  delete renderer;
+  \endcode
 */
 
 // *************************************************************************
 
 #include <VolumeViz/nodes/SoVolumeRendering.h>
 
+#include <stdlib.h>
+
+#include <Inventor/C/tidbits.h>
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/errors/SoDebugError.h>
 
@@ -270,11 +307,15 @@
 #include <VolumeViz/elements/CvrPageSizeElement.h>
 #include <VolumeViz/elements/CvrPalettedTexturesElement.h>
 #include <VolumeViz/elements/CvrStorageHintElement.h>
+#include <VolumeViz/elements/CvrPickProfileElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/CvrLightingElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
+#include <VolumeViz/nodes/SoMultiSlice.h>
 #include <VolumeViz/nodes/SoObliqueSlice.h>
 #include <VolumeViz/nodes/SoOrthoSlice.h>
+#include <VolumeViz/nodes/SoROI.h>
 #include <VolumeViz/nodes/SoTransferFunction.h>
 #include <VolumeViz/nodes/SoVolumeData.h>
 #include <VolumeViz/nodes/SoVolumeFaceSet.h>
@@ -284,7 +325,10 @@
 #include <VolumeViz/nodes/SoVolumeSkin.h>
 #include <VolumeViz/nodes/SoVolumeTriangleStripSet.h>
 #include <VolumeViz/render/common/CvrTextureObject.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrResourceManager.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
+#include <VolumeViz/misc/CvrVoxelChunk.h>
 
 // *************************************************************************
 
@@ -295,9 +339,11 @@ SO_NODE_ABSTRACT_SOURCE(SoVolumeRendering);
 class SoVolumeRenderingP {
 public:
   static SbBool wasinitialized;
+  static int batchrendering;
 };
 
 SbBool SoVolumeRenderingP::wasinitialized = FALSE;
+int SoVolumeRenderingP::batchrendering = -1;
 
 #define PRIVATE(p) (p->pimpl)
 #define PUBLIC(p) (p->master)
@@ -331,7 +377,13 @@ SoVolumeRendering::init(void)
   if (SoVolumeRenderingP::wasinitialized) return;
   SoVolumeRenderingP::wasinitialized = TRUE;
 
-  CvrGlobalRenderLock::init();
+  // The locks and caches shared between render threads are set up
+  // up front, so their creation needs no locking. They are kept until
+  // the process exits.
+  CvrVolumeRenderLock::init();
+  CvrResourceManager::initClass();
+  CvrCLUT::initClass();
+  CvrVoxelChunk::initClass();
 
   SoTransferFunctionElement::initClass();
   CvrCompressedTexturesElement::initClass();
@@ -339,16 +391,20 @@ SoVolumeRendering::init(void)
   CvrPageSizeElement::initClass();
   CvrPalettedTexturesElement::initClass();
   CvrStorageHintElement::initClass();
+  CvrPickProfileElement::initClass();
   CvrVoxelBlockElement::initClass();
   CvrLightingElement::initClass();
+  CvrROIElement::initClass();
 
   SoVolumeRendering::initClass();
   SoVolumeData::initClass();
   SoTransferFunction::initClass();
+  SoROI::initClass();
 
   SoVolumeRender::initClass();
   SoOrthoSlice::initClass();
   SoObliqueSlice::initClass();
+  SoMultiSlice::initClass();
   SoVolumeSkin::initClass();
 
   SoVolumeFaceSet::initClass();
@@ -537,3 +593,142 @@ SoVolumeRendering::getDelayedRendering(void)
 }
 
 // *************************************************************************
+
+/*!
+  Declare that the OpenGL context with cache context id \a
+  cachecontext shares its display lists and texture objects with the
+  context of \a sharecachecontext (i.e. that they are in the same
+  OpenGL "share group").
+
+  Volume textures, transfer function lookup tables and other OpenGL
+  resources will then be made only once for all the contexts in the
+  group, instead of once per context. For applications with several
+  views of the same volume, this saves both texture memory and upload
+  time in proportion to the number of views.
+
+  There is no portable way of detecting context sharing from the
+  OpenGL context itself, which is why the application must tell the
+  library about it. The cache context ids are those set with
+  SoGLRenderAction::setCacheContext() (usually done by the GUI
+  binding's viewer classes).
+
+  This must be called before anything has been rendered in \a
+  cachecontext.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRendering::setContextSharing(uint32_t cachecontext, uint32_t sharecachecontext)
+{
+  CvrResourceManager::setShareGroup(cachecontext, sharecachecontext);
+}
+
+// *************************************************************************
+
+/*!
+  Set whether or not volumes will be rendered in "batch mode", i.e.
+  non-interactively to offscreen buffers. See the class documentation
+  for a description of offscreen batch rendering.
+
+  When \c TRUE, the choice between 2D and 3D texture based
+  rendering is made solely from the capabilities of the OpenGL driver,
+  without the otherwise used performance test, so the same method
+  will be selected every time.
+
+  The default value is \c FALSE, unless the environment variable \c
+  CVR_BATCH_RENDERING is set to a positive value.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRendering::setBatchRendering(SbBool flag)
+{
+  SoVolumeRenderingP::batchrendering = flag ? 1 : 0;
+}
+
+/*!
+  Returns value of the batch rendering flag.
+
+  \sa SoVolumeRendering::setBatchRendering()
+  \since SIM Voleon 2.1
+*/
+SbBool
+SoVolumeRendering::getBatchRendering(void)
+{
+  if (SoVolumeRenderingP::batchrendering == -1) {
+    const char * env = coin_getenv("CVR_BATCH_RENDERING");
+    SoVolumeRenderingP::batchrendering = env && (atoi(env) > 0);
+  }
+  return SoVolumeRenderingP::batchrendering ? TRUE : FALSE;
+}
+
+// *************************************************************************
+
+// Key for the per-context result of the 3D texturing check. Only the
+// address of this is used.
+static const char CVR_3DTEXTURE_STATUS_KEYID[] = "3dtexturestatus";
+
+/*!
+  Returns whether or not volumes are rendered with 3D textures in the
+  OpenGL context \a cachecontext, as decided by the check run
+  upon the first rendering of an SoVolumeRender node in that context,
+  or as set with SoVolumeRendering::set3DTextureAcceleration().
+
+  Returns \c UNKNOWN if nothing has been rendered in the context yet.
+
+  \since SIM Voleon 2.1
+*/
+SoVolumeRendering::HW_SupportStatus
+SoVolumeRendering::get3DTextureAcceleration(uint32_t cachecontext)
+{
+  // (Must not set up a resource manager for the context, as that
+  // would stop SoVolumeRendering::setContextSharing() from working.)
+  CvrResourceManager * rm = CvrResourceManager::findInstance(cachecontext);
+  void * status;
+  if ((rm == NULL) || !rm->get(CVR_3DTEXTURE_STATUS_KEYID, status)) {
+    return SoVolumeRendering::UNKNOWN;
+  }
+  return (HW_SupportStatus)((unsigned long)status);
+}
+
+/*!
+  Decide whether or not volumes shall be rendered with 3D textures in
+  the OpenGL context \a cachecontext, overriding the check which is
+  otherwise made.
+
+  The check involves a short performance test of 2D versus 3D
+  texturing, run once per context (or per share group, see
+  SoVolumeRendering::setContextSharing()). For applications opening
+  many contexts on known hardware, setting the status up front avoids
+  the test altogether.
+
+  The result of the performance test can also be stored from one run
+  to the next, by setting the environment variable \c
+  CVR_3D_TEXTURE_PROBE_CACHE to the name of a file. Results are kept
+  in that file per \c GL_RENDERER and \c GL_VERSION string, so a
+  driver upgrade will cause a new test to be run.
+
+  Setting \c UNKNOWN will cause the check to be run again upon the
+  next rendering.
+
+  \since SIM Voleon 2.1
+*/
+void
+SoVolumeRendering::set3DTextureAcceleration(uint32_t cachecontext, HW_SupportStatus status)
+{
+  // (Clearing the status shouldn't set up a resource manager.)
+  CvrResourceManager * rm = (status == SoVolumeRendering::UNKNOWN) ?
+    CvrResourceManager::findInstance(cachecontext) :
+    CvrResourceManager::getInstance(cachecontext);
+  if (rm == NULL) { return; }
+
+  void * dummy;
+  if (rm->get(CVR_3DTEXTURE_STATUS_KEYID, dummy)) {
+    rm->remove(CVR_3DTEXTURE_STATUS_KEYID);
+  }
+  if (status != SoVolumeRendering::UNKNOWN) {
+    rm->set(CVR_3DTEXTURE_STATUS_KEYID, (void *)((unsigned long)status), NULL, NULL);
+  }
+}
+
+// *************************************************************************
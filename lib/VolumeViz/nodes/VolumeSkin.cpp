@@ -40,11 +40,20 @@
   This can be useful as a very efficient way of visualizing a complete
   opaque volume, only seen from the outside.
 
+  Only the sides facing the camera are rendered, and only the texture
+  data for the sides are built: from the 3D texture bricks along the
+  boundary of the volume when 3D texturing is in use, and otherwise
+  from one 2D texture page per side.
+
+  If a preceding SoROI node selects a sub-volume, the sides of the
+  selected region are rendered instead.
+
   Note that if the transfer function set by a preceding
   SoTransferFunction node contains transparency, the visual appearance
-  to the end user will probably not look correct.
+  to the end user will probably not look correct, as the sides facing
+  away from the camera are not rendered.
 
-  \sa SoVolumeRender, SoTransferFunction, SoOrthoSlice
+  \sa SoVolumeRender, SoTransferFunction, SoOrthoSlice, SoROI
 
   \since SIM Voleon 2.0
 */
@@ -52,19 +61,36 @@
 // *************************************************************************
 
 
-#include <Inventor/actions/SoGLRenderAction.h>
-#include <Inventor/errors/SoDebugError.h>
-#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/C/glue/gl.h>
+#include <Inventor/SbBox3s.h>
 #include <Inventor/SbLinear.h>
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/elements/SoLazyElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/errors/SoDebugError.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
 
+#include <VolumeViz/elements/CvrGLInterpolationElement.h>
+#include <VolumeViz/elements/CvrPageSizeElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
+#include <VolumeViz/elements/CvrStorageHintElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
-#include <VolumeViz/nodes/SoOrthoSlice.h>
+#include <VolumeViz/elements/SoTransferFunctionElement.h>
+#include <VolumeViz/nodes/SoVolumeData.h>
+#include <VolumeViz/nodes/SoVolumeRendering.h>
 #include <VolumeViz/nodes/SoVolumeSkin.h>
 #include <VolumeViz/details/SoVolumeSkinDetail.h>
+#include <VolumeViz/render/2D/Cvr2DTexPage.h>
+#include <VolumeViz/render/3D/CvrCubeHandler.h>
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrUtil.h>
-#include <VolumeViz/misc/CvrGlobalRenderLock.h>
+#include <VolumeViz/misc/CvrVoxelChunk.h>
+#include <VolumeViz/misc/CvrVolumeRenderLock.h>
 
 #include "volumeraypickintersection.h"
 
@@ -74,8 +100,11 @@ SO_NODE_SOURCE(SoVolumeSkin);
 
 // *************************************************************************
 
-struct slicestruct {
-  SoOrthoSlice * slice;
+// One side of the volume, or of a box selected by an SoROI node.
+struct skinface {
+  int axis;
+  int slice;
+  SbBox3s region;
   float distance;
 };
 
@@ -84,31 +113,42 @@ public:
   SoVolumeSkinP(SoVolumeSkin * master)
   {
     this->master = master;
-    this->initialized = FALSE;
+    this->cubehandler = NULL;
   }
   ~SoVolumeSkinP()
   {
-    if (this->initialized) {
-      for (int i=0;i<6;++i) 
-        this->cubesides[i].slice->unref();    
-      delete this->cubesides;
+    delete this->cubehandler;
+    for (int i = 0; i < this->cachedpages.getLength(); i++) {
+      delete this->cachedpages[i].page;
     }
   }
 
-  void buildSkinCube(SoGLRenderAction * action);
-  void sortCubeSides(SoGLRenderAction * action);
-  void renderSkinCube(SoGLRenderAction * action, 
-                      enum SoVolumeSkin::Interpolation interpolation);
-
-  slicestruct * cubesides;
-  SoVolumeSkin::Interpolation interpolation;
-  SbBool initialized;
+  void findVisibleFaces(SoGLRenderAction * action, SbList<skinface> & faces);
+  SbBool use3DTexturing(SoGLRenderAction * action) const;
+  void render3D(SoGLRenderAction * action, const SbList<skinface> & faces);
+  void render2D(SoGLRenderAction * action, const SbList<skinface> & faces);
+  Cvr2DTexPage * getPage(const SoGLRenderAction * action, const int axis, const int slice);
+
+  CvrCubeHandler * cubehandler;
+
+  // One page for each side of the volume, when rendering without 3D
+  // textures. Pages are only built for sides which have been seen,
+  // and are kept until the sides move (i.e. the volume or region of
+  // interest changes).
+  struct CachedPage {
+    Cvr2DTexPage * page;
+    int axis, slice;
+    uint32_t volumedataid;
+    SbBool used;
+  };
+  SbList<struct CachedPage> cachedpages;
 
 private:
   SoVolumeSkin * master;
 };
 
 #define PRIVATE(p) (p->pimpl)
+#define PUBLIC(p) (p->master)
 
 // *************************************************************************
 
@@ -134,105 +174,288 @@ void
 SoVolumeSkin::initClass(void)
 {
   SO_NODE_INIT_CLASS(SoVolumeSkin, SoShape, "SoShape");
+
+  SO_ENABLE(SoGLRenderAction, SoTransferFunctionElement);
+  SO_ENABLE(SoGLRenderAction, SoModelMatrixElement);
+  SO_ENABLE(SoGLRenderAction, SoLazyElement);
+  SO_ENABLE(SoGLRenderAction, CvrGLInterpolationElement);
 }
 
+// Collects the sides of the volume (or of the boxes selected by a
+// region of interest) which are facing the camera, sorted
+// back-to-front.
 void
-SoVolumeSkinP::buildSkinCube(SoGLRenderAction * action)
+SoVolumeSkinP::findVisibleFaces(SoGLRenderAction * action, SbList<skinface> & faces)
 {
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+
+  SbList<SbBox3s> boxes;
+  const CvrROIElement * roielem = CvrROIElement::getInstance(state);
+  if (roielem->isEnabled()) { roielem->getSelection(dims, boxes); }
+  else { boxes.append(SbBox3s(SbVec3s(0, 0, 0), dims - SbVec3s(1, 1, 1))); }
+
+  // This is done to support client code depending on an old bug:
+  // data along the Y axis used to be rendered flipped. The sides are
+  // placed where their voxels are rendered.
+  if (CvrUtil::useFlippedYAxis()) {
+    for (int b = 0; b < boxes.getLength(); b++) {
+      SbVec3s bmin = boxes[b].getMin(), bmax = boxes[b].getMax();
+      const short ymin = bmin[1];
+      bmin[1] = (dims[1] - 1) - bmax[1];
+      bmax[1] = (dims[1] - 1) - ymin;
+      boxes[b].setBounds(bmin, bmax);
+    }
+  }
 
-  this->cubesides = new slicestruct[6];
+  // Do the visibility test in object space.
+  SbViewVolume viewvolumeinv = SoViewVolumeElement::get(state);
+  viewvolumeinv.transform(SoModelMatrixElement::get(state).inverse());
+  const SbBool orthographic =
+    (viewvolumeinv.getProjectionType() == SbViewVolume::ORTHOGRAPHIC);
+  const SbVec3f eye = viewvolumeinv.getProjectionPoint();
+  const SbVec3f projdir = viewvolumeinv.getProjectionDirection();
+  const SbPlane invcamplane = viewvolumeinv.getPlane(0.0f);
 
-  for (int i=0;i<6;++i) {
-    this->cubesides[i].slice = new SoOrthoSlice;
-    this->cubesides[i].slice->ref();
-    this->cubesides[i].distance = 0.0f;
+  const SbBox3f & vdbox = vbelem->getUnitDimensionsBox();
+  const SbVec3f & vdmin = vdbox.getMin();
+  const SbVec3f & vdmax = vdbox.getMax();
+
+  // Any sides which were seen before, but are not part of the current
+  // set of sides, have their pages thrown out below.
+  for (int i = 0; i < this->cachedpages.getLength(); i++) {
+    this->cachedpages[i].used = FALSE;
   }
 
-  const CvrVoxelBlockElement * vbelem =
-    CvrVoxelBlockElement::getInstance(action->getState());
-  assert(vbelem != NULL);
-  const SbVec3s & voxcubedims = vbelem->getVoxelCubeDimensions();
-
-  const int maxslicesx = voxcubedims[0]-1;
-  const int maxslicesy = voxcubedims[1]-1;
-  const int maxslicesz = voxcubedims[2]-1;
-
-  // Top
-  this->cubesides[0].slice->axis.setValue(SoOrthoSlice::Y);
-  this->cubesides[0].slice->sliceNumber.setValue(maxslicesy);
-  // Bottom
-  this->cubesides[1].slice->axis.setValue(SoOrthoSlice::Y);
-  this->cubesides[1].slice->sliceNumber.setValue(0);
-  // Right
-  this->cubesides[2].slice->axis.setValue(SoOrthoSlice::X);
-  this->cubesides[2].slice->sliceNumber.setValue(maxslicesx);
-  // Left
-  this->cubesides[3].slice->axis.setValue(SoOrthoSlice::X);
-  this->cubesides[3].slice->sliceNumber.setValue(0);  
-  // Front
-  this->cubesides[4].slice->axis.setValue(SoOrthoSlice::Z);
-  this->cubesides[4].slice->sliceNumber.setValue(maxslicesz);
-  // Back
-  this->cubesides[5].slice->axis.setValue(SoOrthoSlice::Z);
-  this->cubesides[5].slice->sliceNumber.setValue(0);
-  
+  for (int b = 0; b < boxes.getLength(); b++) {
+    const SbVec3s & bmin = boxes[b].getMin();
+    const SbVec3s & bmax = boxes[b].getMax();
+
+    for (int axis = 0; axis < 3; axis++) {
+      for (int side = 0; side < 2; side++) {
+        skinface face;
+        face.axis = axis;
+        face.slice = side ? bmax[axis] : bmin[axis];
+        face.region = boxes[b];
+
+        for (int i = 0; i < this->cachedpages.getLength(); i++) {
+          struct CachedPage & cp = this->cachedpages[i];
+          if ((cp.axis == axis) && (cp.slice == face.slice)) { cp.used = TRUE; }
+        }
+
+        // Center of the side, in object space.
+        SbVec3f center;
+        for (int a = 0; a < 3; a++) {
+          const float voxelsize = (vdmax[a] - vdmin[a]) / dims[a];
+          center[a] = (a == axis) ?
+            vdmin[a] + (face.slice + 0.5f) * voxelsize :
+            vdmin[a] + (bmin[a] + bmax[a] + 1) * 0.5f * voxelsize;
+        }
+        SbVec3f normal(0.0f, 0.0f, 0.0f);
+        normal[axis] = side ? 1.0f : -1.0f;
+
+        const SbVec3f tocamera = orthographic ? -projdir : (eye - center);
+        if (tocamera.dot(normal) <= 0.0f) { continue; }
+
+        face.distance = orthographic ?
+          -invcamplane.getDistance(center) : (eye - center).length();
+
+        int pos = faces.getLength();
+        while ((pos > 0) && (faces[pos - 1].distance < face.distance)) { pos--; }
+        faces.insert(face, pos);
+      }
+    }
+  }
+
+  for (int i = this->cachedpages.getLength() - 1; i >= 0; i--) {
+    if (!this->cachedpages[i].used ||
+        (this->cachedpages[i].volumedataid != vbelem->getNodeId())) {
+      delete this->cachedpages[i].page;
+      this->cachedpages.remove(i);
+    }
+  }
 }
 
+// Use the 3D texture bricks under the same conditions as
+// SoOrthoSlice, i.e. when they are likely to be shared with
+// SoVolumeRender.
+SbBool
+SoVolumeSkinP::use3DTexturing(SoGLRenderAction * action) const
+{
+  if (CvrUtil::force2DTextureRendering()) { return FALSE; }
+
+  SoState * state = action->getState();
+  const int storagehint = CvrStorageHintElement::get(state);
+  if ((storagehint != SoVolumeData::TEX3D) &&
+      (storagehint != SoVolumeData::AUTO) &&
+      (storagehint != SoVolumeData::VOLUMEPRO)) { return FALSE; }
+
+  const cc_glglue * glue = cc_glglue_instance(action->getCacheContext());
+  if (!cc_glglue_has_3d_textures(glue)) { return FALSE; }
 
-static int
-qsort_compare(const void * element1, const void * element2)
+  const uint32_t ctxid = action->getCacheContext();
+  return (SoVolumeRendering::get3DTextureAcceleration(ctxid) ==
+          SoVolumeRendering::YES) ? TRUE : FALSE;
+}
+
+// Renders the sides as quads through the 3D texture bricks. Only the
+// bricks along the sides will be built.
+void
+SoVolumeSkinP::render3D(SoGLRenderAction * action, const SbList<skinface> & faces)
 {
-  const slicestruct * s1 = (slicestruct *) element1;
-  const slicestruct * s2 = (slicestruct *) element2;  
-  if (s1->distance < s2->distance) return -1;
-  else return 1;
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+
+  SbMatrix volumetransform;
+  CvrUtil::getTransformFromVolumeBoxDimensions(vbelem, volumetransform);
+  SoModelMatrixElement::mult(state, PUBLIC(this), volumetransform);
+
+  // The local coordinate system of the 3D texture cube has one unit
+  // per voxel, and origo in the center of the volume.
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+  const SbVec3f origo(-dims[0] / 2.0f, -dims[1] / 2.0f, -dims[2] / 2.0f);
+
+  SbList<SbVec3f> quads;
+  for (int i = 0; i < faces.getLength(); i++) {
+    const skinface & face = faces[i];
+    const int u = (face.axis + 1) % 3;
+    const int v = (face.axis + 2) % 3;
+    const SbVec3s & rmin = face.region.getMin();
+    const SbVec3s & rmax = face.region.getMax();
+
+    SbVec3f corner;
+    corner[face.axis] = origo[face.axis] + face.slice + 0.5f;
+
+    corner[u] = origo[u] + rmin[u]; corner[v] = origo[v] + rmin[v];
+    quads.append(corner);
+    corner[u] = origo[u] + rmax[u] + 1;
+    quads.append(corner);
+    corner[v] = origo[v] + rmax[v] + 1;
+    quads.append(corner);
+    corner[u] = origo[u] + rmin[u];
+    quads.append(corner);
+  }
+
+  if (!this->cubehandler) { this->cubehandler = new CvrCubeHandler(); }
+
+  this->cubehandler->renderFaces(action, CvrCLUT::ALPHA_BINARY,
+                                 quads.getArrayPtr(), faces.getLength());
 }
 
+// Renders the sides from one 2D texture page each.
 void
-SoVolumeSkinP::sortCubeSides(SoGLRenderAction * action)
+SoVolumeSkinP::render2D(SoGLRenderAction * action, const SbList<skinface> & faces)
 {
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  const SbVec3s & dims = vbelem->getVoxelCubeDimensions();
+
+  // Work in a 1x1x1 volume in unit coordinates, like SoOrthoSlice.
+  const SbBox3f & localbox = vbelem->getUnitDimensionsBox();
+  SbMatrix m;
+  m.setTransform((localbox.getMax() - localbox.getMin()) / 2.0f + localbox.getMin(),
+                 SbRotation::identity(),
+                 localbox.getMax() - localbox.getMin());
+  SoModelMatrixElement::mult(state, PUBLIC(this), m);
 
-  const SbViewVolume viewvolume = SoViewVolumeElement::get(action->getState());
-  const SbPlane camplane = viewvolume.getPlane(0.0f);
+  const SbBool roienabled = CvrROIElement::getInstance(state)->isEnabled();
 
-  // Fetch camera distance to each slice
-  for (int i=0;i<6;++i) {
-    SbVec3f center;
-    SbBox3f dummy;
-    ((SoShape *) this->cubesides[i].slice)->computeBBox(action, dummy, center);
-    this->cubesides[i].distance = camplane.getDistance(center);
+  const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
+  CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, CvrCLUT::ALPHA_BINARY);
+
+  // This must be done, as we want to control stuff in the GL state
+  // machine. Without it, state changes could trigger outside our
+  // control.
+  SoGLLazyElement::getInstance(state)->send(state, SoLazyElement::ALL_MASK);
+
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+  glDisable(GL_LIGHTING);
+  glEnable(GL_TEXTURE_2D);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  for (int i = 0; i < faces.getLength(); i++) {
+    const skinface & face = faces[i];
+
+    Cvr2DTexPage * texpage = this->getPage(action, face.axis, face.slice);
+
+    const CvrCLUT * pageclut = texpage->getPalette();
+    if ((pageclut == NULL) || (*pageclut != *c)) { texpage->setPalette(c); }
+
+    SbVec3f origo, horizspan, verticalspan;
+    vbelem->getPageGeometry(face.axis, face.slice, origo, horizspan, verticalspan);
+
+    if (!roienabled) {
+      texpage->render(action, origo, horizspan, verticalspan);
+    }
+    else {
+      // Only the part of the page within the selected box is built
+      // and rendered, with the rest cut away by clip planes.
+      const SbVec3s & bmin = face.region.getMin();
+      const SbVec3s & bmax = face.region.getMax();
+      SbVec3f rmin, rmax;
+      for (unsigned int a = 0; a < 3; a++) {
+        rmin[a] = -0.5f + float(bmin[a]) / float(dims[a]);
+        rmax[a] = -0.5f + float(bmax[a] + 1) / float(dims[a]);
+      }
+      const SbBox3f region(rmin, rmax);
+
+      const unsigned int axismask = 7 & ~(1 << face.axis);
+      const SbBool clipped = CvrUtil::enableClipBox(state, region, axismask);
+      texpage->render(action, origo, horizspan, verticalspan, &region);
+      if (clipped) { CvrUtil::disableClipBox(state, axismask); }
+    }
   }
-  
-  // Sort rendering order
-  qsort((void *) this->cubesides, 6, sizeof(slicestruct), qsort_compare);
-  
+
+  glPopAttrib();
+
+  c->unref();
 }
 
-void
-SoVolumeSkinP::renderSkinCube(SoGLRenderAction * action, 
-                              enum SoVolumeSkin::Interpolation interpolation)
+// Returns the page for the side at the given slice, building it if
+// this side has not been seen before.
+Cvr2DTexPage *
+SoVolumeSkinP::getPage(const SoGLRenderAction * action,
+                       const int axis, const int slice)
 {
-  
-  if (this->interpolation != interpolation) {
-    for (int i=0;i<6;++i) 
-      this->cubesides[i].slice->interpolation = interpolation;
-    this->interpolation = interpolation;
+  SoState * state = action->getState();
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+
+  for (int i = 0; i < this->cachedpages.getLength(); i++) {
+    struct CachedPage & cp = this->cachedpages[i];
+    if ((cp.axis == axis) && (cp.slice == slice)) { return cp.page; }
   }
-  
-  this->sortCubeSides(action);
-  
-  for (int i=0;i<6;++i) 
-    ((SoShape *) this->cubesides[i].slice)->GLRender(action);
 
+  // This is done to support client code depending on an old bug:
+  // data along the Y axis used to be rendered flipped.
+  int pageslice = slice;
+  if (CvrUtil::useFlippedYAxis() && (axis == 1)) {
+    pageslice = (vbelem->getVoxelCubeDimensions()[1] - 1) - pageslice;
+  }
+
+  const SbVec3s & pagesize = CvrPageSizeElement::get(state);
+  // Pagesize according to axis: X => [Z, Y], Y => [X, Z], Z => [X, Y].
+  const SbVec2s subpagesize =
+    SbVec2s(pagesize[(axis == 0) ? 2 : 0], pagesize[(axis == 1) ? 2 : 1]);
+
+  struct CachedPage cp;
+  cp.page = new Cvr2DTexPage(action, axis, pageslice, subpagesize);
+  cp.axis = axis;
+  cp.slice = slice;
+  cp.volumedataid = vbelem->getNodeId();
+  cp.used = TRUE;
+  this->cachedpages.append(cp);
+  return cp.page;
 }
 
 void
 SoVolumeSkin::GLRender(SoGLRenderAction * action)
 {
   // This will automatically lock and unlock a mutex stopping multiple
-  // render threads for SIM Voleon nodes. FIXME: should really make
-  // code re-entrant / threadsafe. 20041112 mortene.
-  CvrGlobalRenderLock lock;
+  // render threads from rendering the same volume at the same time.
+  CvrVolumeRenderLock lock(action->getState());
 
 
   // FIXME: need to make sure we're not cached in a renderlist
@@ -249,18 +472,51 @@ SoVolumeSkin::GLRender(SoGLRenderAction * action)
     action->addDelayedPath(action->getCurPath()->copy());
     return;
   }
-  
-  if (!PRIVATE(this)->initialized) {
-    PRIVATE(this)->buildSkinCube(action);
-    PRIVATE(this)->initialized = TRUE;
+
+  SoState * state = action->getState();
+
+  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
+  if (vbelem == NULL) {
+    static SbBool first = TRUE;
+    if (first) {
+      SoDebugError::post("SoVolumeSkin::GLRender",
+                         "no SoVolumeData in scene graph before "
+                         "SoVolumeSkin node -- rendering aborted");
+      first = FALSE;
+    }
+    return;
+  }
+
+  const SoTransferFunctionElement * tfelement =
+    SoTransferFunctionElement::getInstance(state);
+  if (tfelement->getTransferFunction() == NULL) {
+    static SbBool first = TRUE;
+    if (first) {
+      SoDebugError::post("SoVolumeSkin::GLRender",
+                         "no SoTransferFunction in scene graph before "
+                         "SoVolumeSkin node -- rendering aborted");
+      first = FALSE;
+    }
+    return;
   }
 
-  Interpolation interp;
-  if (this->interpolation.getValue() == NEAREST) interp = NEAREST;
-  else interp = LINEAR;
+  SbList<skinface> faces;
+  PRIVATE(this)->findVisibleFaces(action, faces);
+  if (faces.getLength() == 0) { return; }
 
-  PRIVATE(this)->renderSkinCube(action, interp);
+  state->push();
+
+  CvrGLInterpolationElement::set(state, (this->interpolation.getValue() == NEAREST) ?
+                                 GL_NEAREST : GL_LINEAR);
+
+  if (PRIVATE(this)->use3DTexturing(action)) {
+    PRIVATE(this)->render3D(action, faces);
+  }
+  else {
+    PRIVATE(this)->render2D(action, faces);
+  }
 
+  state->pop();
 }
 
 
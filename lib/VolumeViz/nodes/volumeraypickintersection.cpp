@@ -35,7 +35,8 @@
 
 /*
   Shared code. 
-  Currently used by SoVolumeRender::rayPick and SoVolumeSkin::rayPick
+  Currently used by SoVolumeRender::rayPick, SoVolumeSkin::rayPick and
+  SoVolumeData::pickRays
 */
 
 SbBool cvr_volumeraypickintersection(SoRayPickAction * action, SbVec3f intersections[2])
@@ -45,9 +46,19 @@ SbBool cvr_volumeraypickintersection(SoRayPickAction * action, SbVec3f intersect
   const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
   if (vbelem == NULL) { return FALSE; }
   
-  const SbBox3f & objbbox = vbelem->getUnitDimensionsBox();
-  const SbLine ray = action->getLine();
-  
+  return cvr_volumelineintersection(vbelem->getUnitDimensionsBox(), action->getLine(),
+                                    intersections);
+}
+
+/*
+  Finds where \a ray enters and leaves the volume box \a objbbox.
+  Also used for picking without an SoRayPickAction.
+*/
+
+SbBool cvr_volumelineintersection(const SbBox3f & objbbox, const SbLine & ray,
+                                  SbVec3f intersections[2])
+{
+
   SbVec3f mincorner, maxcorner;
   objbbox.getBounds(mincorner, maxcorner);
     
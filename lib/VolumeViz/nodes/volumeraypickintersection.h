@@ -41,5 +41,7 @@
 #include <Inventor/actions/SoRayPickAction.h>
 
 SbBool cvr_volumeraypickintersection(SoRayPickAction * action, SbVec3f intersections[2]);
+SbBool cvr_volumelineintersection(const SbBox3f & objbbox, const SbLine & ray,
+                                  SbVec3f intersections[2]);
 
 #endif /* !CVR_VOLUMERAYPICKINTERSECTION_H */
@@ -37,6 +37,7 @@
 
 #include <Inventor/C/tidbits.h>
 #include <Inventor/SbBox2s.h>
+#include <Inventor/SbBox3f.h>
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/system/gl.h>
@@ -193,7 +194,8 @@ Cvr2DTexPage::releaseAllSubPages(void)
 void
 Cvr2DTexPage::render(const SoGLRenderAction * action,
                      const SbVec3f & origo,
-                     const SbVec3f & horizspan, const SbVec3f & verticalspan)
+                     const SbVec3f & horizspan, const SbVec3f & verticalspan,
+                     const SbBox3f * region)
 {
   const cc_glglue * glglue = cc_glglue_instance(action->getCacheContext());
 
@@ -211,22 +213,30 @@ Cvr2DTexPage::render(const SoGLRenderAction * action,
   for (int rowidx = 0; rowidx < this->nrrows; rowidx++) {
     for (int colidx = 0; colidx < this->nrcolumns; colidx++) {
 
-      Cvr2DTexSubPage * page = NULL;
-      Cvr2DTexSubPageItem * pageitem = this->getSubPage(state, colidx, rowidx);
-      if (pageitem == NULL) { pageitem = this->buildSubPage(action, colidx, rowidx); }
-      assert(pageitem != NULL);
-      if (pageitem->invisible) continue;
-      assert(pageitem->page != NULL);
-
       SbVec3f upleft = origo +
         // horizontal shift to correct column
         subpagewidth * (float)colidx +
         // vertical shift to correct row
         subpageheight * (float)rowidx;
 
-      // FIXME: should do view frustum culling on each page as an
-      // optimization measure (both for rendering speed and texture
-      // memory usage). 20021121 mortene.
+      // View frustum culling, to avoid spending time and texture
+      // memory on sub-pages which are not visible.
+      SbBox3f pagebox;
+      pagebox.extendBy(upleft);
+      pagebox.extendBy(upleft + subpagewidth);
+      pagebox.extendBy(upleft + subpageheight);
+      pagebox.extendBy(upleft + subpagewidth + subpageheight);
+      if (!CvrUtil::isInsideViewVolume(state, pagebox)) { continue; }
+
+      // Likewise for sub-pages outside the region of interest.
+      if (region && !region->intersect(pagebox)) { continue; }
+
+      Cvr2DTexSubPage * page = NULL;
+      Cvr2DTexSubPageItem * pageitem = this->getSubPage(state, colidx, rowidx);
+      if (pageitem == NULL) { pageitem = this->buildSubPage(action, colidx, rowidx); }
+      assert(pageitem != NULL);
+      if (pageitem->invisible) continue;
+      assert(pageitem->page != NULL);
 
       pageitem->page->render(action, upleft, subpagewidth, subpageheight);
     }
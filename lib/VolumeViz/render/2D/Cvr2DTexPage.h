@@ -37,6 +37,7 @@
 
 class Cvr2DTexSubPage;
 class CvrCLUT;
+class SbBox3f;
 class SbVec3f;
 class SoGLRenderAction;
 class SoState;
@@ -52,7 +53,8 @@ public:
   ~Cvr2DTexPage();
 
   void render(const SoGLRenderAction * action, const SbVec3f & origo,
-              const SbVec3f & horizspan, const SbVec3f & verticalspan);
+              const SbVec3f & horizspan, const SbVec3f & verticalspan,
+              const SbBox3f * region = NULL);
 
   void setPalette(const CvrCLUT * c);
   const CvrCLUT * getPalette(void) const;
@@ -34,10 +34,12 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <Inventor/C/tidbits.h>
 #include <Inventor/C/glue/gl.h>
 #include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/SbBox3f.h>
 #include <Inventor/SbTime.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/elements/SoModelMatrixElement.h>
@@ -47,6 +49,7 @@
 #include <VolumeViz/render/2D/Cvr2DTexPage.h>
 #include <VolumeViz/nodes/SoTransferFunction.h>
 #include <VolumeViz/elements/CvrPageSizeElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
 #include <VolumeViz/misc/CvrUtil.h>
@@ -240,6 +243,7 @@ CvrPageHandler::render(const SoGLRenderAction * action, CvrCLUT::AlphaUse alphau
   const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
   CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, alphause);
   if (this->clut != c) { this->setPalette(c); }
+  c->unref();
 
   // This must be done, as we want to control stuff in the GL state
   // machine. Without it, state changes could trigger outside our
@@ -332,6 +336,41 @@ CvrPageHandler::render(const SoGLRenderAction * action, CvrCLUT::AlphaUse alphau
   const unsigned int AXISIDX = this->getCurrentAxis(camvec);
   const unsigned int DEPTH = this->voldatadims[AXISIDX];
 
+  // With a region of interest, only pages and sub-pages within the
+  // selected boxes are built and rendered, and the slices are spread
+  // over the selected pages only.
+  const SbVec3s & voxeldims = vbelem->getVoxelCubeDimensions();
+  SbList<SbBox3s> roiboxes;
+  const CvrROIElement * roielem = CvrROIElement::getInstance(state);
+  if (roielem->isEnabled()) {
+    roielem->getSelection(voxeldims, roiboxes);
+    if (roiboxes.getLength() == 0) { glPopAttrib(); return; }
+
+    // With the obsolete flipped Y axis, voxel row y is rendered at
+    // row dims[1]-1-y, so the boxes are flipped to match the page
+    // geometry below.
+    if (CvrUtil::useFlippedYAxis()) {
+      for (int j = 0; j < roiboxes.getLength(); j++) {
+        SbVec3s bmin = roiboxes[j].getMin(), bmax = roiboxes[j].getMax();
+        const short ymin = bmin[1];
+        bmin[1] = (voxeldims[1] - 1) - bmax[1];
+        bmax[1] = (voxeldims[1] - 1) - ymin;
+        roiboxes[j].setBounds(bmin, bmax);
+      }
+    }
+  }
+
+  unsigned int firstpage = 0, nrpages = DEPTH;
+  if (roiboxes.getLength() > 0) {
+    int lo = INT_MAX, hi = INT_MIN;
+    for (int j = 0; j < roiboxes.getLength(); j++) {
+      lo = SbMin(lo, (int)roiboxes[j].getMin()[AXISIDX]);
+      hi = SbMax(hi, (int)roiboxes[j].getMax()[AXISIDX]);
+    }
+    firstpage = lo;
+    nrpages = hi - lo + 1;
+  }
+
   SbVec3f origo, horizspan, verticalspan;
 
   for (unsigned int i = 0; i < numslices; i++) {
@@ -345,13 +384,14 @@ CvrPageHandler::render(const SoGLRenderAction * action, CvrCLUT::AlphaUse alphau
     // the same on all platforms and for all compilers? (20040315
     // handegar)
     //unsigned int pageidx = (unsigned int) (fraction * float(DEPTH - 1) + 0.5f);
-    unsigned int pageidx = (unsigned int) (fraction * float(DEPTH) + 0.5f);
-
-    assert(pageidx < DEPTH);
+    unsigned int pageidx = (unsigned int) (fraction * float(nrpages) + 0.5f);
+    pageidx = SbMin(pageidx, nrpages - 1);
 
     // If rendering in reverse order.
-    if (camvec[AXISIDX] < 0) { pageidx = DEPTH - pageidx - 1; }
+    if (camvec[AXISIDX] < 0) { pageidx = nrpages - pageidx - 1; }
+    pageidx += firstpage;
     assert(pageidx < DEPTH);
+    const unsigned int voxelidx = pageidx;
 
     SoVolumeRender::AbortCode abortcode =
       (abortfunc == NULL) ?
@@ -377,7 +417,35 @@ CvrPageHandler::render(const SoGLRenderAction * action, CvrCLUT::AlphaUse alphau
       // that can give better rendering quality of the volume.
 
       Cvr2DTexPage * page = this->getSlice(action, AXISIDX, pageidx);
-      page->render(action, origo, horizspan, verticalspan);
+
+      if (roiboxes.getLength() == 0) {
+        page->render(action, origo, horizspan, verticalspan);
+      }
+      else {
+        // Render the part of the page within each of the selected
+        // boxes, cutting away the rest with clip planes.
+        const unsigned int axismask = 7 & ~(1 << AXISIDX);
+        for (int j = 0; j < roiboxes.getLength(); j++) {
+          const SbVec3s & bmin = roiboxes[j].getMin();
+          const SbVec3s & bmax = roiboxes[j].getMax();
+          if (((int)voxelidx < bmin[AXISIDX]) || ((int)voxelidx > bmax[AXISIDX])) {
+            continue;
+          }
+
+          // Voxel v along an axis spans [v/dim, (v+1)/dim] of the
+          // unit cube.
+          SbVec3f rmin, rmax;
+          for (unsigned int a = 0; a < 3; a++) {
+            rmin[a] = -0.5f + float(bmin[a]) / float(voxeldims[a]);
+            rmax[a] = -0.5f + float(bmax[a] + 1) / float(voxeldims[a]);
+          }
+          const SbBox3f region(rmin, rmax);
+
+          const SbBool clipped = CvrUtil::enableClipBox(state, region, axismask);
+          page->render(action, origo, horizspan, verticalspan, &region);
+          if (clipped) { CvrUtil::disableClipBox(state, axismask); }
+        }
+      }
     }
     else {
       assert((abortcode == SoVolumeRender::SKIP) &&
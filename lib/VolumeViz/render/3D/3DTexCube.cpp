@@ -32,7 +32,9 @@
 
 #include <VolumeViz/render/3D/Cvr3DTexCube.h>
 
+#include <float.h>
 #include <limits.h>
+#include <math.h>
 #include <string.h>
 
 #include <Inventor/C/glue/gl.h>
@@ -40,6 +42,7 @@
 #include <Inventor/SbLinear.h>
 #include <Inventor/SbViewVolume.h>
 #include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/elements/SoClipPlaneElement.h>
 #include <Inventor/elements/SoModelMatrixElement.h>
 #include <Inventor/elements/SoProjectionMatrixElement.h>
 #include <Inventor/elements/SoViewVolumeElement.h>
@@ -47,6 +50,7 @@
 #include <Inventor/errors/SoDebugError.h>
 
 #include <VolumeViz/elements/CvrPageSizeElement.h>
+#include <VolumeViz/elements/CvrROIElement.h>
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/SoTransferFunctionElement.h>
 #include <VolumeViz/misc/CvrCLUT.h>
@@ -76,6 +80,14 @@ public:
 
   float boundingsphereradius;
   float cameraplane2cubecenter;
+  float minextent; // shortest side of the sub-cube, in world space
+
+  // Position in the grid of sub-cubes.
+  unsigned int col, row, depth;
+
+  // Bounds of the sub-cube in the local coordinate system of the
+  // volume.
+  SbBox3f box;
 };
 
 // *************************************************************************
@@ -114,6 +126,15 @@ Cvr3DTexCube::Cvr3DTexCube(const SoGLRenderAction * action)
 
   this->abortfunc = NULL;
   this->abortfuncdata = NULL;
+
+  this->occlusionculling = FALSE;
+
+  this->roitracked = FALSE;
+
+  this->cachehits = 0;
+  this->cachemisses = 0;
+  this->prefetched = 0;
+  this->evicted = 0;
 }
 
 
@@ -132,6 +153,16 @@ Cvr3DTexCube::setAbortCallback(SoVolumeRenderAbortCB * func, void * userdata)
 }
 
 
+// Turn on or off culling of sub-cubes which are hidden behind fully
+// opaque sub-cubes. This is only valid for compositing modes where
+// voxels can obscure other voxels, i.e. ALPHA_BLENDING.
+void
+Cvr3DTexCube::setOcclusionCulling(const SbBool enable)
+{
+  this->occlusionculling = enable;
+}
+
+
 /*!
   Release resources used by a page in the slice.
 */
@@ -288,10 +319,55 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
   SbViewVolume viewvolumeinv = viewvolume;
   viewvolumeinv.transform(SoModelMatrixElement::get(state).inverse());
 
-  SbBox3f bbox(this->origo, this->origo +
-               SbVec3f(this->dimensions[0],
-                       this->dimensions[1],
-                       this->dimensions[2]));
+  // With a region of interest, only the sub-cubes intersecting the
+  // selected boxes are built, and the slices are clipped to the
+  // boxes.
+  SbList<SbBox3f> roiboxes;
+  const CvrROIElement * roielem = CvrROIElement::getInstance(state);
+  if (roielem->isEnabled()) {
+    SbList<SbBox3s> selection;
+    roielem->getSelection(this->dimensions, selection);
+    if (selection.getLength() == 0) { return; }
+
+    for (int i = 0; i < selection.getLength(); i++) {
+      const SbVec3s & smin = selection[i].getMin();
+      const SbVec3s & smax = selection[i].getMax();
+      // With the obsolete flipped Y axis, the sub-cubes are built
+      // upside-down, see buildSubCube().
+      float ymin = smin[1], ymax = smax[1] + 1;
+      if (CvrUtil::useFlippedYAxis()) {
+        ymin = this->dimensions[1] - 1 - smax[1];
+        ymax = this->dimensions[1] - smin[1];
+      }
+      roiboxes.append(SbBox3f(this->origo + SbVec3f(smin[0], ymin, smin[2]),
+                              this->origo + SbVec3f(smax[0] + 1, ymax, smax[2] + 1)));
+    }
+  }
+
+  SbBox3f bbox;
+  if (roiboxes.getLength() == 0) {
+    bbox.extendBy(this->origo);
+    bbox.extendBy(this->origo +
+                  SbVec3f(this->dimensions[0],
+                          this->dimensions[1],
+                          this->dimensions[2]));
+  }
+  else {
+    // Spread the slices over the selected region only.
+    for (int i = 0; i < roiboxes.getLength(); i++) { bbox.extendBy(roiboxes[i]); }
+  }
+
+  // Follow the motion of the region of interest, and drop the
+  // sub-cubes it has left behind.
+  SbBox3f predictedroi;
+  if (roiboxes.getLength() > 0) {
+    predictedroi = this->trackROI(bbox);
+    this->evictSubCubes(bbox, predictedroi);
+  }
+  else {
+    this->roitracked = FALSE;
+  }
+
   bbox.transform(SoModelMatrixElement::get(state));
   float dx, dy, dz;
   bbox.getSize(dx, dy, dz);
@@ -343,25 +419,45 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
     for (unsigned int colidx = startcolumn; colidx <= endcolumn; colidx++) {
       for (unsigned int depthidx = startdepth; depthidx <= enddepth; depthidx++) {
 
-        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
-
         const SbVec3f subcubeorigo =
           this->origo +
           subcubewidth * (float)colidx +
           subcubeheight * (float)rowidx +
           subcubedepth * (float)depthidx;
 
+        SbBox3f subbbox(subcubeorigo, subcubeorigo + subcubeheight + subcubewidth + subcubedepth);
+
+        // Sub-cubes outside the view volume are neither built nor
+        // sliced.
+        if (!CvrUtil::isInsideViewVolume(state, subbbox)) { continue; }
+
+        // Likewise for sub-cubes outside the region of interest.
+        if (roiboxes.getLength() > 0) {
+          int j;
+          for (j = 0; j < roiboxes.getLength(); j++) {
+            if (roiboxes[j].intersect(subbbox)) { break; }
+          }
+          if (j == roiboxes.getLength()) { continue; }
+        }
+
+        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
+
         if (cubeitem == NULL) { 
           cubeitem = this->buildSubCube(action, subcubeorigo, colidx, rowidx, depthidx); 
+          this->cachemisses++;
+        }
+        else {
+          this->cachehits++;
         }
         assert(cubeitem != NULL);
 
         if (cubeitem->invisible) continue;
         assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
 
         subcubelist.append(cubeitem);
+        cubeitem->box = subbbox;
 
-        SbBox3f subbbox(subcubeorigo, subcubeorigo + subcubeheight + subcubewidth + subcubedepth);
         float dist = -invcamplane.getDistance(subbbox.getCenter());
 
         //subbbox.transform(SoModelMatrixElement::get(state));
@@ -384,6 +480,7 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
         float sdx, sdy, sdz;
         subbbox.getSize(sdx, sdy, sdz);
         cubeitem->boundingsphereradius = SbVec3f(sdx, sdy, sdz).length() * 0.5f;
+        cubeitem->minextent = SbMin(sdx, SbMin(sdy, sdz));
         cubeitem->cameraplane2cubecenter = SbAbs(camplane.getDistance(subbbox.getCenter()));
 
 #if 0 // debug
@@ -398,6 +495,27 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
     }
   }
 
+  // Sort rendering order of the subcubes depending on the distance to
+  // the camera.
+  qsort((void *) subcubelist.getArrayPtr(), subcubelist.getLength(),
+        sizeof(Cvr3DTexSubCubeItem *), subcube_qsort_compare);
+
+  // Throw out sub-cubes that can't be seen anyway, before spending
+  // any time on slicing them. (Not done when the debug override to
+  // render a single sub-cube is active, as the occluders would then
+  // not be in the list, nor with a region of interest or clip planes,
+  // as clipped sub-cubes may no longer occlude.)
+  static int nocull = -1;
+  if (nocull == -1) {
+    const char * env = coin_getenv("CVR_NO_OCCLUSION_CULLING");
+    nocull = env && (atoi(env) > 0);
+  }
+  if (this->occlusionculling && !nocull && (forcerow == UINT_MAX - 1) &&
+      (roiboxes.getLength() == 0) &&
+      (SoClipPlaneElement::getInstance(state)->getNum() == 0)) {
+    this->cullOccludedSubCubes(viewvolumeinv, distancedelta, subcubelist);
+  }
+
   // FIXME: Can we rewrite this to support viewport shells for proper
   // perspective? (20040227 handegar)
 
@@ -439,7 +557,15 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
         continue; // We haven't reached the cube yet.
       }
 
-      cubeitem->cube->intersectSlice(xformslicecorners);
+      if (roiboxes.getLength() == 0) {
+        cubeitem->cube->intersectSlice(xformslicecorners);
+      }
+      else {
+        for (int j = 0; j < roiboxes.getLength(); j++) {
+          if (!roiboxes[j].intersect(cubeitem->box)) { continue; }
+          cubeitem->cube->intersectSlice(xformslicecorners, roiboxes[j]);
+        }
+      }
       nrofclippinginvocations++; // debug
     }
   }
@@ -452,17 +578,303 @@ Cvr3DTexCube::render(const SoGLRenderAction * action,
   }
 #endif // debug
 
-  // Sort rendering order of the subcubes depending on the distance to
-  // the camera.
-  qsort((void *) subcubelist.getArrayPtr(), subcubelist.getLength(),
-        sizeof(Cvr3DTexSubCubeItem *), subcube_qsort_compare);
-
   this->renderResult(action, subcubelist);
+
+  // Build the sub-cubes the region of interest is heading for, after
+  // the current frame has been sent off.
+  if (roiboxes.getLength() > 0) {
+    this->prefetchSubCubes(action, predictedroi);
+  }
+
+  static int showstats = -1;
+  if (showstats == -1) {
+    const char * env = coin_getenv("CVR_DEBUG_SUBCUBE_CACHE");
+    showstats = env && (atoi(env) > 0);
+  }
+  if (showstats) {
+    const unsigned int lookups = this->cachehits + this->cachemisses;
+    SoDebugError::postInfo("Cvr3DTexCube::render",
+                           "sub-cube cache: %u hits, %u misses (%.1f%% hit "
+                           "rate), %u prefetched, %u evicted",
+                           this->cachehits, this->cachemisses,
+                           lookups ? (100.0f * this->cachehits / lookups) : 0.0f,
+                           this->prefetched, this->evicted);
+  }
+}
+
+
+// Updates the estimated velocity of the region of interest, given
+// its \a bounds for this frame, and returns where it is expected to
+// be a few frames ahead. All boxes are in the local coordinate system
+// of the volume.
+SbBox3f
+Cvr3DTexCube::trackROI(const SbBox3f & bounds)
+{
+  const SbVec3f center = bounds.getCenter();
+
+  if (!this->roitracked) {
+    this->roivelocity.setValue(0.0f, 0.0f, 0.0f);
+    this->roitracked = TRUE;
+  }
+  else {
+    // Smooth the velocity, so it isn't thrown off by a single
+    // irregular frame.
+    this->roivelocity = this->roivelocity * 0.5f + (center - this->roicenter) * 0.5f;
+  }
+  this->roicenter = center;
+
+  static int lookahead = -1;
+  if (lookahead == -1) {
+    const char * env = coin_getenv("CVR_ROI_PREFETCH_FRAMES");
+    lookahead = env ? SbMax(atoi(env), 0) : 4;
+  }
+
+  SbVec3f bmin, bmax;
+  bounds.getBounds(bmin, bmax);
+  const SbVec3f ahead = this->roivelocity * (float)lookahead;
+  return SbBox3f(bmin + ahead, bmax + ahead);
+}
+
+
+// Calculates the range of sub-cubes intersecting the given \a box, in
+// the local coordinate system of the volume. Returns FALSE if the box
+// is outside the volume.
+SbBool
+Cvr3DTexCube::getSubCubeRange(const SbBox3f & box,
+                              unsigned int mincube[3],
+                              unsigned int maxcube[3]) const
+{
+  const unsigned int nrcubes[3] = { this->nrcolumns, this->nrrows, this->nrdepths };
+
+  SbVec3f bmin, bmax;
+  box.getBounds(bmin, bmax);
+  for (unsigned int i = 0; i < 3; i++) {
+    const float lo = (bmin[i] - this->origo[i]) / this->subcubesize[i];
+    const float hi = (bmax[i] - this->origo[i]) / this->subcubesize[i];
+    if ((hi <= 0.0f) || (lo >= (float)nrcubes[i])) { return FALSE; }
+
+    mincube[i] = (lo <= 0.0f) ? 0 : (unsigned int)lo;
+    maxcube[i] = SbMin((unsigned int)ceil(hi), nrcubes[i]) - 1;
+  }
+  return TRUE;
+}
+
+
+// Releases the sub-cubes which are outside both the current region
+// of interest and the \a predicted one, with a margin of one sub-cube.
+void
+Cvr3DTexCube::evictSubCubes(const SbBox3f & current, const SbBox3f & predicted)
+{
+  if (this->subcubes == NULL) { return; }
+
+  SbBox3f keep = current;
+  keep.extendBy(predicted);
+  SbVec3f kmin, kmax;
+  keep.getBounds(kmin, kmax);
+  const SbVec3f margin(this->subcubesize[0], this->subcubesize[1], this->subcubesize[2]);
+  keep.setBounds(kmin - margin, kmax + margin);
+
+  for (unsigned int row = 0; row < this->nrrows; row++) {
+    for (unsigned int col = 0; col < this->nrcolumns; col++) {
+      for (unsigned int depth = 0; depth < this->nrdepths; depth++) {
+        const unsigned int idx = this->calcSubCubeIdx(row, col, depth);
+        if (this->subcubes[idx] == NULL) { continue; }
+
+        const SbVec3f cubeorigo = this->origo +
+          SbVec3f(col * this->subcubesize[0],
+                  row * this->subcubesize[1],
+                  depth * this->subcubesize[2]);
+        const SbBox3f cubebox(cubeorigo, cubeorigo + margin);
+        if (!keep.intersect(cubebox)) {
+          this->releaseSubCube(row, col, depth);
+          this->evicted++;
+        }
+      }
+    }
+  }
+}
+
+
+// Builds sub-cubes along the path from the current position of the
+// region of interest to the \a predicted one, nearest first. At most
+// a few sub-cubes are built per frame, so the cost of moving into new
+// parts of the volume is spread over the frames before they are
+// actually needed.
+void
+Cvr3DTexCube::prefetchSubCubes(const SoGLRenderAction * action,
+                               const SbBox3f & predicted)
+{
+  static int budget = -1;
+  if (budget == -1) {
+    const char * env = coin_getenv("CVR_ROI_PREFETCH_BUDGET");
+    budget = env ? SbMax(atoi(env), 0) : 2;
+  }
+
+  // Not moving, so nothing new to fetch.
+  const float speed = this->roivelocity.length();
+  if ((budget == 0) || (speed < 0.5f)) { return; }
+
+  SoState * state = action->getState();
+
+  SbVec3f pmin, pmax;
+  predicted.getBounds(pmin, pmax);
+  const SbVec3f halfsize = (pmax - pmin) * 0.5f;
+  const float pathlength = (predicted.getCenter() - this->roicenter).length();
+  const unsigned int nrsteps = (unsigned int)(pathlength / speed + 0.5f);
+
+  int built = 0;
+  for (unsigned int i = 1; (i <= nrsteps) && (built < budget); i++) {
+    const SbVec3f center = this->roicenter + this->roivelocity * (float)i;
+
+    unsigned int mincube[3], maxcube[3];
+    if (!this->getSubCubeRange(SbBox3f(center - halfsize, center + halfsize),
+                               mincube, maxcube)) { continue; }
+
+    for (unsigned int col = mincube[0]; (col <= maxcube[0]) && (built < budget); col++) {
+      for (unsigned int row = mincube[1]; (row <= maxcube[1]) && (built < budget); row++) {
+        for (unsigned int depth = mincube[2]; (depth <= maxcube[2]) && (built < budget); depth++) {
+          if (this->getSubCube(state, col, row, depth) != NULL) { continue; }
+
+          const SbVec3f cubeorigo = this->origo +
+            SbVec3f(col * this->subcubesize[0],
+                    row * this->subcubesize[1],
+                    depth * this->subcubesize[2]);
+          (void)this->buildSubCube(action, cubeorigo, col, row, depth);
+          this->prefetched++;
+          built++;
+        }
+      }
+    }
+  }
+}
+
+
+// Removes from the back-to-front sorted \a subcubelist all sub-cubes
+// which are completely hidden behind opaque sub-cubes. \a viewvolume
+// must be in the local coordinate system of the volume.
+//
+// A ray from the eye can only enter a sub-cube through the faces
+// turned towards the eye, and will then come directly from one of the
+// (at most 7) neighbor sub-cubes sharing those faces, edges or
+// corner. If all of these neighbors are either fully opaque, or
+// themselves occluded, the ray is already saturated when it reaches
+// the sub-cube, which can then be skipped.
+//
+// The neighbors are visited before the sub-cube itself by traversing
+// the list front-to-back. Any neighbor not yet classified is counted
+// as non-occluding, so the test can only err on the conservative side.
+//
+// An opaque sub-cube only saturates the rays if slices are actually
+// sampled within it, so with few slices (e.g. with a time budget or
+// during interaction), only sub-cubes spanning several times the
+// world space \a slicedistance count as occluders. Rays crossing just
+// a thin edge or corner of an occluder can still miss its slices, but
+// these are then close enough together to make that rare.
+void
+Cvr3DTexCube::cullOccludedSubCubes(const SbViewVolume & viewvolume,
+                                   const float slicedistance,
+                                   SbList <Cvr3DTexSubCubeItem *> & subcubelist) const
+{
+  // The number of slices an occluder must span along its shortest
+  // side.
+  const float MINOCCLUDERSLICES = 4.0f;
+
+  const unsigned int nrsubcubes = this->nrrows * this->nrcolumns * this->nrdepths;
+  SbList <SbBool> saturated(nrsubcubes);
+  for (unsigned int i = 0; i < nrsubcubes; i++) { saturated.append(FALSE); }
+
+  const SbBool perspective =
+    (viewvolume.getProjectionType() == SbViewVolume::PERSPECTIVE);
+  const SbVec3f eye = viewvolume.getProjectionPoint();
+  const SbVec3f projdir = viewvolume.getProjectionDirection();
+
+  const unsigned int nrgrid[3] = { this->nrcolumns, this->nrrows, this->nrdepths };
+
+  unsigned int nrculled = 0; // debug
+
+  for (int i = subcubelist.getLength() - 1; i >= 0; i--) {
+    Cvr3DTexSubCubeItem * cubeitem = subcubelist[i];
+    const unsigned int pos[3] = { cubeitem->col, cubeitem->row, cubeitem->depth };
+
+    // Find which side of the sub-cube faces the eye along each axis
+    // (0 if the eye is within the sub-cube's extent on the axis).
+    int side[3];
+    for (unsigned int a = 0; a < 3; a++) {
+      if (perspective) {
+        const float cmin = this->origo[a] + pos[a] * this->subcubesize[a];
+        const float cmax = cmin + this->subcubesize[a];
+        side[a] = (eye[a] > cmax) ? 1 : ((eye[a] < cmin) ? -1 : 0);
+      }
+      else {
+        side[a] = (projdir[a] < -FLT_EPSILON) ? 1 : ((projdir[a] > FLT_EPSILON) ? -1 : 0);
+      }
+    }
+
+    SbBool occluded = (side[0] != 0) || (side[1] != 0) || (side[2] != 0);
+
+    for (unsigned int n = 1; occluded && (n < 8); n++) {
+      int neighbor[3];
+      SbBool skip = FALSE;
+      for (unsigned int a = 0; a < 3; a++) {
+        const int step = (n & (1 << a)) ? side[a] : 0;
+        if ((n & (1 << a)) && (step == 0)) { skip = TRUE; }
+        neighbor[a] = (int)pos[a] + step;
+      }
+      if (skip) { continue; } // not a neighbor in the direction of the eye
+
+      for (unsigned int a = 0; a < 3; a++) {
+        if ((neighbor[a] < 0) || (neighbor[a] >= (int)nrgrid[a])) { occluded = FALSE; }
+      }
+      if (occluded) {
+        const unsigned int idx =
+          this->calcSubCubeIdx(neighbor[1], neighbor[0], neighbor[2]);
+        occluded = saturated[idx];
+      }
+    }
+
+    const unsigned int idx = this->calcSubCubeIdx(pos[1], pos[0], pos[2]);
+    saturated[idx] = occluded ||
+      (cubeitem->cube->isOpaque() &&
+       (cubeitem->minextent >= (MINOCCLUDERSLICES * slicedistance)));
+
+    if (occluded) {
+      subcubelist.remove(i);
+      nrculled++;
+    }
+  }
+
+#if CVR_DEBUG && 0 // debug
+  SoDebugError::postInfo("Cvr3DTexCube::cullOccludedSubCubes",
+                         "culled %u sub-cubes, %d left",
+                         nrculled, subcubelist.getLength());
+#endif // debug
+}
+
+
+// Returns TRUE if the plane passes through the box, i.e. if the
+// corners of the box are not all on the same side of it.
+static SbBool
+cvr_plane_intersects_box(const SbPlane & plane, const SbBox3f & box)
+{
+  SbVec3f bmin, bmax;
+  box.getBounds(bmin, bmax);
+
+  SbBool above = FALSE, below = FALSE;
+  for (int i = 0; i < 8; i++) {
+    const SbVec3f corner((i & 1) ? bmax[0] : bmin[0],
+                         (i & 2) ? bmax[1] : bmin[1],
+                         (i & 4) ? bmax[2] : bmin[2]);
+    const float d = plane.getDistance(corner);
+    if (d >= 0.0f) { above = TRUE; }
+    if (d <= 0.0f) { below = TRUE; }
+    if (above && below) { return TRUE; }
+  }
+  return FALSE;
 }
 
 
 // Renders *one* slice of the volume according to the specified
-// plane. Loads all the subcubes needed.
+// plane. Only the sub-cubes intersected by the plane are loaded.
 void
 Cvr3DTexCube::renderObliqueSlice(const SoGLRenderAction * action,
                                  const SbPlane plane)
@@ -505,21 +917,35 @@ Cvr3DTexCube::renderObliqueSlice(const SoGLRenderAction * action,
   viewvolume.transform(m);
   const SbMatrix mat = SoModelMatrixElement::get(state).inverse();
 
+  // The slice plane in the local coordinate system of the cube, set
+  // up from the same points as the slice polygon of
+  // Cvr3DTexSubCube::intersectSlice(). Sub-cubes it doesn't pass
+  // through are neither built nor sliced.
+  SbVec3f planepts[3];
+  planepts[0] = viewvolume.getPlanePoint(0, SbVec2f(-2.0f, 2.0f));
+  planepts[1] = viewvolume.getPlanePoint(0, SbVec2f(2.0f, 2.0f));
+  planepts[2] = viewvolume.getPlanePoint(0, SbVec2f(2.0f, -2.0f));
+  for (int i = 0; i < 3; i++) { mat.multVecMatrix(planepts[i], planepts[i]); }
+  const SbPlane localplane(planepts[0], planepts[1], planepts[2]);
+
   SbList <Cvr3DTexSubCubeItem *> subcubelist;
 
   for (unsigned int rowidx = 0; rowidx < this->nrrows; rowidx++) {
     for (unsigned int colidx = 0; colidx < this->nrcolumns; colidx++) {
       for (unsigned int depthidx = 0; depthidx < this->nrdepths; depthidx++) {
 
-        Cvr3DTexSubCube * cube = NULL;
-        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
-
         const SbVec3f subcubeorigo =
           this->origo +
           subcubewidth * (float)colidx +
           subcubeheight * (float)rowidx +
           subcubedepth * (float)depthidx;
 
+        const SbBox3f subbbox(subcubeorigo,
+                              subcubeorigo + subcubewidth + subcubeheight + subcubedepth);
+        if (!cvr_plane_intersects_box(localplane, subbbox)) { continue; }
+
+        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
+
         if (cubeitem == NULL) { 
           cubeitem = this->buildSubCube(action, subcubeorigo, colidx, rowidx, depthidx); 
         }
@@ -527,6 +953,7 @@ Cvr3DTexCube::renderObliqueSlice(const SoGLRenderAction * action,
 
         if (cubeitem->invisible) continue;
         assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
       
         cubeitem->cube->intersectSlice(viewvolume, 0, mat);
         subcubelist.append(cubeitem);
@@ -539,6 +966,333 @@ Cvr3DTexCube::renderObliqueSlice(const SoGLRenderAction * action,
 }
 
 
+// Renders the axis-aligned slice through the centers of the voxels
+// at index 'slice' along 'axis'. Only the layer of sub-cubes which
+// contains the slice is touched, so bricks already resident for
+// volume rendering are reused as they are, and no 2D pages need to be
+// extracted.
+void
+Cvr3DTexCube::renderOrthoSlice(const SoGLRenderAction * action,
+                               const unsigned int axis,
+                               const unsigned int slice)
+{
+  assert(axis < 3);
+  if (slice >= (unsigned int)this->dimensions[axis]) { return; }
+
+  SoState * state = action->getState();
+
+  const unsigned int nrcubes[3] = { this->nrcolumns, this->nrrows, this->nrdepths };
+
+  // The slice quad spans the full volume in the two other
+  // dimensions. Each sub-cube clips it down to its own extent.
+  const unsigned int a1 = (axis + 1) % 3;
+  const unsigned int a2 = (axis + 2) % 3;
+  const float depth = this->origo[axis] + (float)slice + 0.5f;
+
+  SbVec3f corners[4];
+  for (unsigned int i = 0; i < 4; i++) {
+    corners[i][axis] = depth;
+    corners[i][a1] = this->origo[a1] + (((i == 1) || (i == 2)) ? this->dimensions[a1] : 0);
+    corners[i][a2] = this->origo[a2] + ((i >= 2) ? this->dimensions[a2] : 0);
+  }
+
+  unsigned int cubeidx[3];
+  cubeidx[axis] = slice / this->subcubesize[axis];
+  assert(cubeidx[axis] < nrcubes[axis]);
+
+  SbList <Cvr3DTexSubCubeItem *> subcubelist;
+
+  for (cubeidx[a1] = 0; cubeidx[a1] < nrcubes[a1]; cubeidx[a1]++) {
+    for (cubeidx[a2] = 0; cubeidx[a2] < nrcubes[a2]; cubeidx[a2]++) {
+
+      const unsigned int colidx = cubeidx[0];
+      const unsigned int rowidx = cubeidx[1];
+      const unsigned int depthidx = cubeidx[2];
+
+      const SbVec3f subcubeorigo =
+        this->origo + SbVec3f((float)(this->subcubesize[0] * colidx),
+                              (float)(this->subcubesize[1] * rowidx),
+                              (float)(this->subcubesize[2] * depthidx));
+      const SbBox3f subbbox(subcubeorigo,
+                            subcubeorigo + SbVec3f((float)this->subcubesize[0],
+                                                   (float)this->subcubesize[1],
+                                                   (float)this->subcubesize[2]));
+
+      if (!CvrUtil::isInsideViewVolume(state, subbbox)) { continue; }
+
+      Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
+
+      if (cubeitem == NULL) {
+        cubeitem = this->buildSubCube(action, subcubeorigo, colidx, rowidx, depthidx);
+        this->cachemisses++;
+      }
+      else {
+        this->cachehits++;
+      }
+      assert(cubeitem != NULL);
+
+      if (cubeitem->invisible) continue;
+      assert(cubeitem->cube != NULL);
+      if (cubeitem->cube->isInvisible()) continue;
+
+      cubeitem->box = subbbox;
+      cubeitem->cube->intersectSlice(corners);
+      subcubelist.append(cubeitem);
+    }
+  }
+
+  this->renderResult(action, subcubelist);
+}
+
+
+// Renders a set of slices through the volume in one pass, with the
+// planes given in the local coordinate system of the cube. The
+// sub-cubes are rendered back-to-front, and within each sub-cube the
+// slice pieces are ordered by the distance from the camera to where
+// they cut through it, so transparent slices blend correctly against
+// each other (except where they intersect within a sub-cube).
+void
+Cvr3DTexCube::renderSlices(const SoGLRenderAction * action,
+                           const SbPlane * planes,
+                           const unsigned int numplanes)
+{
+  if (numplanes == 0) { return; }
+
+  SoState * state = action->getState();
+
+  SbViewVolume viewvolumeinv = SoViewVolumeElement::get(state);
+  viewvolumeinv.transform(SoModelMatrixElement::get(state).inverse());
+  const SbPlane invcamplane = viewvolumeinv.getPlane(0.0f);
+  const SbBool orthographic =
+    (viewvolumeinv.getProjectionType() == SbViewVolume::ORTHOGRAPHIC);
+  const SbVec3f eye = viewvolumeinv.getProjectionPoint();
+
+  // A quad on each plane large enough to cover the full volume, for
+  // the sub-cubes to clip down to their own extent.
+  const float halfsize = SbVec3f(this->dimensions[0], this->dimensions[1],
+                                 this->dimensions[2]).length();
+  SbList <SbVec3f> corners;
+  for (unsigned int i = 0; i < numplanes; i++) {
+    const SbVec3f & n = planes[i].getNormal();
+    const SbVec3f center = n * planes[i].getDistanceFromOrigin();
+    const SbVec3f up = (fabs(n[1]) < 0.9f) ? SbVec3f(0, 1, 0) : SbVec3f(0, 0, 1);
+    SbVec3f u = up.cross(n);
+    u.normalize();
+    SbVec3f v = n.cross(u);
+    v.normalize();
+    u *= halfsize;
+    v *= halfsize;
+    corners.append(center - u + v);
+    corners.append(center + u + v);
+    corners.append(center + u - v);
+    corners.append(center - u - v);
+  }
+
+  const SbVec3f subcubewidth(this->subcubesize[0], 0, 0);
+  const SbVec3f subcubeheight(0, this->subcubesize[1], 0);
+  const SbVec3f subcubedepth(0, 0, this->subcubesize[2]);
+
+  SbList <Cvr3DTexSubCubeItem *> subcubelist;
+
+  for (unsigned int rowidx = 0; rowidx < this->nrrows; rowidx++) {
+    for (unsigned int colidx = 0; colidx < this->nrcolumns; colidx++) {
+      for (unsigned int depthidx = 0; depthidx < this->nrdepths; depthidx++) {
+
+        const SbVec3f subcubeorigo =
+          this->origo +
+          subcubewidth * (float)colidx +
+          subcubeheight * (float)rowidx +
+          subcubedepth * (float)depthidx;
+
+        const SbBox3f subbbox(subcubeorigo,
+                              subcubeorigo + subcubewidth + subcubeheight + subcubedepth);
+        if (!CvrUtil::isInsideViewVolume(state, subbbox)) { continue; }
+
+        unsigned int i;
+        for (i = 0; i < numplanes; i++) {
+          if (cvr_plane_intersects_box(planes[i], subbbox)) { break; }
+        }
+        if (i == numplanes) { continue; }
+
+        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
+
+        if (cubeitem == NULL) {
+          cubeitem = this->buildSubCube(action, subcubeorigo, colidx, rowidx, depthidx);
+          this->cachemisses++;
+        }
+        else {
+          this->cachehits++;
+        }
+        assert(cubeitem != NULL);
+
+        if (cubeitem->invisible) continue;
+        assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
+
+        cubeitem->box = subbbox;
+        const SbVec3f center = subbbox.getCenter();
+        cubeitem->distancefromcamera = orthographic ?
+          -invcamplane.getDistance(center) : (eye - center).length();
+        subcubelist.append(cubeitem);
+      }
+    }
+  }
+
+  qsort((void *) subcubelist.getArrayPtr(), subcubelist.getLength(),
+        sizeof(Cvr3DTexSubCubeItem *), subcube_qsort_compare);
+
+  SbList <unsigned int> order;
+  SbList <float> distances;
+
+  for (int cubeidx = 0; cubeidx < subcubelist.getLength(); cubeidx++) {
+    Cvr3DTexSubCubeItem * cubeitem = subcubelist[cubeidx];
+    const SbVec3f center = cubeitem->box.getCenter();
+
+    // Sort the pieces in this sub-cube front-to-back, as the
+    // sub-cube renders its polygons in the opposite order of how
+    // they were added.
+    order.truncate(0);
+    distances.truncate(0);
+    for (unsigned int i = 0; i < numplanes; i++) {
+      if (!cvr_plane_intersects_box(planes[i], cubeitem->box)) { continue; }
+
+      const SbVec3f p = center - planes[i].getNormal() * planes[i].getDistance(center);
+      const float dist = orthographic ? -invcamplane.getDistance(p) : (eye - p).length();
+
+      int pos = order.getLength();
+      while ((pos > 0) && (distances[pos - 1] > dist)) { pos--; }
+      order.insert(i, pos);
+      distances.insert(dist, pos);
+    }
+
+    for (int i = 0; i < order.getLength(); i++) {
+      cubeitem->cube->intersectSlice(&corners[order[i] * 4]);
+    }
+  }
+
+  this->renderResult(action, subcubelist);
+}
+
+
+// Renders a set of planar quads, given as four corners each in the
+// local coordinate system of the cube. Only the sub-cubes touched by
+// the quads are loaded, which makes this suitable for rendering the
+// outer faces of the volume.
+void
+Cvr3DTexCube::renderFaces(const SoGLRenderAction * action,
+                          const SbVec3f * quads,
+                          const unsigned int numquads)
+{
+  if (numquads == 0) { return; }
+
+  SoState * state = action->getState();
+
+  SbViewVolume viewvolumeinv = SoViewVolumeElement::get(state);
+  viewvolumeinv.transform(SoModelMatrixElement::get(state).inverse());
+  const SbPlane invcamplane = viewvolumeinv.getPlane(0.0f);
+  const SbBool orthographic =
+    (viewvolumeinv.getProjectionType() == SbViewVolume::ORTHOGRAPHIC);
+  const SbVec3f eye = viewvolumeinv.getProjectionPoint();
+
+  SbList <SbBox3f> quadboxes;
+  for (unsigned int i = 0; i < numquads; i++) {
+    SbBox3f b;
+    for (unsigned int j = 0; j < 4; j++) { b.extendBy(quads[i * 4 + j]); }
+    quadboxes.append(b);
+  }
+
+  const SbVec3f subcubewidth(this->subcubesize[0], 0, 0);
+  const SbVec3f subcubeheight(0, this->subcubesize[1], 0);
+  const SbVec3f subcubedepth(0, 0, this->subcubesize[2]);
+
+  SbList <Cvr3DTexSubCubeItem *> subcubelist;
+
+  for (unsigned int rowidx = 0; rowidx < this->nrrows; rowidx++) {
+    for (unsigned int colidx = 0; colidx < this->nrcolumns; colidx++) {
+      for (unsigned int depthidx = 0; depthidx < this->nrdepths; depthidx++) {
+
+        const SbVec3f subcubeorigo =
+          this->origo +
+          subcubewidth * (float)colidx +
+          subcubeheight * (float)rowidx +
+          subcubedepth * (float)depthidx;
+
+        const SbBox3f subbbox(subcubeorigo,
+                              subcubeorigo + subcubewidth + subcubeheight + subcubedepth);
+
+        unsigned int i;
+        for (i = 0; i < numquads; i++) {
+          if (quadboxes[i].intersect(subbbox)) { break; }
+        }
+        if (i == numquads) { continue; }
+
+        if (!CvrUtil::isInsideViewVolume(state, subbbox)) { continue; }
+
+        Cvr3DTexSubCubeItem * cubeitem = this->getSubCube(state, colidx, rowidx, depthidx);
+
+        if (cubeitem == NULL) {
+          cubeitem = this->buildSubCube(action, subcubeorigo, colidx, rowidx, depthidx);
+          this->cachemisses++;
+        }
+        else {
+          this->cachehits++;
+        }
+        assert(cubeitem != NULL);
+
+        if (cubeitem->invisible) continue;
+        assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
+
+        cubeitem->box = subbbox;
+        const SbVec3f center = subbbox.getCenter();
+        cubeitem->distancefromcamera = orthographic ?
+          -invcamplane.getDistance(center) : (eye - center).length();
+        subcubelist.append(cubeitem);
+      }
+    }
+  }
+
+  qsort((void *) subcubelist.getArrayPtr(), subcubelist.getLength(),
+        sizeof(Cvr3DTexSubCubeItem *), subcube_qsort_compare);
+
+  SbList <unsigned int> order;
+  SbList <float> distances;
+
+  for (int cubeidx = 0; cubeidx < subcubelist.getLength(); cubeidx++) {
+    Cvr3DTexSubCubeItem * cubeitem = subcubelist[cubeidx];
+    const SbVec3f & bmin = cubeitem->box.getMin();
+    const SbVec3f & bmax = cubeitem->box.getMax();
+
+    // Front-to-back within the sub-cube, as for renderSlices().
+    order.truncate(0);
+    distances.truncate(0);
+    for (unsigned int i = 0; i < numquads; i++) {
+      if (!quadboxes[i].intersect(cubeitem->box)) { continue; }
+
+      // Center of the part of the quad inside the sub-cube.
+      const SbVec3f & qmin = quadboxes[i].getMin();
+      const SbVec3f & qmax = quadboxes[i].getMax();
+      SbVec3f p;
+      for (unsigned int a = 0; a < 3; a++) {
+        p[a] = (SbMax(qmin[a], bmin[a]) + SbMin(qmax[a], bmax[a])) / 2.0f;
+      }
+      const float dist = orthographic ? -invcamplane.getDistance(p) : (eye - p).length();
+
+      int pos = order.getLength();
+      while ((pos > 0) && (distances[pos - 1] > dist)) { pos--; }
+      order.insert(i, pos);
+      distances.insert(dist, pos);
+    }
+
+    for (int i = 0; i < order.getLength(); i++) {
+      cubeitem->cube->intersectSlice(&quads[order[i] * 4]);
+    }
+  }
+
+  this->renderResult(action, subcubelist);
+}
+
+
 // Renders a indexed faceset inside the volume. Loads all the subcubes needed.
 void
 Cvr3DTexCube::renderIndexedSet(const SoGLRenderAction * action,
@@ -581,6 +1335,7 @@ Cvr3DTexCube::renderIndexedSet(const SoGLRenderAction * action,
 
         if (cubeitem->invisible) continue;
         assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
 
         if (type == Cvr3DTexCube::INDEXEDFACE_SET) {
           cubeitem->cube->intersectIndexedFaceSet(vertexarray,
@@ -648,6 +1403,7 @@ Cvr3DTexCube::renderNonindexedSet(const SoGLRenderAction * action,
 
         if (cubeitem->invisible) continue;
         assert(cubeitem->cube != NULL);
+        if (cubeitem->cube->isInvisible()) continue;
 
         if (type == Cvr3DTexCube::FACE_SET) {
           cubeitem->cube->intersectFaceSet(vertexarray,
@@ -695,9 +1451,6 @@ Cvr3DTexCube::buildSubCube(const SoGLRenderAction * action,
                            const SbVec3f & subcubeorigo,
                            unsigned int col, unsigned int row, unsigned int depth)
 {
-  // FIXME: optimalization idea; *crop* textures for 100%
-  // transparency. 20021124 mortene.
-
   // FIXME: optimalization idea; detect 100% similar neighboring
   // cubes, and make cubes able to map to several "slice indices". Not
   // sure if this can be much of a gain -- but look into it. 20021124 mortene.
@@ -764,8 +1517,13 @@ Cvr3DTexCube::buildSubCube(const SoGLRenderAction * action,
 
   Cvr3DTexSubCube * cube = NULL;
   if (texobj) {
-    cube = new Cvr3DTexSubCube(action, texobj, subcubeorigo,
-                               subcubecut.getMax() - subcubecut.getMin());
+    // The texture may have been cropped to the non-transparent part
+    // of the sub-cube.
+    const SbBox3s & content = texobj->getContentBox();
+    const SbVec3s & contentmin = content.getMin();
+    cube = new Cvr3DTexSubCube(action, texobj,
+                               subcubeorigo + SbVec3f(contentmin[0], contentmin[1], contentmin[2]),
+                               content.getMax() - contentmin);
     cube->setPalette(this->clut);
   }
 
@@ -776,6 +1534,9 @@ Cvr3DTexCube::buildSubCube(const SoGLRenderAction * action,
   Cvr3DTexSubCubeItem * pitem = new Cvr3DTexSubCubeItem(cube);
   pitem->volumedataid = vbelem->getNodeId();
   pitem->invisible = (texobj == NULL) ? TRUE : FALSE;
+  pitem->col = col;
+  pitem->row = row;
+  pitem->depth = depth;
 
   const int idx = this->calcSubCubeIdx(row, col, depth);
   this->subcubes[idx] = pitem;
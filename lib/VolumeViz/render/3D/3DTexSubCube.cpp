@@ -38,6 +38,8 @@
 
 #include <Inventor/C/glue/gl.h>
 #include <Inventor/C/tidbits.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbBox3s.h>
 #include <Inventor/SbMatrix.h>
 #include <Inventor/SbViewVolume.h>
 #include <Inventor/actions/SoGLRenderAction.h>
@@ -49,6 +51,7 @@
 #include <VolumeViz/misc/CvrCLUT.h>
 #include <VolumeViz/misc/CvrUtil.h>
 #include <VolumeViz/render/common/Cvr3DPaletteTexture.h>
+#include <VolumeViz/render/common/CvrPaletteTexture.h>
 
 
 // *************************************************************************
@@ -81,27 +84,9 @@ Cvr3DTexSubCube::Cvr3DTexSubCube(const SoGLRenderAction * action,
   this->textureobject = texobj;
   this->textureobject->ref();
 
-  // Calculate clipplanes
-  this->clipplanes[0] = SbPlane(cubeorigo + SbVec3f(0.0f, this->dimensions[1], 0.0f),
-                                cubeorigo,
-                                cubeorigo + SbVec3f(this->dimensions[0], 0.0f, 0.0f));
-  this->clipplanes[1] = SbPlane(cubeorigo + SbVec3f(this->dimensions[0], 0.0f, this->dimensions[2]),
-                                cubeorigo + SbVec3f(0.0f, 0.0f, this->dimensions[2]),
-                                cubeorigo + SbVec3f(0.0f, this->dimensions[1], this->dimensions[2]));
-  this->clipplanes[2] = SbPlane(cubeorigo + SbVec3f(this->dimensions[0], 0.0f, 0.0f),
-                                cubeorigo,
-                                cubeorigo + SbVec3f(0.0f, 0.0f,  this->dimensions[2]));
-  this->clipplanes[3] = SbPlane(cubeorigo + SbVec3f(0.0f, this->dimensions[1], this->dimensions[2]),
-                                cubeorigo + SbVec3f(0.0f, this->dimensions[1], 0.0f),
-                                cubeorigo + SbVec3f(this->dimensions[0], this->dimensions[1], 0.0f));
-  this->clipplanes[4] = SbPlane(cubeorigo + SbVec3f(this->dimensions[0], this->dimensions[1], 0.0f),
-                                cubeorigo + SbVec3f(this->dimensions[0], 0.0f, 0.0f),
-                                cubeorigo + SbVec3f(this->dimensions[0], 0.0f, this->dimensions[2]));
-  this->clipplanes[5] = SbPlane(cubeorigo + SbVec3f(0.0f, 0.0f, this->dimensions[2]),
-                                cubeorigo,
-                                cubeorigo + SbVec3f(0.0f, this->dimensions[1], 0.0f));
-  
   this->origo = cubeorigo;
+  this->invisible = FALSE;
+  this->setClipBox(cubeorigo, cubeorigo + SbVec3f(cubesize[0], cubesize[1], cubesize[2]));
 
   this->volumesliceslength = 0;
 }
@@ -122,6 +107,15 @@ Cvr3DTexSubCube::isPaletted(void) const
 }
 
 
+// Returns TRUE if the sub-cube is known to contain only fully opaque
+// voxels with the current palette / transfer function.
+SbBool
+Cvr3DTexSubCube::isOpaque(void) const
+{
+  return this->textureobject->isOpaque(this->clut);
+}
+
+
 void
 Cvr3DTexSubCube::setPalette(const CvrCLUT * newclut)
 {
@@ -131,6 +125,83 @@ Cvr3DTexSubCube::setPalette(const CvrCLUT * newclut)
 
   this->clut = newclut;
   this->clut->ref();
+
+  this->updateClipBox();
+}
+
+
+// Returns TRUE if no voxels of the sub-cube are visible with the
+// current palette.
+SbBool
+Cvr3DTexSubCube::isInvisible(void) const
+{
+  return this->invisible;
+}
+
+
+// *************************************************************************
+
+// Set up the planes which slice polygons are clipped against.
+void
+Cvr3DTexSubCube::setClipBox(const SbVec3f & boxmin, const SbVec3f & boxmax)
+{
+  const SbVec3f d = boxmax - boxmin;
+
+  this->clipplanes[0] = SbPlane(boxmin + SbVec3f(0.0f, d[1], 0.0f),
+                                boxmin,
+                                boxmin + SbVec3f(d[0], 0.0f, 0.0f));
+  this->clipplanes[1] = SbPlane(boxmin + SbVec3f(d[0], 0.0f, d[2]),
+                                boxmin + SbVec3f(0.0f, 0.0f, d[2]),
+                                boxmin + SbVec3f(0.0f, d[1], d[2]));
+  this->clipplanes[2] = SbPlane(boxmin + SbVec3f(d[0], 0.0f, 0.0f),
+                                boxmin,
+                                boxmin + SbVec3f(0.0f, 0.0f, d[2]));
+  this->clipplanes[3] = SbPlane(boxmin + SbVec3f(0.0f, d[1], d[2]),
+                                boxmin + SbVec3f(0.0f, d[1], 0.0f),
+                                boxmin + SbVec3f(d[0], d[1], 0.0f));
+  this->clipplanes[4] = SbPlane(boxmin + SbVec3f(d[0], d[1], 0.0f),
+                                boxmin + SbVec3f(d[0], 0.0f, 0.0f),
+                                boxmin + SbVec3f(d[0], 0.0f, d[2]));
+  this->clipplanes[5] = SbPlane(boxmin + SbVec3f(0.0f, 0.0f, d[2]),
+                                boxmin,
+                                boxmin + SbVec3f(0.0f, d[1], 0.0f));
+}
+
+
+// For paletted textures, shrink the clip box to the part of the
+// sub-cube which is not fully transparent with the current palette,
+// to save fill-rate. (RGBA textures are already cropped when the
+// texture is made.)
+void
+Cvr3DTexSubCube::updateClipBox(void)
+{
+  this->invisible = FALSE;
+
+  const SbVec3f cubemax = this->origo +
+    SbVec3f(this->dimensions[0], this->dimensions[1], this->dimensions[2]);
+
+  SbBox3s visible;
+  if (!this->textureobject->isPaletted() ||
+      !((CvrPaletteTexture *)this->textureobject)->getVisibleBox(this->clut, visible)) {
+    this->setClipBox(this->origo, cubemax);
+    return;
+  }
+
+  if (visible.isEmpty()) {
+    this->invisible = TRUE;
+    return;
+  }
+
+  // Keep a one voxel border, so linear interpolation at the edges
+  // comes out the same as without the cropping.
+  SbVec3s vmin, vmax;
+  visible.getBounds(vmin, vmax);
+  SbVec3f boxmin, boxmax;
+  for (unsigned int i = 0; i < 3; i++) {
+    boxmin[i] = this->origo[i] + (float)SbMax(vmin[i] - 1, 0);
+    boxmax[i] = this->origo[i] + (float)SbMin(vmax[i] + 2, (int)this->dimensions[i]);
+  }
+  this->setClipBox(boxmin, boxmax);
 }
 
 
@@ -302,6 +373,28 @@ Cvr3DTexSubCube::intersectSlice(const SbVec3f * sliceplanecorners)
 }
 
 
+// As above, but keeps only the part of the slice which is within the
+// given region, in the same coordinate system as the cube.
+void
+Cvr3DTexSubCube::intersectSlice(const SbVec3f * sliceplanecorners,
+                                const SbBox3f & region)
+{
+  this->clippoly.reset();
+  for (unsigned int i=0; i < 4; i++) { this->clippoly.addVertex(sliceplanecorners[i]); }
+
+  SbVec3f regionmin, regionmax;
+  region.getBounds(regionmin, regionmax);
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    SbVec3f normal(0.0f, 0.0f, 0.0f);
+    normal[axis] = 1.0f;
+    this->clippoly.clip(SbPlane(normal, regionmin[axis]));
+    this->clippoly.clip(SbPlane(-normal, -regionmax[axis]));
+  }
+
+  this->clipPolygonAgainstCube();
+}
+
+
 // Check if this cube is intersected by the viewport aligned clip plane.
 void
 Cvr3DTexSubCube::intersectSlice(const SbViewVolume & viewvolume,
@@ -357,21 +450,13 @@ Cvr3DTexSubCube::clipPolygonAgainstCube(void)
   if (nrvertices >= 3) {
     const SbVec3s texdims = this->textureobject->getDimensions();
     SbVec3f vert;
-    subcube_slice * slice = NULL;
-
-    // We use our own tracking of the list-length, instead of doing
-    // SbList::truncate(), so we can reuse the list elements (to avoid
-    // unnecessary memory allocation).
-    const unsigned int reallength = (unsigned int)this->volumeslices.getLength();
-    assert(this->volumesliceslength <= reallength);
-    if (this->volumesliceslength == reallength) {
-      subcube_slice s;
-      this->volumeslices.append(s);
-    }
 
-    slice = &this->volumeslices[this->volumesliceslength++];
-    slice->vertex.truncate(0);
-    slice->texcoord.truncate(0);
+    // SbList::truncate() does not free memory, so the arrays will
+    // quickly settle at the size needed for the full slice set, and
+    // no allocations will be done in subsequent frames.
+    this->slicefirst.append((GLint)this->slicevertices.getLength());
+    this->slicecount.append((GLsizei)nrvertices);
+    this->volumesliceslength++;
 
     // Due to the padding of subcubes which are not of size 2^n, we'll
     // have to cap the calculated texture coordinate with one voxel to
@@ -387,14 +472,14 @@ Cvr3DTexSubCube::clipPolygonAgainstCube(void)
     
     for (unsigned int i=0; i < nrvertices; i++) {
       this->clippoly.getVertex(i, vert);
-      slice->vertex.append(vert);
+      this->slicevertices.append(vert);
       
       const SbVec3f dist = vert - this->origo;
       const SbVec3f v(dist[0] / texdimsmodded[0], 
                       dist[1] / texdimsmodded[1], 
                       dist[2] / texdimsmodded[2]);
 
-      slice->texcoord.append(v);
+      this->slicetexcoords.append(v);
     }
   }
 }
@@ -418,32 +503,43 @@ Cvr3DTexSubCube::renderSlices(const SoGLRenderAction * action, SbBool wireframe)
   if (CvrUtil::dontModulateTextures()) // Is texture mod. disabled by an envvar?
     glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 
-  // FIXME: Maybe we should build a vertex array instead of making
-  // glVertex3f calls. Would probably give a performance
-  // boost. (20040312 handegar)
-  //
-  // COMMENT 20040804 mortene: sounds unlikely to be a significant
-  // bottleneck, IMHO.
-
+  // The polygons were added front-to-back, so reverse the order for
+  // the draw batch.
+  this->drawfirst.truncate(0);
+  this->drawcount.truncate(0);
   for (int i = this->volumesliceslength - 1; i >= 0; --i) {
-    struct subcube_slice & slice = this->volumeslices[i];
+    this->drawfirst.append(this->slicefirst[i]);
+    this->drawcount.append(this->slicecount[i]);
+  }
 
-    glBegin(GL_TRIANGLE_FAN);
-    for (int j = 0; j < slice.vertex.getLength() ; ++j) {
-      glTexCoord3fv(slice.texcoord[j].getValue());
-      glVertex3fv(slice.vertex[j].getValue());
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  // SbVec3f is a plain float[3], so the lists can be handed directly
+  // to GL as tightly packed arrays.
+  glVertexPointer(3, GL_FLOAT, 0, this->slicevertices.getArrayPtr());
+  glTexCoordPointer(3, GL_FLOAT, 0, this->slicetexcoords.getArrayPtr());
+
+  const cc_glglue * glue = cc_glglue_instance(action->getCacheContext());
+  if (cc_glglue_has_multidraw_vertex_arrays(glue)) {
+    cc_glglue_glMultiDrawArrays(glue, GL_TRIANGLE_FAN,
+                                this->drawfirst.getArrayPtr(),
+                                this->drawcount.getArrayPtr(),
+                                this->volumesliceslength);
+  }
+  else {
+    for (unsigned int i = 0; i < this->volumesliceslength; i++) {
+      glDrawArrays(GL_TRIANGLE_FAN, this->drawfirst[i], this->drawcount[i]);
     }
-    glEnd();
-
-    slice.vertex.truncate(0);
-    slice.texcoord.truncate(0);
-
-    assert(glGetError() == GL_NO_ERROR);
   }
 
-  // We use our own tracking of the list-length, instead of doing
-  // SbList::truncate(), so we can reuse the list elements (to avoid
-  // unnecessary memory allocation).
+  glPopClientAttrib();
+
+  this->slicevertices.truncate(0);
+  this->slicetexcoords.truncate(0);
+  this->slicefirst.truncate(0);
+  this->slicecount.truncate(0);
   this->volumesliceslength = 0;
 
   if (!wireframe && this->textureobject->isPaletted()) {
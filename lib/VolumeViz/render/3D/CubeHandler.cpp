@@ -113,28 +113,23 @@ CvrCubeHandler::setPalette(const CvrCLUT * c)
   this->clut = c;
 }
 
+// Sets up the 3D texture cube and its palette, and the GL state
+// common to all the ways of rendering it, with alpha blending. Must
+// be followed by endRender().
 void
-CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, unsigned int numslices,
-                       CvrCubeHandler::Composition composition,
-                       SoVolumeRender::SoVolumeRenderAbortCB * abortfunc,
-                       void * abortcbdata)
+CvrCubeHandler::beginRender(SoGLRenderAction * action, const CvrCLUT::AlphaUse alphause)
 {
-  if (CvrUtil::doDebugging() && FALSE) {
-    SoDebugError::postInfo("CvrCubeHandler::render",
-                           "numslices==%u", numslices);
-  }
-
   SoState * state = action->getState();
   const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
   assert(vbelem != NULL);
 
   // Fetch light settings to detect if light has changed
-  const CvrLightingElement * lightelem = CvrLightingElement::getInstance(action->getState());
+  const CvrLightingElement * lightelem = CvrLightingElement::getInstance(state);
   assert(lightelem != NULL);  
-  const SbBool lighting = lightelem->useLighting(action->getState());
+  const SbBool lighting = lightelem->useLighting(state);
   SbVec3f lightDir;
   float lightIntensity;
-  lightelem->get(action->getState(), lightDir, lightIntensity);
+  lightelem->get(state, lightDir, lightIntensity);
   SbBool usePaletteTextures = CvrCLUT::usePaletteTextures(action);
 
   // Has the dataelement changed since last time?
@@ -157,6 +152,7 @@ CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, un
   const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
   const CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, alphause);
   if (this->clut != c) { this->setPalette(c); }
+  c->unref();
 
   // This must be done, as we want to control stuff in the GL state
   // machine. Without it, state changes could trigger outside our
@@ -176,11 +172,29 @@ CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, un
   // the Z-buffer test.
 
   glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
 
-  if (composition == CvrCubeHandler::ALPHA_BLENDING) {
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void
+CvrCubeHandler::endRender(void)
+{
+  glPopAttrib();
+}
+
+void
+CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, unsigned int numslices,
+                       CvrCubeHandler::Composition composition,
+                       SoVolumeRender::SoVolumeRenderAbortCB * abortfunc,
+                       void * abortcbdata)
+{
+  if (CvrUtil::doDebugging() && FALSE) {
+    SoDebugError::postInfo("CvrCubeHandler::render",
+                           "numslices==%u", numslices);
   }
-  else {
+
+  this->beginRender(action, alphause);
+
+  if (composition != CvrCubeHandler::ALPHA_BLENDING) {
     const cc_glglue * glglue = cc_glglue_instance(action->getCacheContext());
     if (!cc_glglue_has_blendequation(glglue)) {
       static SbBool first = TRUE;
@@ -192,7 +206,6 @@ CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, un
         first = FALSE;
       }
       // Fall back on ALPHA_BLENDING.
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
     else {
       if (composition == CvrCubeHandler::MAX_INTENSITY) {
@@ -235,9 +248,11 @@ CvrCubeHandler::render(SoGLRenderAction * action, CvrCLUT::AlphaUse alphause, un
   assert(glGetError() == GL_NO_ERROR);
 
   if (abortfunc != NULL) { this->volumecube->setAbortCallback(abortfunc, abortcbdata); }
+  // Opaque sub-cubes only hide what is behind them when blending.
+  this->volumecube->setOcclusionCulling(composition == CvrCubeHandler::ALPHA_BLENDING);
   this->volumecube->render(action, numslices);
 
-  glPopAttrib();
+  this->endRender();
 }
 
 
@@ -246,14 +261,6 @@ CvrCubeHandler::renderObliqueSlice(SoGLRenderAction * action,
                                    SoObliqueSlice::AlphaUse alphause,
                                    SbPlane plane)
 {
-  SoState * state = action->getState();
-
-  const CvrVoxelBlockElement * vbelem = CvrVoxelBlockElement::getInstance(state);
-  assert(vbelem != NULL);
- 
-  if (this->volumecube == NULL) { this->volumecube = new Cvr3DTexCube(action); }
-
-  const SoTransferFunctionElement * tfelement = SoTransferFunctionElement::getInstance(state);
   CvrCLUT::AlphaUse clutalphause;
   switch(alphause) {
     case SoObliqueSlice::ALPHA_AS_IS: clutalphause = CvrCLUT::ALPHA_AS_IS; break;
@@ -261,33 +268,65 @@ CvrCubeHandler::renderObliqueSlice(SoGLRenderAction * action,
     case SoObliqueSlice::ALPHA_BINARY: clutalphause = CvrCLUT::ALPHA_BINARY; break;
     default: assert(0 && "invalid alphause value"); break;
   }
-  CvrCLUT * c = CvrVoxelChunk::getCLUT(tfelement, clutalphause);
-  if (this->clut != c) {  
-    this->setPalette(c);  
-  }
 
-  // This must be done, as we want to control stuff in the GL state
-  // machine. Without it, state changes could trigger outside our
-  // control.
-  SoGLLazyElement::getInstance(state)->send(state, SoLazyElement::ALL_MASK);
+  this->beginRender(action, clutalphause);
+  assert(glGetError() == GL_NO_ERROR);
+   
+  this->volumecube->renderObliqueSlice(action, plane);
 
-  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  this->endRender();
+}
 
-  glDisable(GL_LIGHTING);
-  glEnable(GL_TEXTURE_3D);
+// Renders one axis-aligned slice through the 3D texture bricks. Used
+// by SoOrthoSlice when 3D textures are available, so the slice can
+// share bricks with SoVolumeRender instead of extracting 2D pages.
+// (RGBA bricks have the CLUT baked in, so they are only shared with
+// the same alpha use. Otherwise, full bricks are built for the slice.)
+void
+CvrCubeHandler::renderOrthoSlice(SoGLRenderAction * action,
+                                 CvrCLUT::AlphaUse alphause,
+                                 const unsigned int axis,
+                                 const unsigned int slice)
+{
+  this->beginRender(action, alphause);
+  assert(glGetError() == GL_NO_ERROR);
 
-  // FIXME: how does the blending cooperate with the other geometry in
-  // a Coin scene graph? Do we need to delay rendering? 20021109 mortene.
-  //
-  // UPDATE: yes, we do, or geometry that is traversed after this will
-  // not be rendered through the transparent parts because it fails
-  // the Z-buffer test.
+  this->volumecube->renderOrthoSlice(action, axis, slice);
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  this->endRender();
+}
+
+// Renders a set of slices in one pass, with a single GL state setup
+// and palette. The planes are in the local coordinate system of the
+// 3D texture cube, as set up by
+// CvrUtil::getTransformFromVolumeBoxDimensions().
+void
+CvrCubeHandler::renderSlices(SoGLRenderAction * action,
+                             CvrCLUT::AlphaUse alphause,
+                             const SbPlane * planes,
+                             const unsigned int numplanes)
+{
+  this->beginRender(action, alphause);
   assert(glGetError() == GL_NO_ERROR);
-   
-  this->volumecube->renderObliqueSlice(action, plane);
 
-  glPopAttrib();
+  this->volumecube->renderSlices(action, planes, numplanes);
+
+  this->endRender();
+}
+
+// Renders a set of quads (four corners each, in the same coordinate
+// system as for renderSlices()) with the volume texture, e.g. for the
+// outer faces of the volume.
+void
+CvrCubeHandler::renderFaces(SoGLRenderAction * action,
+                            CvrCLUT::AlphaUse alphause,
+                            const SbVec3f * quads,
+                            const unsigned int numquads)
+{
+  this->beginRender(action, alphause);
+  assert(glGetError() == GL_NO_ERROR);
+
+  this->volumecube->renderFaces(action, quads, numquads);
+
+  this->endRender();
 }
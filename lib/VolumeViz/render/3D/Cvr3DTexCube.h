@@ -37,10 +37,12 @@
 #error this is a private header file
 #endif // !SIMVOLEON_INTERNAL
 
+#include <Inventor/SbBox3f.h>
 #include <Inventor/SbVec3s.h>
 #include <VolumeViz/nodes/SoVolumeRender.h>
 
 class SoState;
+class SbViewVolume;
 class CvrCLUT;
 
 // *************************************************************************
@@ -58,6 +60,18 @@ public:
 
   void renderObliqueSlice(const SoGLRenderAction * action,
                           const SbPlane plane);
+
+  void renderOrthoSlice(const SoGLRenderAction * action,
+                        const unsigned int axis,
+                        const unsigned int slice);
+
+  void renderSlices(const SoGLRenderAction * action,
+                    const SbPlane * planes,
+                    const unsigned int numplanes);
+
+  void renderFaces(const SoGLRenderAction * action,
+                   const SbVec3f * quads,
+                   const unsigned int numquads);
  
   void renderIndexedSet(const SoGLRenderAction * action,
                         const SbVec3f * vertexarray,
@@ -78,6 +92,8 @@ public:
                                                           void * userdata);
   void setAbortCallback(SoVolumeRenderAbortCB * func, void * userdata);
 
+  void setOcclusionCulling(const SbBool enable);
+
 private:
   class Cvr3DTexSubCubeItem * getSubCube(SoState * state, unsigned int col, unsigned int row, unsigned int depth);
   class Cvr3DTexSubCubeItem * buildSubCube(const SoGLRenderAction * action,
@@ -91,9 +107,18 @@ private:
   unsigned int calcSubCubeIdx(unsigned int row, unsigned int col, unsigned int depth) const;
   void renderResult(const SoGLRenderAction * action, 
                     SbList <Cvr3DTexSubCubeItem *> & subcubelist);
+  void cullOccludedSubCubes(const SbViewVolume & viewvolume,
+                            const float slicedistance,
+                            SbList <Cvr3DTexSubCubeItem *> & subcubelist) const;
 
   static SbVec3s clampSubCubeSize(const SbVec3s & size);
 
+  SbBox3f trackROI(const SbBox3f & bounds);
+  SbBool getSubCubeRange(const SbBox3f & box,
+                         unsigned int mincube[3], unsigned int maxcube[3]) const;
+  void evictSubCubes(const SbBox3f & current, const SbBox3f & predicted);
+  void prefetchSubCubes(const SoGLRenderAction * action, const SbBox3f & predicted);
+
   class Cvr3DTexSubCubeItem ** subcubes;
 
   SbVec3s subcubesize;
@@ -107,6 +132,19 @@ private:
   SoVolumeRender::SoVolumeRenderAbortCB * abortfunc;
   void * abortfuncdata;
 
+  SbBool occlusionculling;
+
+  // Motion of the region of interest, in voxels per frame.
+  SbBool roitracked;
+  SbVec3f roicenter;
+  SbVec3f roivelocity;
+
+  // Sub-cube cache counters, for debugging and tuning.
+  unsigned int cachehits;
+  unsigned int cachemisses;
+  unsigned int prefetched;
+  unsigned int evicted;
+
   const CvrCLUT * clut;
 };
 
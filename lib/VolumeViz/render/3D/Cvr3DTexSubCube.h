@@ -38,7 +38,9 @@
 #include <Inventor/SbPlane.h>
 #include <Inventor/lists/SbList.h>
 #include <Inventor/SbClip.h>
+#include <Inventor/C/glue/gl.h>
 
+class SbBox3f;
 class SbMatrix;
 class SbViewVolume;
 class SoGLRenderAction;
@@ -62,7 +64,11 @@ public:
   SbBool isPaletted(void) const;
   void setPalette(const CvrCLUT * newclut);
 
+  SbBool isOpaque(void) const;
+  SbBool isInvisible(void) const;
+
   void intersectSlice(const SbVec3f * sliceplanecorners);
+  void intersectSlice(const SbVec3f * sliceplanecorners, const SbBox3f & region);
 
   // FIXME: this should be obsoleted, use the one above? 20040916 mortene.
   void intersectSlice(const SbViewVolume & viewvolume, 
@@ -97,6 +103,8 @@ private:
   void deactivateCLUT(const SoGLRenderAction * action); 
  
   void clipPolygonAgainstCube(void);
+  void setClipBox(const SbVec3f & boxmin, const SbVec3f & boxmax);
+  void updateClipBox(void);
 
   const CvrTextureObject * textureobject;
   const CvrCLUT * clut;
@@ -104,16 +112,22 @@ private:
   SbVec3s dimensions;
   SbVec3f origo;
 
-  struct subcube_slice {
-    SbList <SbVec3f> texcoord; 
-    SbList <SbVec3f> vertex;  
-  };
-
-  SbList <subcube_slice> volumeslices;
+  // All slice polygons of the sub-cube are kept in flat vertex
+  // arrays, with one (first, count) pair per polygon, so the complete
+  // set can be sent to GL in a single batch.
+  SbList <SbVec3f> slicetexcoords;
+  SbList <SbVec3f> slicevertices;
+  SbList <GLint> slicefirst;
+  SbList <GLsizei> slicecount;
   unsigned int volumesliceslength;
 
+  // Scratch buffers for the back-to-front ordered draw batch.
+  SbList <GLint> drawfirst;
+  SbList <GLsizei> drawcount;
+
   SbPlane clipplanes[6];
   SbClip clippoly;
+  SbBool invisible;
 };
 
 #endif // !SIMVOLEON_CVR3DTEXSUBPAGE_H
@@ -64,6 +64,21 @@ public:
                           SoObliqueSlice::AlphaUse alphause,
                           const SbPlane plane);
 
+  void renderOrthoSlice(SoGLRenderAction * action,
+                        CvrCLUT::AlphaUse alphause,
+                        const unsigned int axis,
+                        const unsigned int slice);
+
+  void renderSlices(SoGLRenderAction * action,
+                    CvrCLUT::AlphaUse alphause,
+                    const SbPlane * planes,
+                    const unsigned int numplanes);
+
+  void renderFaces(SoGLRenderAction * action,
+                   CvrCLUT::AlphaUse alphause,
+                   const SbVec3f * quads,
+                   const unsigned int numquads);
+
   unsigned int getCurrentAxis(SoGLRenderAction * action) const;
 
   void releaseAllSlices(void);
@@ -73,6 +88,8 @@ private:
   unsigned int getCurrentAxis(const SbVec3f & viewvec) const;
   void getViewVector(SoGLRenderAction * action, SbVec3f & direction) const;
   void setPalette(const CvrCLUT * c);
+  void beginRender(SoGLRenderAction * action, const CvrCLUT::AlphaUse alphause);
+  void endRender(void);
 
   Cvr3DTexCube * volumecube;
   const CvrCLUT * clut;
@@ -114,6 +114,8 @@ PointRendering::render(SoGLRenderAction * action)
   glEnd();
 
   glPopAttrib();
+
+  clut->unref();
 }
 
 // *************************************************************************
@@ -33,7 +33,9 @@
 #include <VolumeViz/render/common/Cvr3DRGBATexture.h>
 
 #include <assert.h>
+#include <string.h>
 #include <Inventor/C/tidbits.h>
+#include <Inventor/SbBasic.h>
 #include <Inventor/SbName.h>
 
 // *************************************************************************
@@ -61,10 +63,13 @@ Cvr3DRGBATexture::initClass(void)
 Cvr3DRGBATexture::Cvr3DRGBATexture(void)
 {
   assert(Cvr3DRGBATexture::classTypeId != SoType::badType());
+  this->compressedbuffer = NULL;
+  this->compressedsize = 0;
 }
 
 Cvr3DRGBATexture::~Cvr3DRGBATexture()
 {
+  delete[] this->compressedbuffer;
 }
 
 // *************************************************************************
@@ -128,3 +133,141 @@ Cvr3DRGBATexture::blankUnused(const SbVec3s & texsize) const
 }
 
 // *************************************************************************
+
+// Quantizes an 8-bit-per-component RGB color to the 5:6:5 format
+// used for the color endpoints of S3TC blocks.
+static inline uint16_t
+cvr_pack565(const uint8_t * rgb)
+{
+  return (uint16_t)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+// Compresses a block of 4x4 RGBA texels to a 16 byte DXT5 block. The
+// encoder is a simple and fast bounding box fit, which is good enough
+// for the smooth color ramps we usually get out of transfer
+// functions.
+static void
+cvr_compress_dxt5_block(const uint8_t texels[16][4], uint8_t * block)
+{
+  int i, c;
+
+  // Alpha: 8-value interpolation between the max and min value.
+  uint8_t amin = 255, amax = 0;
+  for (i = 0; i < 16; i++) {
+    amin = SbMin(amin, texels[i][3]);
+    amax = SbMax(amax, texels[i][3]);
+  }
+
+  block[0] = amax;
+  block[1] = amin;
+  uint32_t alphabits[2] = { 0, 0 }; // 2 x 24 bits
+  if (amax != amin) {
+    const int range = amax - amin;
+    for (i = 0; i < 16; i++) {
+      // 0 = amax, 7 = amin, with the codes in-between interpolated.
+      const int t = ((amax - texels[i][3]) * 7 + range / 2) / range;
+      const uint32_t code = (t == 0) ? 0 : ((t == 7) ? 1 : (t + 1));
+      alphabits[i / 8] |= code << ((i % 8) * 3);
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    block[2 + i] = (uint8_t)(alphabits[0] >> (i * 8));
+    block[5 + i] = (uint8_t)(alphabits[1] >> (i * 8));
+  }
+
+  // Color: 4-value interpolation between the corners of the RGB
+  // bounding box.
+  uint8_t cmin[3] = { 255, 255, 255 }, cmax[3] = { 0, 0, 0 };
+  for (i = 0; i < 16; i++) {
+    for (c = 0; c < 3; c++) {
+      cmin[c] = SbMin(cmin[c], texels[i][c]);
+      cmax[c] = SbMax(cmax[c], texels[i][c]);
+    }
+  }
+
+  const uint16_t c0 = cvr_pack565(cmax);
+  const uint16_t c1 = cvr_pack565(cmin);
+  block[8] = (uint8_t)(c0 & 0xff);
+  block[9] = (uint8_t)(c0 >> 8);
+  block[10] = (uint8_t)(c1 & 0xff);
+  block[11] = (uint8_t)(c1 >> 8);
+
+  uint32_t colorbits = 0;
+  if (c0 != c1) {
+    const int d[3] = { cmax[0] - cmin[0], cmax[1] - cmin[1], cmax[2] - cmin[2] };
+    const int dd = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    // Maps from position along the c0 -> c1 line to S3TC color code.
+    static const uint32_t codes[4] = { 0, 2, 3, 1 };
+    for (i = 0; i < 16; i++) {
+      int dot = 0;
+      for (c = 0; c < 3; c++) { dot += (cmax[c] - texels[i][c]) * d[c]; }
+      const int t = (dot * 3 + dd / 2) / dd;
+      colorbits |= codes[SbClamp(t, 0, 3)] << (i * 2);
+    }
+  }
+  for (i = 0; i < 4; i++) {
+    block[12 + i] = (uint8_t)(colorbits >> (i * 8));
+  }
+}
+
+// Returns TRUE if a texture with the given dimensions can be
+// compressed, i.e. all dimensions can be split into 4x4x4 blocks.
+SbBool
+Cvr3DRGBATexture::canCompress(const SbVec3s & dims)
+{
+  return ((dims[0] % 4) == 0) && ((dims[1] % 4) == 0) && ((dims[2] % 4) == 0);
+}
+
+// Compresses the RGBA buffer to DXT5 / S3TC format, for upload with
+// glCompressedTexImage3D(). The blocks are laid out as specified by
+// the GL_NV_texture_compression_vtc extension: each 4x4x4 block of
+// texels is stored as four consecutive DXT5 blocks, one for each
+// slice, and the 4x4x4 blocks are ordered with x running fastest,
+// then y, then z.
+//
+// The uncompressed buffer is kept, as the texture may also be used
+// in GL contexts without support for compressed 3D textures.
+void
+Cvr3DRGBATexture::compress(void)
+{
+  assert(this->rgbabuffer);
+  if (this->compressedbuffer) { return; }
+
+  const SbVec3s dims = this->getDimensions();
+  assert(Cvr3DRGBATexture::canCompress(dims));
+
+  // 16 bytes per 4x4 block.
+  this->compressedsize = (dims[0] / 4) * (dims[1] / 4) * dims[2] * 16;
+  this->compressedbuffer = new uint8_t[this->compressedsize];
+
+  const uint8_t * src = (const uint8_t *)this->rgbabuffer;
+  uint8_t * dst = this->compressedbuffer;
+  uint8_t texels[16][4];
+
+  for (int zgroup = 0; zgroup < dims[2]; zgroup += 4) {
+    for (int by = 0; by < dims[1]; by += 4) {
+      for (int bx = 0; bx < dims[0]; bx += 4) {
+        for (int z = zgroup; z < zgroup + 4; z++) {
+          for (int y = 0; y < 4; y++) {
+            const uint8_t * row =
+              src + ((z * dims[1] + by + y) * dims[0] + bx) * 4;
+            (void)memcpy(texels[y * 4], row, 4 * 4);
+          }
+          cvr_compress_dxt5_block(texels, dst);
+          dst += 16;
+        }
+      }
+    }
+  }
+
+  assert(dst == this->compressedbuffer + this->compressedsize);
+}
+
+// Returns the DXT5 compressed texture data, or NULL if compress()
+// has not been invoked.
+const uint8_t *
+Cvr3DRGBATexture::getCompressedBuffer(unsigned int & size) const
+{
+  size = this->compressedsize;
+  return this->compressedbuffer;
+}
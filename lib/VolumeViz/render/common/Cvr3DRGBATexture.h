@@ -50,11 +50,18 @@ public:
   virtual uint32_t * getRGBABuffer(void) const;
   void blankUnused(const SbVec3s & texsize) const;
 
+  static SbBool canCompress(const SbVec3s & dims);
+  void compress(void);
+  const uint8_t * getCompressedBuffer(unsigned int & size) const;
+
 protected:
   Cvr3DRGBATexture(void);
   virtual ~Cvr3DRGBATexture();
 
 private:
+  uint8_t * compressedbuffer;
+  unsigned int compressedsize;
+
   static SoType classTypeId;
   static void * createInstance(void);
 };
@@ -0,0 +1,356 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <VolumeViz/render/common/CvrImageCache.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/elements/SoProjectionMatrixElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/elements/SoViewingMatrixElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+
+#include <VolumeViz/misc/CvrResourceManager.h>
+
+// *************************************************************************
+
+static short
+cvr_next_power_of_two(short value)
+{
+  short p = 1;
+  while (p < value) { p <<= 1; }
+  return p;
+}
+
+// *************************************************************************
+
+CvrImageCache::CvrImageCache(void)
+{
+  this->ctxid = 0;
+  this->keyvalid = FALSE;
+  this->imagevalid = FALSE;
+  this->capture = FALSE;
+  this->depth = 0.0f;
+  this->texid = 0;
+  this->texsize = SbVec2s(0, 0);
+  this->background = NULL;
+  this->black = NULL;
+  this->image = NULL;
+}
+
+CvrImageCache::~CvrImageCache()
+{
+  if (this->texid != 0) {
+    CvrResourceManager::getInstance(this->ctxid)->killTexture(this->texid);
+  }
+  delete[] this->background;
+  delete[] this->black;
+  delete[] this->image;
+}
+
+// *************************************************************************
+
+void
+CvrImageCache::invalidate(void)
+{
+  this->keyvalid = FALSE;
+  this->imagevalid = FALSE;
+  this->capture = FALSE;
+}
+
+SbBool
+CvrImageCache::shouldCapture(void) const
+{
+  return this->capture;
+}
+
+SbBool
+CvrImageCache::lookup(SoGLRenderAction * action,
+                      const SbMatrix & modelmatrix, const SbBox3f & box,
+                      const SbList<uint32_t> & settings)
+{
+  SoState * state = action->getState();
+  const uint32_t ctx = action->getCacheContext();
+  const SbMatrix & viewmatrix = SoViewingMatrixElement::get(state);
+  const SbMatrix & projmatrix = SoProjectionMatrixElement::get(state);
+  const SbViewportRegion & vp = SoViewportRegionElement::get(state);
+  const SbVec2s & vporigin = vp.getViewportOriginPixels();
+  const SbVec2s & vpsize = vp.getViewportSizePixels();
+
+  SbBool same = this->keyvalid &&
+    (ctx == this->ctxid) &&
+    (modelmatrix == this->modelmatrix) &&
+    (viewmatrix == this->viewmatrix) &&
+    (projmatrix == this->projmatrix) &&
+    (vporigin == this->vporigin) &&
+    (vpsize == this->vpsize) &&
+    (settings.getLength() == this->settings.getLength());
+  for (int i = 0; same && (i < settings.getLength()); i++) {
+    same = (settings[i] == this->settings[i]);
+  }
+
+  if (same) {
+    // Second frame in a row with the same settings; it is likely
+    // that we will get more of them, so grab the image.
+    this->capture = !this->imagevalid;
+    return this->imagevalid;
+  }
+
+  if ((ctx != this->ctxid) && (this->texid != 0)) {
+    CvrResourceManager::getInstance(this->ctxid)->killTexture(this->texid);
+    this->texid = 0;
+    this->texsize = SbVec2s(0, 0);
+  }
+
+  this->ctxid = ctx;
+  this->modelmatrix = modelmatrix;
+  this->viewmatrix = viewmatrix;
+  this->projmatrix = projmatrix;
+  this->vporigin = vporigin;
+  this->vpsize = vpsize;
+  this->settings = settings;
+  this->keyvalid = TRUE;
+  this->imagevalid = FALSE;
+  this->capture = FALSE;
+
+  // Find the screen region covered by the volume, and the depth of
+  // its nearest point. The cached image is drawn at that depth, so
+  // geometry in front of the volume will not be overwritten.
+  const SbViewVolume & vv = SoViewVolumeElement::get(state);
+  const SbVec3f & bmin = box.getMin();
+  const SbVec3f & bmax = box.getMax();
+  SbBox3f screenbox;
+  SbBool behindeye = FALSE;
+  for (unsigned int c = 0; c < 8; c++) {
+    SbVec3f corner((c & 1) ? bmax[0] : bmin[0],
+                   (c & 2) ? bmax[1] : bmin[1],
+                   (c & 4) ? bmax[2] : bmin[2]);
+    modelmatrix.multVecMatrix(corner, corner);
+
+    if ((vv.getProjectionType() == SbViewVolume::PERSPECTIVE) &&
+        ((corner - vv.getProjectionPoint()).dot(vv.getProjectionDirection()) <
+         vv.getNearDist())) {
+      behindeye = TRUE;
+      break;
+    }
+
+    SbVec3f screenpt;
+    vv.projectToScreen(corner, screenpt);
+    screenbox.extendBy(screenpt);
+  }
+
+  if (behindeye) {
+    this->origin = vporigin;
+    this->size = vpsize;
+    this->depth = 0.0f;
+  }
+  else {
+    const SbVec3f & smin = screenbox.getMin();
+    const SbVec3f & smax = screenbox.getMax();
+    short x0 = (short)SbMax(smin[0] * vpsize[0] - 1.0f, 0.0f);
+    short y0 = (short)SbMax(smin[1] * vpsize[1] - 1.0f, 0.0f);
+    short x1 = (short)SbMin(smax[0] * vpsize[0] + 2.0f, (float)vpsize[0]);
+    short y1 = (short)SbMin(smax[1] * vpsize[1] + 2.0f, (float)vpsize[1]);
+    this->origin = SbVec2s(vporigin[0] + x0, vporigin[1] + y0);
+    this->size = SbVec2s((short)SbMax(x1 - x0, 0), (short)SbMax(y1 - y0, 0));
+    this->depth = SbMax(smin[2], 0.0f);
+  }
+
+  return FALSE;
+}
+
+// *************************************************************************
+
+void
+CvrImageCache::beginCapture(SoGLRenderAction * action)
+{
+  assert(this->capture);
+
+  const int bytes = this->size[0] * this->size[1] * 4;
+  delete[] this->background;
+  delete[] this->black;
+  delete[] this->image;
+  this->background = new unsigned char[bytes];
+  this->black = new unsigned char[bytes];
+  this->image = new unsigned char[bytes];
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(this->origin[0], this->origin[1], this->size[0], this->size[1],
+               GL_RGBA, GL_UNSIGNED_BYTE, this->background);
+
+  // Popped in endCapture().
+  glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_SCISSOR_BIT);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(this->origin[0], this->origin[1], this->size[0], this->size[1]);
+  // The volume is rendered twice, so it must not hide itself.
+  glDepthMask(GL_FALSE);
+
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void
+CvrImageCache::nextCapturePass(SoGLRenderAction * action)
+{
+  glReadPixels(this->origin[0], this->origin[1], this->size[0], this->size[1],
+               GL_RGBA, GL_UNSIGNED_BYTE, this->black);
+
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void
+CvrImageCache::endCapture(SoGLRenderAction * action)
+{
+  glReadPixels(this->origin[0], this->origin[1], this->size[0], this->size[1],
+               GL_RGBA, GL_UNSIGNED_BYTE, this->image);
+  glPopAttrib();
+
+  // On black, we get the (premultiplied) color of the volume. On
+  // white, we get that color plus the transparency.
+  const int nrpixels = this->size[0] * this->size[1];
+  for (int i = 0; i < nrpixels; i++) {
+    const unsigned char * b = &this->black[i * 4];
+    unsigned char * w = &this->image[i * 4];
+    const int t = ((w[0] - b[0]) + (w[1] - b[1]) + (w[2] - b[2])) / 3;
+    w[0] = b[0];
+    w[1] = b[1];
+    w[2] = b[2];
+    w[3] = (unsigned char)(255 - SbMin(SbMax(t, 0), 255));
+  }
+
+  delete[] this->black;
+  this->black = NULL;
+
+  this->capture = FALSE;
+  this->imagevalid = TRUE;
+
+  this->drawImage(this->background, FALSE);
+  delete[] this->background;
+  this->background = NULL;
+
+  this->render(action);
+}
+
+// *************************************************************************
+
+void
+CvrImageCache::render(SoGLRenderAction * action)
+{
+  assert(this->imagevalid);
+  this->drawImage(this->image, TRUE);
+}
+
+void
+CvrImageCache::drawImage(const unsigned char * pixels, SbBool blend)
+{
+  if ((this->size[0] == 0) || (this->size[1] == 0)) { return; }
+
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+  if (this->texid == 0) { glGenTextures(1, &this->texid); }
+  glBindTexture(GL_TEXTURE_2D, this->texid);
+
+  if ((this->size[0] > this->texsize[0]) || (this->size[1] > this->texsize[1])) {
+    this->texsize = SbVec2s(cvr_next_power_of_two(this->size[0]),
+                            cvr_next_power_of_two(this->size[1]));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->texsize[0], this->texsize[1],
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->size[0], this->size[1],
+                  GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  glDisable(GL_LIGHTING);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_TEXTURE_3D);
+  glEnable(GL_TEXTURE_2D);
+  glDepthMask(GL_FALSE);
+
+  if (blend) {
+    // The image has premultiplied colors.
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+  }
+  else {
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+  }
+
+  glMatrixMode(GL_TEXTURE);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // Normalized device coordinates of the region within the viewport.
+  const float x0 = float(this->origin[0] - this->vporigin[0]) / this->vpsize[0] * 2.0f - 1.0f;
+  const float y0 = float(this->origin[1] - this->vporigin[1]) / this->vpsize[1] * 2.0f - 1.0f;
+  const float x1 = x0 + float(this->size[0]) / this->vpsize[0] * 2.0f;
+  const float y1 = y0 + float(this->size[1]) / this->vpsize[1] * 2.0f;
+  const float z = this->depth * 2.0f - 1.0f;
+  const float s = float(this->size[0]) / this->texsize[0];
+  const float t = float(this->size[1]) / this->texsize[1];
+
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0f, 0.0f); glVertex3f(x0, y0, z);
+  glTexCoord2f(s, 0.0f); glVertex3f(x1, y0, z);
+  glTexCoord2f(s, t); glVertex3f(x1, y1, z);
+  glTexCoord2f(0.0f, t); glVertex3f(x0, y1, z);
+  glEnd();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_TEXTURE);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+
+  glPopAttrib();
+}
+
+// *************************************************************************
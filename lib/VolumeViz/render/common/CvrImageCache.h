@@ -0,0 +1,105 @@
+#ifndef SIMVOLEON_CVRIMAGECACHE_H
+#define SIMVOLEON_CVRIMAGECACHE_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SbVec2s.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
+
+class SoGLRenderAction;
+
+// *************************************************************************
+
+// Keeps the composited image of a volume rendering, to avoid slicing
+// and compositing the volume again when only other parts of the
+// scene have changed.
+//
+// The image is captured by rendering the volume twice, on black and
+// on white background, from which colors and transparency are found.
+// This is only done when the same settings have been used for two
+// frames in a row, so there is no extra cost while e.g. the camera
+// is moving.
+
+class CvrImageCache {
+public:
+  CvrImageCache(void);
+  ~CvrImageCache();
+
+  // Returns TRUE if the cached image can be used for the current
+  // state. settings should contain anything besides the camera and
+  // model transform which influences the rendering.
+  SbBool lookup(SoGLRenderAction * action,
+                const SbMatrix & modelmatrix, const SbBox3f & box,
+                const SbList<uint32_t> & settings);
+
+  // Returns TRUE if the image should be captured for this frame,
+  // after a failed lookup().
+  SbBool shouldCapture(void) const;
+
+  void render(SoGLRenderAction * action);
+
+  void beginCapture(SoGLRenderAction * action);
+  void nextCapturePass(SoGLRenderAction * action);
+  void endCapture(SoGLRenderAction * action);
+
+  void invalidate(void);
+
+private:
+  void drawImage(const unsigned char * pixels, SbBool blend);
+
+  uint32_t ctxid;
+  SbMatrix modelmatrix, viewmatrix, projmatrix;
+  SbVec2s vporigin, vpsize;
+  SbList<uint32_t> settings;
+  SbBool keyvalid;
+  SbBool imagevalid;
+  SbBool capture;
+
+  // Screen region covered by the volume, and its nearest depth.
+  SbVec2s origin, size;
+  float depth;
+
+  GLuint texid;
+  SbVec2s texsize;
+
+  unsigned char * background;
+  unsigned char * black;
+  unsigned char * image;
+};
+
+// *************************************************************************
+
+#endif // !SIMVOLEON_CVRIMAGECACHE_H
@@ -59,13 +59,17 @@ CvrPaletteTexture::CvrPaletteTexture(void)
 {
   assert(CvrPaletteTexture::classTypeId != SoType::badType());
   this->indexbuffer = NULL;
+  this->indexboxes = NULL;
   this->clut = NULL;
+  // Until told otherwise, assume all indices are in use.
+  for (unsigned int i = 0; i < 8; i++) { this->usedindices[i] = 0xffffffff; }
 }
 
 CvrPaletteTexture::~CvrPaletteTexture()
 {
   if (this->clut) this->clut->unref();
   if (this->indexbuffer) delete [] this->indexbuffer;
+  delete [] this->indexboxes;
 }
 
 // *************************************************************************
@@ -94,3 +98,47 @@ CvrPaletteTexture::getCLUT(void) const
 }
 
 // *************************************************************************
+
+void
+CvrPaletteTexture::setUsedIndices(const uint32_t usedindices[8])
+{
+  for (unsigned int i = 0; i < 8; i++) { this->usedindices[i] = usedindices[i]; }
+}
+
+// Returns TRUE if all texels will be fully opaque when looked up in
+// \a table.
+SbBool
+CvrPaletteTexture::isOpaque(const CvrCLUT * table) const
+{
+  assert(table != NULL);
+  return table->isOpaque(this->usedindices);
+}
+
+void
+CvrPaletteTexture::setIndexBoxes(const SbBox3s indexboxes[256])
+{
+  if (this->indexboxes == NULL) { this->indexboxes = new SbBox3s[256]; }
+  for (unsigned int i = 0; i < 256; i++) { this->indexboxes[i] = indexboxes[i]; }
+}
+
+// Finds the bounding box, in texel coordinates, of all texels which
+// are not fully transparent when looked up in \a table. The box will
+// be empty if all texels are invisible.
+//
+// Returns FALSE if no per-index information was stored for the
+// texture, and the visible part is therefore unknown.
+SbBool
+CvrPaletteTexture::getVisibleBox(const CvrCLUT * table, SbBox3s & box) const
+{
+  assert(table != NULL);
+  if (this->indexboxes == NULL) { return FALSE; }
+
+  box.makeEmpty();
+  for (unsigned int i = 0; i < 256; i++) {
+    if (this->indexboxes[i].isEmpty() || table->isTransparent(i)) { continue; }
+    box.extendBy(this->indexboxes[i]);
+  }
+  return TRUE;
+}
+
+// *************************************************************************
@@ -53,6 +53,12 @@ public:
   const CvrCLUT * getCLUT(void) const;
 
   virtual SbBool isPaletted(void) const { return TRUE; }
+  virtual SbBool isOpaque(const CvrCLUT * clut) const;
+
+  void setUsedIndices(const uint32_t usedindices[8]);
+
+  void setIndexBoxes(const SbBox3s indexboxes[256]);
+  SbBool getVisibleBox(const CvrCLUT * table, SbBox3s & box) const;
 
 protected:
   CvrPaletteTexture(void);
@@ -62,6 +68,12 @@ protected:
 
 private:
   const CvrCLUT * clut;
+  // Bitmask of the color indices present in the texture, so we can
+  // decide opacity for any palette without scanning the texels.
+  uint32_t usedindices[8];
+  // Bounding box of the texels for each color index, so the visible
+  // part of the texture can be found for any palette.
+  SbBox3s * indexboxes;
   static SoType classTypeId;
 };
 
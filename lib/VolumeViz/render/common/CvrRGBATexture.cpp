@@ -58,6 +58,7 @@ CvrRGBATexture::CvrRGBATexture(void)
 {
   assert(CvrRGBATexture::classTypeId != SoType::badType());
   this->rgbabuffer = NULL;
+  this->opaque = FALSE;
 }
 
 CvrRGBATexture::~CvrRGBATexture()
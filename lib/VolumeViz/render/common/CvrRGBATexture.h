@@ -48,6 +48,9 @@ public:
   virtual uint32_t * getRGBABuffer(void) const;
 
   virtual SbBool isPaletted(void) const { return FALSE; }
+  virtual SbBool isOpaque(const CvrCLUT * clut) const { return this->opaque; }
+
+  void setOpaque(const SbBool flag) { this->opaque = flag; }
 
 protected:
   CvrRGBATexture(void);
@@ -56,6 +59,7 @@ protected:
   uint32_t * rgbabuffer;
 
 private:
+  SbBool opaque;
   static SoType classTypeId;
 };
 
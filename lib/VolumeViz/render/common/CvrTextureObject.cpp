@@ -38,6 +38,7 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #include <Inventor/C/glue/gl.h>
 #include <Inventor/C/tidbits.h>
@@ -47,6 +48,7 @@
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/elements/SoCacheElement.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/threads/SbMutex.h>
 
 #include <VolumeViz/caches/CvrGLTextureCache.h>
 #include <VolumeViz/elements/CvrCompressedTexturesElement.h>
@@ -54,6 +56,7 @@
 #include <VolumeViz/elements/CvrVoxelBlockElement.h>
 #include <VolumeViz/elements/CvrLightingElement.h>
 #include <VolumeViz/misc/CvrCLUT.h>
+#include <VolumeViz/misc/CvrResourceManager.h>
 #include <VolumeViz/misc/CvrUtil.h>
 #include <VolumeViz/misc/CvrVoxelChunk.h>
 #include <VolumeViz/render/common/Cvr2DRGBATexture.h>
@@ -137,6 +140,9 @@ SoType CvrTextureObject::getClassTypeId(void) { return CvrTextureObject::classTy
 // *************************************************************************
 
 SbDict * CvrTextureObject::instancedict = NULL;
+// Guards instancedict, which is used from the render threads of all
+// volumes.
+SbMutex * CvrTextureObject::instancedictmutex = NULL;
 
 // *************************************************************************
 
@@ -151,6 +157,185 @@ cvr_debug_textureuse(void)
   return val > 0 ? TRUE : FALSE;
 }
 
+// Returns TRUE if we can make textures with dimensions that are not
+// power-of-two's in the given context. This saves a lot of texture
+// memory for volumes with odd dimensions, where the border sub-cubes
+// would otherwise have to be padded up to nearly twice the size along
+// each axis.
+static SbBool
+cvr_use_npot_textures(const cc_glglue * glw, SbBool paletteextension)
+{
+  static int disable = -1;
+  if (disable == -1) {
+    const char * env = coin_getenv("CVR_NO_NPOT_TEXTURES");
+    disable = env && (atoi(env) > 0);
+  }
+  if (disable) { return FALSE; }
+
+  // Don't mix with the old paletted texture extension, as that is
+  // unlikely to have been tested with NPOT textures by the driver
+  // vendors.
+  if (paletteextension) { return FALSE; }
+
+  return
+    cc_glglue_glversion_matches_at_least(glw, 2, 0, 0) ||
+    cc_glglue_glext_supported(glw, "GL_ARB_texture_non_power_of_two");
+}
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif // !GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+
+// Returns TRUE if 3D textures can be uploaded as pre-compressed
+// S3TC data. Compressing on the CPU ourselves is both much faster
+// and gives more predictable results than leaving the job to the
+// driver through the generic GL_COMPRESSED_RGBA_ARB format.
+static SbBool
+cvr_use_s3tc_3d_textures(const cc_glglue * glw)
+{
+  return
+    cc_glue_has_texture_compression(glw) &&
+    cc_glglue_glext_supported(glw, "GL_EXT_texture_compression_s3tc") &&
+    cc_glglue_glext_supported(glw, "GL_NV_texture_compression_vtc");
+}
+
+// *************************************************************************
+
+#ifndef GL_PIXEL_UNPACK_BUFFER_ARB
+#define GL_PIXEL_UNPACK_BUFFER_ARB 0x88EC
+#endif // !GL_PIXEL_UNPACK_BUFFER_ARB
+#ifndef GL_STREAM_DRAW_ARB
+#define GL_STREAM_DRAW_ARB 0x88E0
+#endif // !GL_STREAM_DRAW_ARB
+#ifndef GL_WRITE_ONLY_ARB
+#define GL_WRITE_ONLY_ARB 0x88B9
+#endif // !GL_WRITE_ONLY_ARB
+
+// Ring of pixel buffer objects used for streaming texture data to
+// the GL. Cycling through several buffers (and orphaning the storage
+// of each before mapping it) lets the driver keep consuming earlier
+// uploads while we copy the next brick into mapped memory, instead
+// of blocking on a synchronous glTexImage3D() from client memory.
+#define CVR_UPLOAD_RING_SIZE 4
+
+struct cvr_upload_ring {
+  GLuint buffers[CVR_UPLOAD_RING_SIZE];
+  unsigned int next;
+  // The ring is shared by all contexts in a share group, which may
+  // upload from different threads.
+  SbMutex mutex;
+};
+
+// Key for storing the ring in CvrResourceManager::getInstance().
+static const char * CVR_UPLOAD_RING_KEYID = "cvr_upload_ring";
+
+// Guards against making two rings for the same share group.
+static SbMutex * cvr_upload_ring_mutex = NULL;
+
+static void
+cvr_upload_ring_destruct(void * closure, uint32_t ctxid)
+{
+  CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
+  void * ptr;
+  const SbBool ok = rm->get(CVR_UPLOAD_RING_KEYID, ptr);
+  assert(ok);
+
+  struct cvr_upload_ring * ring = (struct cvr_upload_ring *)ptr;
+  const cc_glglue * glw = cc_glglue_instance(ctxid);
+  cc_glglue_glDeleteBuffers(glw, CVR_UPLOAD_RING_SIZE, ring->buffers);
+
+  rm->remove(CVR_UPLOAD_RING_KEYID);
+  delete ring;
+}
+
+static SbBool
+cvr_use_pbo_uploads(const cc_glglue * glw)
+{
+  static int disable = -1;
+  if (disable == -1) {
+    const char * env = coin_getenv("CVR_NO_PBO_UPLOADS");
+    disable = env && (atoi(env) > 0);
+  }
+  if (disable) { return FALSE; }
+
+  return
+    cc_glglue_has_vertex_buffer_object(glw) &&
+    (cc_glglue_glversion_matches_at_least(glw, 2, 1, 0) ||
+     cc_glglue_glext_supported(glw, "GL_ARB_pixel_buffer_object"));
+}
+
+// Copies the texels into the next buffer of the context's upload
+// ring, and leaves that buffer bound to GL_PIXEL_UNPACK_BUFFER. The
+// "pixels" argument to the following glTex[Sub]Image*() call is then
+// an offset into the buffer (i.e. NULL), and cvr_unstage_texels()
+// must be called afterwards.
+//
+// Returns FALSE if the data could not be staged through a buffer
+// object, in which case nothing is left bound, and the caller should
+// upload straight from client memory.
+static SbBool
+cvr_stage_texels(uint32_t ctxid, const void * texels, const size_t size)
+{
+  const cc_glglue * glw = cc_glglue_instance(ctxid);
+  if (!cvr_use_pbo_uploads(glw)) { return FALSE; }
+
+  CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
+  void * ptr;
+  cvr_upload_ring_mutex->lock();
+  if (!rm->get(CVR_UPLOAD_RING_KEYID, ptr)) {
+    struct cvr_upload_ring * newring = new struct cvr_upload_ring;
+    cc_glglue_glGenBuffers(glw, CVR_UPLOAD_RING_SIZE, newring->buffers);
+    newring->next = 0;
+    ptr = newring;
+    rm->set(CVR_UPLOAD_RING_KEYID, ptr, cvr_upload_ring_destruct, NULL);
+  }
+  cvr_upload_ring_mutex->unlock();
+
+  struct cvr_upload_ring * ring = (struct cvr_upload_ring *)ptr;
+  ring->mutex.lock();
+  const GLuint buffer = ring->buffers[ring->next];
+  ring->next = (ring->next + 1) % CVR_UPLOAD_RING_SIZE;
+
+  cc_glglue_glBindBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB, buffer);
+  // Orphan the previous storage, so mapping won't have to wait for
+  // the GL to finish reading from it.
+  cc_glglue_glBufferData(glw, GL_PIXEL_UNPACK_BUFFER_ARB, size, NULL,
+                         GL_STREAM_DRAW_ARB);
+  void * dst = cc_glglue_glMapBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB,
+                                     GL_WRITE_ONLY_ARB);
+  if (dst == NULL) {
+    cc_glglue_glBindBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    ring->mutex.unlock();
+    return FALSE;
+  }
+
+  (void)memcpy(dst, texels, size);
+
+  if (!cc_glglue_glUnmapBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB)) {
+    // The buffer contents were lost (e.g. on a display mode change).
+    cc_glglue_glBindBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    ring->mutex.unlock();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+// Unbinds the buffer bound by a successful cvr_stage_texels(), and
+// releases the upload ring.
+static void
+cvr_unstage_texels(uint32_t ctxid)
+{
+  const cc_glglue * glw = cc_glglue_instance(ctxid);
+  cc_glglue_glBindBuffer(glw, GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+  CvrResourceManager * rm = CvrResourceManager::getInstance(ctxid);
+  void * ptr;
+  const SbBool ok = rm->get(CVR_UPLOAD_RING_KEYID, ptr);
+  assert(ok);
+  ((struct cvr_upload_ring *)ptr)->mutex.unlock();
+}
+
 // *************************************************************************
 
 
@@ -171,6 +356,8 @@ CvrTextureObject::initClass(void)
 
   // FIXME: leak, never deallocated. 20040721 mortene.
   CvrTextureObject::instancedict = new SbDict;
+  CvrTextureObject::instancedictmutex = new SbMutex;
+  cvr_upload_ring_mutex = new SbMutex;
 }
 
 
@@ -178,6 +365,8 @@ CvrTextureObject::CvrTextureObject(void)
 {
   assert(CvrTextureObject::classTypeId != SoType::badType());
   this->refcounter = 0;
+  this->indict = FALSE;
+  this->eqcmp.clut = NULL;
 }
 
 
@@ -198,24 +387,33 @@ CvrTextureObject::~CvrTextureObject()
 
   // Take us out of the static list of all CvrTextureObject instances:
 
-  const unsigned long key = this->hashKey();
-  void * ptr;
-  const SbBool ok = CvrTextureObject::instancedict->find(key, ptr);
-  assert(ok);
-
-  // Calculated hash key is not guaranteed to be unique, so a list is
-  // stored in the hash, which we must do comparisons on the elements
-  // in.
-  SbList<CvrTextureObject *> * l = (SbList<CvrTextureObject *> *)ptr;
-  const int idx = l->find(this);
-  assert(idx != -1);
-  l->removeFast(idx);
+  // (Objects thrown away by create() were never put there.)
+  if (this->indict) {
+    CvrTextureObject::instancedictmutex->lock();
 
-  if (l->getLength() == 0) {
-    delete l;
-    const SbBool ok = CvrTextureObject::instancedict->remove(key);
+    const unsigned long key = this->hashKey();
+    void * ptr;
+    const SbBool ok = CvrTextureObject::instancedict->find(key, ptr);
     assert(ok);
+
+    // Calculated hash key is not guaranteed to be unique, so a list is
+    // stored in the hash, which we must do comparisons on the elements
+    // in.
+    SbList<CvrTextureObject *> * l = (SbList<CvrTextureObject *> *)ptr;
+    const int idx = l->find(this);
+    assert(idx != -1);
+    l->removeFast(idx);
+
+    if (l->getLength() == 0) {
+      delete l;
+      const SbBool ok = CvrTextureObject::instancedict->remove(key);
+      assert(ok);
+    }
+
+    CvrTextureObject::instancedictmutex->unlock();
   }
+
+  if (this->eqcmp.clut) { this->eqcmp.clut->unref(); }
 }
 
 
@@ -228,6 +426,16 @@ CvrTextureObject::getDimensions(void) const
   return this->dimensions;
 }
 
+// Returns the part of the requested cut which is actually held in the
+// texture, relative to the lower corner of the cut. This will be
+// smaller than the cut when fully transparent borders were cropped
+// away.
+const SbBox3s &
+CvrTextureObject::getContentBox(void) const
+{
+  return this->contentbox;
+}
+
 
 // *************************************************************************
 
@@ -235,8 +443,10 @@ CvrTextureObject::getDimensions(void) const
 SbList<CvrGLTextureCache *> *
 CvrTextureObject::cacheListForGLContext(const uint32_t glctxid) const
 {
+  // Textures are shared by all contexts in a share group.
+  const uint32_t group = CvrResourceManager::getShareGroup(glctxid);
   void * ptr;
-  const SbBool found = this->glctxdict.find((unsigned long)glctxid, ptr);
+  const SbBool found = this->glctxdict.find((unsigned long)group, ptr);
   if (!found) { return NULL; }
   return (SbList<CvrGLTextureCache *> *)ptr;
 }
@@ -475,12 +685,24 @@ CvrTextureObject::getGLTexture(const SoGLRenderAction * action) const
   // FIXME: CvrCompressedTexturesElement should be FALSE if we're
   // using paletted textures, I believe, and if so, this should be an
   // assert, not an "if". 20041029 mortene.
+  unsigned int compressedsize = 0;
+  const uint8_t * compressed = NULL;
+  //
+  // Lighting forces an uncompressed format below, so don't compress
+  // then either.
   if (cc_glue_has_texture_compression(glw) && !this->isPaletted() &&
+      !lighting &&
       // Important to check this last, as we want to avoid getting an
       // unnecessary cache dependency:
       CvrCompressedTexturesElement::get(state)) {
     assert(internalFormat == 4);
     internalFormat = GL_COMPRESSED_RGBA_ARB;
+
+    // Use data compressed up front in create(), if available.
+    if ((nrtexdims == 3) && cvr_use_s3tc_3d_textures(glw)) {
+      compressed = ((Cvr3DRGBATexture *)this)->getCompressedBuffer(compressedsize);
+      if (compressed) { internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; }
+    }
   }
 
   // Force this internal GL format if lighting is on, so we know which
@@ -530,28 +752,94 @@ CvrTextureObject::getGLTexture(const SoGLRenderAction * action) const
     //
     // 20090730 eigils
     int border = 1;
+    const GLenum format = this->isPaletted() ? gltextureformat : GL_RGBA;
+    const SbVec3s glsize(texdims[0]+2*border, texdims[1]+2*border, 1);
+
+    // Scrubbing through slices makes a lot of textures of the same
+    // size come and go, so reuse the storage of a recently released
+    // texture when possible, instead of allocating new. (Not for
+    // generic compression, as the driver may not be able to compress
+    // sub-images.)
+    const SbBool recyclable = (internalFormat != GL_COMPRESSED_RGBA_ARB);
+    GLuint recycledid;
+
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(gltextypeenum,
-                 0,
-                 internalFormat,
-                 texdims[0]+2*border, texdims[1]+2*border,
-                 border,
-                 this->isPaletted() ? gltextureformat : GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 imgptr);
+    if (recyclable &&
+        CvrResourceManager::getInstance(glctxid)->reuseTexture(glsize, internalFormat,
+                                                               format, recycledid)) {
+      // The recycled texture was set up with the same parameters as
+      // above.
+      glDeleteTextures(1, &texid);
+      texid = recycledid;
+      glBindTexture(gltextypeenum, texid);
+      glTexSubImage2D(gltextypeenum,
+                      0,
+                      -border, -border,
+                      glsize[0], glsize[1],
+                      format,
+                      GL_UNSIGNED_BYTE,
+                      imgptr);
+    }
+    else {
+      glTexImage2D(gltextypeenum,
+                   0,
+                   internalFormat,
+                   glsize[0], glsize[1],
+                   border,
+                   format,
+                   GL_UNSIGNED_BYTE,
+                   imgptr);
+    }
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (recyclable) { cache->setRecyclable(glsize, internalFormat, format); }
+  }
+  else if (compressed) {
+    assert(nrtexdims == 3);
+    const SbBool staged = cvr_stage_texels(glctxid, compressed, compressedsize);
+    cc_glglue_glCompressedTexImage3D(glw,
+                                     gltextypeenum,
+                                     0,
+                                     internalFormat,
+                                     texdims[0], texdims[1], texdims[2],
+                                     0,
+                                     compressedsize,
+                                     staged ? NULL : compressed);
+    if (staged) { cvr_unstage_texels(glctxid); }
   }
   else {
     assert(nrtexdims == 3);
+    const GLenum format = this->isPaletted() ? gltextureformat : GL_RGBA;
+    const unsigned int texelsize = (format == GL_RGBA) ? 4 : 1;
+
+    // Rows of 8-bit texels will not be 4-byte aligned with NPOT
+    // dimensions. The GL default of 4 is fine for everything else, so
+    // only touch the pixel store state when necessary.
+    const SbBool unaligned = ((texdims[0] * texelsize) % 4) != 0;
+    if (unaligned) { glPixelStorei(GL_UNPACK_ALIGNMENT, 1); }
+
+    // The driver may not be able to recompress sub-images into the
+    // generic compressed format, so those are still handed over in
+    // one go.
+    const SbBool staged =
+      (internalFormat != GL_COMPRESSED_RGBA_ARB) &&
+      cvr_stage_texels(glctxid, imgptr,
+                       (size_t)texdims[0] * texdims[1] * texdims[2] * texelsize);
+
+    // With the unpack buffer bound, the NULL pointer is an offset
+    // into it, which lets the GL do the transfer asynchronously.
     cc_glglue_glTexImage3D(glw,
                            gltextypeenum,
                            0,
                            internalFormat,
                            texdims[0], texdims[1], texdims[2],
                            0,
-                           this->isPaletted() ? gltextureformat : GL_RGBA,
+                           format,
                            GL_UNSIGNED_BYTE,
-                           imgptr);
+                           staged ? NULL : imgptr);
+    if (staged) { cvr_unstage_texels(glctxid); }
+
+    if (unaligned) { glPixelStorei(GL_UNPACK_ALIGNMENT, 4); }
   }
 
   { // We've had a report of GL errors here, so dump lots of debug info.
@@ -595,7 +883,8 @@ CvrTextureObject::getGLTexture(const SoGLRenderAction * action) const
   SbList<CvrGLTextureCache *> * l = this->cacheListForGLContext(glctxid);
   if (l == NULL) {
     l = new SbList<CvrGLTextureCache *>;
-    ((CvrTextureObject *)this)->glctxdict.enter((unsigned long)glctxid, l);
+    const uint32_t group = CvrResourceManager::getShareGroup(glctxid);
+    ((CvrTextureObject *)this)->glctxdict.enter((unsigned long)group, l);
   }
   l->append(cache);
 
@@ -639,21 +928,24 @@ CvrTextureObject::findInstanceMatch(const SoType t,
                                     const struct CvrTextureObject::EqualityComparison & obj)
 {
   const unsigned long key = CvrTextureObject::hashKey(obj);
-  void * ptr;
-  const SbBool ok = CvrTextureObject::instancedict->find(key, ptr);
-  if (!ok) { return NULL; }
-
-  // Calculated hash key is not guaranteed to be unique, so a list is
-  // stored in the hash, which we must do comparisons on the elements
-  // in.
-  SbList<CvrTextureObject *> * l = (SbList<CvrTextureObject *> *)ptr;
+  CvrTextureObject * match = NULL;
 
-  for (int i = 0; i < l->getLength(); i++) {
-    CvrTextureObject * to = (*l)[i];
-    if ((to->eqcmp == obj) && (to->getTypeId() == t)) { return to; }
+  CvrTextureObject::instancedictmutex->lock();
+  void * ptr;
+  if (CvrTextureObject::instancedict->find(key, ptr)) {
+    // Calculated hash key is not guaranteed to be unique, so a list is
+    // stored in the hash, which we must do comparisons on the elements
+    // in.
+    SbList<CvrTextureObject *> * l = (SbList<CvrTextureObject *> *)ptr;
+
+    for (int i = 0; (i < l->getLength()) && (match == NULL); i++) {
+      CvrTextureObject * to = (*l)[i];
+      if ((to->eqcmp == obj) && (to->getTypeId() == t)) { match = to; }
+    }
   }
+  CvrTextureObject::instancedictmutex->unlock();
 
-  return NULL;
+  return match;
 }
 
 
@@ -732,12 +1024,26 @@ CvrTextureObject::create(const SoGLRenderAction * action,
     createtype = Cvr3DRGBATexture::getClassTypeId(); 
   }
 
+  // Note that textures are shared between GL contexts, so contexts
+  // with and without support for NPOT textures will get separate
+  // instances.
+  const cc_glglue * glw = cc_glglue_instance(action->getCacheContext());
+  const SbBool npot =
+    cvr_use_npot_textures(glw, paletted &&
+                          CvrCLUT::usePaletteExtension(glw) &&
+                          !CvrCLUT::useFragmentProgramLookup(glw));
+
   struct CvrTextureObject::EqualityComparison incoming;
   incoming.sovolumedata_id = vbelem->getNodeId();
   incoming.cutcube = cutcube; // For 3D tex
   incoming.cutslice = cutslice; // For 2D tex
   incoming.axisidx = axisidx; // For 2D tex
   incoming.pageidx = pageidx; // For 2D tex
+  incoming.npot = npot;
+  // RGBA textures have the CLUT colors baked in (and may be cropped
+  // to what is visible with it), so they can only be shared between
+  // users of equal CLUTs.
+  incoming.clut = paletted ? NULL : clut;
 
   CvrTextureObject * obj =
     CvrTextureObject::findInstanceMatch(createtype, incoming);
@@ -753,26 +1059,69 @@ CvrTextureObject::create(const SoGLRenderAction * action,
   CvrVoxelChunk * input =
     new CvrVoxelChunk(voxdims, vbelem->getBytesPrVoxel(), dataptr);
   CvrVoxelChunk * cubechunk;
+  SbBox3s contentbox(SbVec3s(0, 0, 0), texsize);
   if (is2d) { 
     cubechunk = input->buildSubPage(axisidx, pageidx, cutslice); 
   }
   else { 
     cubechunk = input->buildSubCube(cutcube); 
+
+    // Crop away fully transparent borders of RGBA textures. Paletted
+    // textures can't be cropped, as a palette change could make the
+    // cropped voxels visible, so for those only the geometry is
+    // clipped, see CvrPaletteTexture::getVisibleBox().
+    //
+    // (Not done with the obsolete flipped Y axis, as the sub-cube
+    // data are then stored upside-down versus the geometry.)
+    static int nocropping = -1;
+    if (nocropping == -1) {
+      const char * env = coin_getenv("CVR_NO_TEXTURE_CROPPING");
+      nocropping = env && (atoi(env) > 0);
+    }
+
+    if (!paletted && !nocropping && !CvrUtil::useFlippedYAxis()) {
+      const SbBox3s visible = cubechunk->getVisibleBox(action, clut);
+      if (visible.isEmpty()) {
+        // All voxels are fully transparent, so no texture is needed.
+        delete cubechunk;
+        delete input;
+        return NULL;
+      }
+
+      // Keep a one voxel border of transparent voxels, so linear
+      // interpolation at the edges comes out the same as before.
+      SbVec3s vmin, vmax;
+      visible.getBounds(vmin, vmax);
+      for (unsigned int i = 0; i < 3; i++) {
+        vmin[i] = SbMax(vmin[i] - 1, 0);
+        vmax[i] = SbMin(vmax[i] + 2, (int)texsize[i]);
+      }
+
+      if ((vmin != contentbox.getMin()) || (vmax != contentbox.getMax())) {
+        contentbox.setBounds(vmin, vmax);
+        delete cubechunk;
+        const SbVec3s & cutmin = cutcube.getMin();
+        cubechunk = input->buildSubCube(SbBox3s(cutmin + vmin, cutmin + vmax));
+      }
+    }
   }
   delete input;
 
+  const SbVec3s usedtexsize = contentbox.getMax() - contentbox.getMin();
+
   CvrTextureObject * newtexobj = (CvrTextureObject *)
     createtype.createInstance();
 
   // The actual dimensions of the GL texture must be values that are
-  // power-of-two's:
+  // power-of-two's, unless the NPOT extension is available:
   for (unsigned int i=0; i < 3; i++) {
     // SbMax(4, ...) to work around a crash bug in older NVidia
     // drivers when a lot of 1x- or 2x-dimensions textures are
     // allocated. 20090812 mortene.
     
-    newtexobj->dimensions[i] =
-      SbMax((uint32_t)4, coin_geq_power_of_two(texsize[i]));
+    const uint32_t dim = npot ?
+      (uint32_t)usedtexsize[i] : coin_geq_power_of_two(usedtexsize[i]);
+    newtexobj->dimensions[i] = SbMax((uint32_t)4, dim);
     
   }
 
@@ -801,14 +1150,21 @@ CvrTextureObject::create(const SoGLRenderAction * action,
   // If completely transparent, and not in palette mode, we need not
   // bother with a texture object for this slice/brick at all:
   if (invisible && !paletted) {
-    // FIXME: we get grave mem-leaks by just returning here, I
-    // believe. Audit code in this function. 20041029 mortene.
+    delete newtexobj;
     return NULL;
   }
 
   // Must clear unused texture area to prevent artifacts due to
   // floating point inaccuracies when calculating texture coords.
-  newtexobj->blankUnused(texsize);
+  newtexobj->blankUnused(usedtexsize);
+  newtexobj->contentbox = contentbox;
+
+  if (createtype == Cvr3DRGBATexture::getClassTypeId() && !lighting &&
+      Cvr3DRGBATexture::canCompress(newtexobj->getDimensions()) &&
+      cvr_use_s3tc_3d_textures(glw) &&
+      CvrCompressedTexturesElement::get(action->getState())) {
+    ((Cvr3DRGBATexture *)newtexobj)->compress();
+  }
 
   // We'll self-destruct when the SoVolumeData node is changed.
   //
@@ -820,6 +1176,9 @@ CvrTextureObject::create(const SoGLRenderAction * action,
   // UPDATE: ..or is this already taken care of higher up in the
   // call-chain? I think it may be. Investigate. 20040722 mortene.
   newtexobj->eqcmp = incoming;
+  if (newtexobj->eqcmp.clut) { newtexobj->eqcmp.clut->ref(); }
+
+  CvrTextureObject::instancedictmutex->lock();
 
   const unsigned long key = newtexobj->hashKey();
   void * ptr;
@@ -834,6 +1193,9 @@ CvrTextureObject::create(const SoGLRenderAction * action,
     assert(newentry);
   }
   l->append(newtexobj);
+  newtexobj->indict = TRUE;
+
+  CvrTextureObject::instancedictmutex->unlock();
 
   return newtexobj;
 }
@@ -934,6 +1296,7 @@ CvrTextureObject::hashKey(const struct CvrTextureObject::EqualityComparison & ob
 
   if (obj.axisidx != UINT_MAX) { key += obj.axisidx; }
   if (obj.pageidx != INT_MAX) { key += obj.pageidx; }
+  if (obj.clut) { key += obj.clut->getChecksum(); }
 
   SbBox3s empty3;
   if (obj.cutcube.getMin() != empty3.getMin()) {
@@ -970,7 +1333,10 @@ CvrTextureObject::EqualityComparison::operator==(const CvrTextureObject::Equalit
     (this->cutcube.getMax() == obj.cutcube.getMax()) &&
     (this->cutslice == obj.cutslice) &&
     (this->axisidx == obj.axisidx) &&
-    (this->pageidx == obj.pageidx);
+    (this->pageidx == obj.pageidx) &&
+    (this->npot == obj.npot) &&
+    ((this->clut == obj.clut) ||
+     (this->clut && obj.clut && (*this->clut == *obj.clut)));
 }
 
 // *************************************************************************
@@ -44,6 +44,7 @@
 class SoGLRenderAction;
 class SbVec2s;
 class CvrGLTextureCache;
+class SbMutex;
 
 // *************************************************************************
 
@@ -71,10 +72,12 @@ public:
   void unref(void) const;
 
   const SbVec3s & getDimensions(void) const;
+  const SbBox3s & getContentBox(void) const;
 
   void activateTexture(const SoGLRenderAction * action) const;
 
   virtual SbBool isPaletted(void) const = 0;
+  virtual SbBool isOpaque(const CvrCLUT * clut) const = 0;
   virtual void blankUnused(const SbVec3s & texsize) const = 0;
   virtual unsigned short getNrOfTextureDimensions(void) const = 0;
 
@@ -98,8 +101,11 @@ private:
 
   static SoType classTypeId;
   SbVec3s dimensions;
+  SbBox3s contentbox;
   uint32_t refcounter;
+  SbBool indict; // if in the list of instances looked up by create()
   static SbDict * instancedict;
+  static SbMutex * instancedictmutex;
   SbDict glctxdict;
 
   SbList<CvrGLTextureCache *> * cacheListForGLContext(const uint32_t glctxid) const;
@@ -113,6 +119,10 @@ private:
     SbBox2s cutslice;
     unsigned int axisidx;
     int pageidx;
+    // non-power-of-two dimensions used for the GL texture
+    SbBool npot;
+    // the CLUT baked into RGBA textures, NULL for paletted textures
+    const CvrCLUT * clut;
 
     int operator==(const struct EqualityComparison & cmp);
   } eqcmp;